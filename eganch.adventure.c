@@ -4,434 +4,3550 @@
  * It provides an interface for the user to navigate through the rooms from the start
  * room until they reach the end room at which point they "win." The user can also
  * request and receive the current local time that is printed to the screen and stored
- * in a file.
+ * in a file by a long running time service thread, or type "hint" for the next room
+ * on the shortest path to the end room. With --batch the moves are read
+ * from a script instead and a one line JSON summary is printed at the end. With
+ * --server the world is loaded once and played by many sessions at a time over a
+ * Unix domain socket. Worlds are either a directory of room files or one packed world file
+ * (see eganch.world.h) which is mapped into memory and used in place. The newest
+ * world, or one picked by id, is found through the catalog (see eganch.catalog.h).
+ * With --shared the first process to load a world publishes it, packed, in a
+ * POSIX shared memory segment and later processes attach to that instead.
+ * Built with -DEMBEDDED_WORLD='"FILE"', where FILE was written by
+ * eganch.buildrooms --embed, it plays only that world, compiled in as constant
+ * arrays, and reads no files to start.
  * AUTHOR: Chelsea Egan (eganch@oregonstate.edu)
  */
 
+#define _GNU_SOURCE
+
 #include <assert.h>
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
 #include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <time.h>
+#include <unistd.h>
+
+#include "eganch.arena.h"
+#include "eganch.catalog.h"
+#include "eganch.journal.h"
+#include "eganch.random.h"
+#include "eganch.stats.h"
+#include "eganch.world.h"
+
+#ifdef EMBEDDED_WORLD
+#include EMBEDDED_WORLD
+#endif
 
 #define BUFFER_SIZE 256
-#define NUM_ROOMS 7
-#define ROOM_NAME_SIZE 12
-#define ROOM_TYPE_SIZE 11
-#define TIME_CODE 10
+#define BATCH_BUFFER_SIZE (1 << 20)
+#define MAX_EVENTS 256
+#define MAX_WORKERS 64
+#define SERVER_POLL_MS 200
+#define NUM_CONNECTIONS 6
+#define ARENA_START_SIZE (1 << 16)
+#define ROOM_FILE_SIZE (1 << 16)
+#define TIME_CODE -2
+#define HINT_CODE -3
+#define SAVE_CODE -4
+#define LOAD_CODE -5
+#define DISTANCE_TABLE_MIN_ROOMS 65536
+#define BENCH_SOLVER_SEARCHES 100
+#define PATH_LOG_SIZE 4096
+#define MAX_VARINT_SIZE 5
+#define VISITED_EMPTY 0
+#define VISITED_HASH 0x9E3779B97F4A7C15ULL
 #define TIME_FILE_NAME "currentTime.txt"
+#define SAVE_FILE_NAME "eganch.save"
+#define SAVE_MAGIC "EGSAVE"
+#define SAVE_MAGIC_SIZE 8
+#define SAVE_VERSION 1
+#define SIMULATION_MAX_STEPS 1000000
+#define SHARED_WORLD_MAGIC "EGSHARE"
+#define SHARED_WORLD_VERSION 2
+#define SHARED_MEMORY_DIRECTORY "/dev/shm"
+#define ROOM_TEXT_MAX_ROOMS (1 << 20)
+#define LOCATION_TEXT "\nCURRENT LOCATION: "
+#define CONNECTIONS_TEXT "\nPOSSIBLE CONNECTIONS: "
+#define PROMPT_TEXT "WHERE TO? >"
+#define INVALID_ROOM_TEXT "\nHUH? I DON'T UNDERSTAND THAT ROOM. TRY AGAIN.\n"
+#define TIME_FORMAT "%l:%M%P, %A, %B %e, %Y%n%n"
 #define TRUE 0
 #define FALSE 1
 
 int startRoomIndex = -1;
 int endRoomIndex = -1;
+int numRooms = 0;
+char worldPath[BUFFER_SIZE];
 
 pthread_mutex_t lock;
 pthread_t threadID;
 
-struct Room* rooms;
-struct Room {
-    char roomName[ROOM_NAME_SIZE];
-    char roomType[ROOM_TYPE_SIZE];
-    char* connections[6];
-    int index;
-    int numConnections;
+/* Long running thread that formats the time for any number of requesters.
+ * Requests take a ticket and wait until the service has completed it, so
+ * requests that arrive together are answered by one clock read. */
+struct TimeService timeService;
+struct TimeService {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t requestReady;
+    pthread_cond_t responseReady;
+    unsigned long long requested;
+    unsigned long long completed;
+    char timeString[BUFFER_SIZE];
+    int writeFile;
+    int running;
+};
+
+/* The loaded world in compressed sparse row form. Room i's connections are
+ * connections[connectionOffsets[i]] up to connections[connectionOffsets[i + 1]].
+ * For a packed world file the arrays point straight into the mapped file,
+ * for room files they are laid out the same way in one arena. */
+struct World world;
+struct World {
+    uint64_t numConnections;
+    const uint32_t* connectionOffsets;
+    const uint32_t* connections;
+    const uint32_t* nameOffsets;
+    const char* names;
+    const uint32_t* nameIndex;
+    uint64_t nameIndexSize;
+    void* mapping;
+    size_t mappingSize;
+    const struct WorldHeader* image;
+    struct Arena arena;
+    int edited;
+};
+
+/* Edits from a packed world's journal, replayed over the mapped file at load
+ * (see eganch.journal.h). Only used when world.edited is set. */
+struct WorldEdits edits;
+
+/* Where each array of a world read from room files starts in its arena */
+struct ArenaLayout arenaLayout;
+struct ArenaLayout {
+    size_t names;
+    size_t nameOffsets;
+    size_t connectionOffsets;
+    size_t nameIndex;
+    size_t connections;
 };
 
+/* The rooms a player has moved to, kept as a log of room id deltas from the
+ * previous room (starting at the start room), zigzag encoded so small steps
+ * either way are small numbers, then written as little endian base 128
+ * varints. Only PATH_LOG_SIZE bytes are held in memory, older bytes are
+ * spilled to the path log file. The rooms visited so far are kept in an open
+ * addressing set of room id + 1 so the summary needs no pass over the log. */
 struct UserPath path;
 struct UserPath {
-    int* path;
-    int pathSize;
-    int pathUsed;
+    unsigned char* log;
+    size_t logUsed;
+    FILE* spill;
+    char* spillName;
+    int lastRoom;
+    long long steps;
+    long long loops;
+    uint32_t* visited;
+    uint64_t visitedSize;
+    long long uniqueRooms;
+};
+
+/* Walks the rooms in a path log from the first move to the last */
+struct PathReader {
+    struct UserPath* path;
+    FILE* spill;
+    size_t position;
+    int room;
+    long long remaining;
+};
+
+/* Distance from every room to the end room, built at load time for large
+ * worlds so hints do not need a search, and the shortest path's length */
+int* distanceToEnd = NULL;
+int shortestPathLength = -1;
+
+/* Set by --path-summary to print step, room and loop counts instead of the whole path */
+int pathSummary = FALSE;
+
+/* Set by --path-log to keep the spilled path in a named file */
+char* pathLogName = NULL;
+
+/* A saved game is this header, the path log (the spilled part, then the part
+ * in memory) and the visited set, so a game of any length is restored with
+ * one read and no moves replayed. The world is identified by its
+ * fingerprint. The checksum covers every byte after the header. */
+struct SaveHeader {
+    char magic[SAVE_MAGIC_SIZE];
+    uint32_t version;
+    uint32_t numRooms;
+    uint64_t worldFingerprint;
+    char worldPath[BUFFER_SIZE];
+    int32_t currentRoom;
+    int32_t padding;
+    int64_t steps;
+    int64_t loops;
+    int64_t uniqueRooms;
+    uint64_t logSize;
+    uint64_t visitedSize;
+    uint64_t checksum;
+};
+
+/* What is printed for each room on each turn, rendered once before play so
+ * a turn is a single write. Room i's text is text[offsets[i]] up to
+ * text[offsets[i + 1]]. Worlds of more than ROOM_TEXT_MAX_ROOMS rooms are not
+ * rendered ahead; their text is rendered into scratch on each turn. */
+struct RoomText roomText;
+struct RoomText {
+    char* text;
+    uint64_t* offsets;
+    char* scratch;
+    size_t scratchSize;
+};
+
+/* A world published with --shared is this header followed by the world in the
+ * packed file layout (see eganch.world.h), which uses offsets rather than
+ * pointers so it works wherever it is mapped. The segment is named after the
+ * world's path alone, and its key records when the world and its journal last
+ * changed, so an edited world's segment is replaced rather than left behind.
+ * Segments are filled under a name of their own and renamed into place, so a
+ * segment under a world's name is always complete. */
+struct SharedWorldHeader {
+    char magic[WORLD_MAGIC_SIZE];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t key;
+    uint64_t fingerprint;
+    uint64_t worldStart;
 };
 
+/* Set by --shared */
+int sharedWorld = FALSE;
+
+/* Worked out once, by getWorldFingerprint or from a shared world's header */
+uint64_t worldFingerprint = 0;
+int worldFingerprintKnown = FALSE;
+
+/* Set by --save-file and --resume */
+char* saveFileName = SAVE_FILE_NAME;
+int resumeGame = FALSE;
+
+/* What the game has done so far, dumped with --stats (see eganch.stats.h).
+ * Commands are timed from reading them to finishing their response. Turn
+ * writes and bytes count the room text written by interactive play. */
+char* statsFileName = NULL;
+int statsEnabled = FALSE;
+uint64_t statsStart;
+uint64_t commandStart;
+struct AdventureStats stats;
+struct AdventureStats {
+    uint64_t directoryEntries;
+    uint64_t filesRead;
+    uint64_t bytesRead;
+    uint64_t bytesMapped;
+    uint64_t loadNs;
+    uint64_t turnWrites;
+    uint64_t turnBytes;
+    struct LatencyHistogram moves;
+    struct LatencyHistogram invalidCommands;
+    struct LatencyHistogram timeRequests;
+    struct LatencyHistogram hints;
+};
+
+/* Pending output for a server session */
+struct OutputBuffer {
+    char* data;
+    size_t size;
+    size_t used;
+    size_t sent;
+};
+
+/* One player connected to the server. The world is shared, so a session
+ * only holds where the player is and where they have been. */
+struct Session {
+    int socket;
+    int currentRoomIndex;
+    int finished;
+    int inputUsed;
+    char input[BUFFER_SIZE];
+    struct UserPath path;
+    struct OutputBuffer output;
+};
+
+/* A server thread with its own epoll instance and the sessions it accepted */
+struct ServerWorker {
+    pthread_t thread;
+    int epollFd;
+    long long sessionsStarted;
+    long long sessionsFinished;
+    long long commands;
+};
+
+int listenSocket = -1;
+volatile sig_atomic_t serverRunning = FALSE;
+
+/* Simulated players. A random player takes any connection; a greedy player
+ * takes a connection it has not been through yet when there is one, and
+ * only backtracks at random when every neighbor has been seen. */
+enum simulatedPlayers {RANDOM_PLAYER, GREEDY_PLAYER, NUM_PLAYERS};
+const char* playerNames[] = {"RANDOM", "GREEDY"};
+
+/* Set by --seed and --max-steps for --simulate */
+uint64_t simulationSeed = 1;
+uint32_t simulationMaxSteps = SIMULATION_MAX_STEPS;
+
+/* A simulation thread. It plays its own range of walks into its own part of
+ * the results and keeps its own visit stamps, so the threads share nothing
+ * they write. Walk i always uses random stream i of the seed, so results do
+ * not depend on the number of threads. */
+struct SimulationWorker {
+    pthread_t thread;
+    int player;
+    long long firstWalk;
+    long long numWalks;
+    long long unfinished;
+    uint32_t* steps;
+    uint32_t* lastVisit;
+};
+
+/*
+ * NAME: markVisited
+ * PARAMS: Pointer to the path struct and int holding the room index
+ * RETURN: Int indicating if the room is new
+ * DESCRIPTION: Adds a room to the visited set, growing the set once it is
+ * half full. Returns 0 if the room had not been visited before, 1 otherwise.
+ */
+int markVisited(struct UserPath* path, int roomIndex) {
+    uint64_t mask = path->visitedSize - 1;
+    uint64_t slot = ((uint64_t)roomIndex * VISITED_HASH) >> 32 & mask;
+
+    while (path->visited[slot] != VISITED_EMPTY) {
+        if (path->visited[slot] == (uint32_t)roomIndex + 1) {
+            return FALSE;
+        }
+        slot = (slot + 1) & mask;
+    }
+    path->visited[slot] = (uint32_t)roomIndex + 1;
+    path->uniqueRooms++;
+
+    if ((uint64_t)path->uniqueRooms * 2 > path->visitedSize) {
+        uint32_t* oldVisited = path->visited;
+        uint64_t oldSize = path->visitedSize;
+        uint64_t i;
+
+        path->visitedSize *= 2;
+        path->visited = calloc(path->visitedSize, sizeof(uint32_t));
+        assert(path->visited != NULL);
+        path->uniqueRooms = 0;
+        for (i = 0; i < oldSize; i++) {
+            if (oldVisited[i] != VISITED_EMPTY) {
+                markVisited(path, oldVisited[i] - 1);
+            }
+        }
+        free(oldVisited);
+    }
+
+    return TRUE;
+}
+
 /*
  * NAME: initPath
- * PARAMS: none
+ * PARAMS: Pointer to the path struct and pointer to the name of the path log
+ * file, NULL for an unnamed temporary file
  * RETURN: void
  * DESCRIPTION: Creates the struct that stores info about the user's path
  */
-void initPath(){
-    path.path = (int *)malloc(10 * sizeof(int));
-    path.pathUsed = 0;
-    path.pathSize = 10;
+void initPath(struct UserPath* path, char* spillName) {
+    memset(path, 0, sizeof(struct UserPath));
+    path->log = malloc(PATH_LOG_SIZE);
+    path->visitedSize = 16;
+    path->visited = calloc(path->visitedSize, sizeof(uint32_t));
+    assert(path->log != NULL && path->visited != NULL);
+    path->spillName = spillName;
+    path->lastRoom = startRoomIndex;
+    markVisited(path, startRoomIndex);
+}
+
+/*
+ * NAME: openPathLog
+ * PARAMS: Pointer to the path struct
+ * RETURN: void
+ * DESCRIPTION: Opens the path log file if it is not open yet
+ */
+void openPathLog(struct UserPath* path) {
+    if (path->spill == NULL) {
+        path->spill = (path->spillName != NULL) ? fopen(path->spillName, "w+") : tmpfile();
+        if (path->spill == NULL) {
+            printf("ERROR: Failed to open the path log. Exiting.\n");
+            exit(1);
+        }
+    }
+}
+
+/*
+ * NAME: spillPath
+ * PARAMS: Pointer to the path struct
+ * RETURN: void
+ * DESCRIPTION: Appends the in memory part of the log to the path log file,
+ * opening the file the first time
+ */
+void spillPath(struct UserPath* path) {
+    openPathLog(path);
+
+    /* The file may have been read since the last spill */
+    fseek(path->spill, 0, SEEK_END);
+    if (fwrite(path->log, 1, path->logUsed, path->spill) != path->logUsed) {
+        printf("ERROR: Failed to write the path log. Exiting.\n");
+        exit(1);
+    }
+    path->logUsed = 0;
 }
 
 /*
  * NAME: addToPath
- * PARAMS: Int holding index of room to be added to path
+ * PARAMS: Pointer to the path struct and int holding index of room to be added to path
  * RETURN: void
  * DESCRIPTION: Updates the user path with new room
  */
-void addToPath(int roomIndex) {
-    if (path.pathUsed == path.pathSize) {
-        path.pathSize *= 2;
-        path.path = (int *)realloc(path.path, path.pathSize * sizeof(int));
+void addToPath(struct UserPath* path, int roomIndex) {
+    int64_t delta = (int64_t)roomIndex - path->lastRoom;
+    uint64_t value = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+
+    /* Varints never straddle a spill so the log can be read back a byte at a time */
+    if (path->logUsed + MAX_VARINT_SIZE > PATH_LOG_SIZE) {
+        spillPath(path);
+    }
+
+    while (value >= 0x80) {
+        path->log[path->logUsed++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    path->log[path->logUsed++] = (unsigned char)value;
+
+    path->lastRoom = roomIndex;
+    path->steps++;
+    if (markVisited(path, roomIndex) == FALSE) {
+        path->loops++;
+    }
+}
+
+/*
+ * NAME: startPathReader
+ * PARAMS: Pointer to the reader and pointer to the path struct
+ * RETURN: void
+ * DESCRIPTION: Starts reading a path from its first move, rewinding the path
+ * log file if part of the path was spilled
+ */
+void startPathReader(struct PathReader* reader, struct UserPath* path) {
+    reader->path = path;
+    reader->spill = path->spill;
+    reader->position = 0;
+    reader->room = startRoomIndex;
+    reader->remaining = path->steps;
+
+    if (reader->spill != NULL) {
+        fflush(reader->spill);
+        rewind(reader->spill);
+    }
+}
+
+/*
+ * NAME: readPathByte
+ * PARAMS: Pointer to the reader
+ * RETURN: The next byte of the log
+ * DESCRIPTION: Reads the spilled part of the log and then the part in memory
+ */
+int readPathByte(struct PathReader* reader) {
+    if (reader->spill != NULL) {
+        int byte = getc(reader->spill);
+        if (byte != EOF) {
+            return byte;
+        }
+        reader->spill = NULL;
+    }
+    return reader->path->log[reader->position++];
+}
+
+/*
+ * NAME: nextPathRoom
+ * PARAMS: Pointer to the reader
+ * RETURN: Int holding the index of the next room in the path, -1 at the end
+ * DESCRIPTION: Decodes one move from the log
+ */
+int nextPathRoom(struct PathReader* reader) {
+    uint64_t value = 0;
+    int shift = 0;
+    int byte;
+
+    if (reader->remaining == 0) {
+        return -1;
     }
 
-    path.path[path.pathUsed++] = roomIndex;
+    do {
+        byte = readPathByte(reader);
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    reader->room += (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+    reader->remaining--;
+    return reader->room;
+}
+
+/*
+ * NAME: freePath
+ * PARAMS: Pointer to the path struct
+ * RETURN: void
+ * DESCRIPTION: Frees the path and closes its log file. A named path log is
+ * flushed first so it holds the whole path.
+ */
+void freePath(struct UserPath* path) {
+    if (path->spillName != NULL && path->log != NULL) {
+        spillPath(path);
+    }
+    if (path->spill != NULL) {
+        fclose(path->spill);
+    }
+    free(path->log);
+    free(path->visited);
 }
 
 /*
  * NAME: getRoomsDirectory
  * PARAMS: none
  * RETURN: void
- * DESCRIPTION: Find the directory that is holding the rooms file and change into it
+ * DESCRIPTION: Find the newest rooms directory or packed world file and store
+ * its name. The catalog's latest link is used when it points at a world,
+ * otherwise every entry in the current directory is checked.
  */
 void getRoomsDirectory() {
     DIR* rootDir;
     char targetDirPrefix[32] = "eganch.rooms.";
-    char newestDirName[BUFFER_SIZE];
     struct dirent *fileInDir;
     struct stat dirAttributes;
     int newestDirTime = -1;
 
+    memset(worldPath, '\0', sizeof(worldPath));
+
+    ssize_t length = readlink(LATEST_LINK_NAME, worldPath, sizeof(worldPath) - 1);
+    if (length > 0 && access(worldPath, F_OK) == TRUE) {
+        return;
+    }
+    memset(worldPath, '\0', sizeof(worldPath));
+
     rootDir = opendir(".");
     assert(rootDir > 0);
 
     while ((fileInDir = readdir(rootDir)) != NULL) {
+        stats.directoryEntries++;
         if (strstr(fileInDir->d_name, targetDirPrefix) != NULL) {
+            /* Skip world files that are still being written, and journals */
+            if (strstr(fileInDir->d_name, ".tmp") != NULL || strstr(fileInDir->d_name, JOURNAL_SUFFIX) != NULL) {
+                continue;
+            }
+
             /* Check if this file was created newer than previous */
             stat(fileInDir->d_name, &dirAttributes);
             if ((int)dirAttributes.st_mtime > newestDirTime) {
                 newestDirTime = (int) dirAttributes.st_mtime;
-                memset(newestDirName, '\0', sizeof(newestDirName));
-                strcpy(newestDirName, fileInDir->d_name);
+                snprintf(worldPath, sizeof(worldPath), "%s", fileInDir->d_name);
             }
         }
     }
 
-    int result = chdir(newestDirName);
-    assert(result == TRUE);
+    if (newestDirTime == -1) {
+        printf("ERROR: No rooms found. Run eganch.buildrooms first. Exiting.\n");
+        exit(1);
+    }
 
     closedir(rootDir);
 }
 
 /*
- * NAME: getRoomInfo
- * PARAMS: none
- * RETURN: Pointer to array of room structs
- * DESCRIPTION: Reads each room file and stores the info in the structs
+ * NAME: findCatalogWorld
+ * PARAMS: Pointer to the world id
+ * RETURN: void
+ * DESCRIPTION: Looks a world up by id in the catalog and stores its name
  */
-struct Room* getRoomInfo() {
-    DIR* roomsDir;
-    FILE* filePtr;
-    struct dirent* fileInDir;
-    char buffer[BUFFER_SIZE];
-    int roomIndex = 0;
+void findCatalogWorld(char* worldId) {
+    struct CatalogEntry entry;
+    char line[CATALOG_LINE_SIZE];
+    FILE* catalog = fopen(CATALOG_FILE_NAME, "r");
 
-    rooms = malloc(NUM_ROOMS * sizeof(struct Room));
+    if (catalog == NULL) {
+        printf("ERROR: No world catalog found. Run eganch.buildrooms first. Exiting.\n");
+        exit(1);
+    }
 
-    roomsDir = opendir(".");
-    assert(roomsDir != NULL);
-    
-    while ((fileInDir = readdir(roomsDir))) {
-        /* Skip files of current and parent diretory */
-        if (!strcmp(fileInDir->d_name, ".")) {
-            continue;
-        }
-        if (!strcmp(fileInDir->d_name, "..")) {
-            continue;
+    while (fgets(line, sizeof(line), catalog) != NULL) {
+        if (parseCatalogEntry(line, &entry) == 0 && strcmp(entry.id, worldId) == TRUE) {
+            memset(worldPath, '\0', sizeof(worldPath));
+            strncpy(worldPath, entry.name, sizeof(worldPath) - 1);
+            fclose(catalog);
+            return;
         }
+    }
 
-        memset(buffer, '\0', BUFFER_SIZE);
-
-        filePtr = fopen(fileInDir->d_name, "r");
-        assert(filePtr != NULL);
+    printf("ERROR: No world with id %s in %s. Exiting.\n", worldId, CATALOG_FILE_NAME);
+    exit(1);
+}
 
-        memset(rooms[roomIndex].roomName, '\0', ROOM_NAME_SIZE);
-        memset(rooms[roomIndex].roomType, '\0', ROOM_TYPE_SIZE);
-        rooms[roomIndex].numConnections = 0;
-        rooms[roomIndex].index = roomIndex;
+/*
+ * NAME: getRoomName
+ * PARAMS: Int holding the room index
+ * RETURN: Pointer to the room's name
+ * DESCRIPTION: Returns the name of a room
+ */
+const char* getRoomName(int roomIndex) {
+#ifdef EMBEDDED_WORLD
+    return embeddedNames + embeddedNameOffsets[roomIndex];
+#else
+    if (world.edited == TRUE) {
+        return getEditedRoomName(&edits, roomIndex);
+    }
+    return world.names + world.nameOffsets[roomIndex];
+#endif
+}
 
-        if (fgets(buffer, BUFFER_SIZE, filePtr) == NULL) {
-            printf("ERROR: Failed to read file %s. Exiting. \n");
-            exit(1);
-        }
+/*
+ * NAME: getNumConnections
+ * PARAMS: Int holding the room index
+ * RETURN: Int holding the number of connections
+ * DESCRIPTION: Returns how many rooms a room is connected to
+ */
+int getNumConnections(int roomIndex) {
+#ifdef EMBEDDED_WORLD
+    return embeddedConnectionOffsets[roomIndex + 1] - embeddedConnectionOffsets[roomIndex];
+#else
+    if (world.edited == TRUE) {
+        return getEditedNumConnections(&edits, roomIndex);
+    }
+    return world.connectionOffsets[roomIndex + 1] - world.connectionOffsets[roomIndex];
+#endif
+}
 
-        int length = strcspn(buffer, "\n");
+/*
+ * NAME: getConnection
+ * PARAMS: Int holding the room index and int holding the connection number
+ * RETURN: Int holding the index of the connected room
+ * DESCRIPTION: Returns the index of a room's nth connection
+ */
+int getConnection(int roomIndex, int connection) {
+#ifdef EMBEDDED_WORLD
+    return embeddedConnections[embeddedConnectionOffsets[roomIndex] + connection];
+#else
+    if (world.edited == TRUE) {
+        return getEditedConnection(&edits, roomIndex, connection);
+    }
+    return world.connections[world.connectionOffsets[roomIndex] + connection];
+#endif
+}
 
-        strncpy(rooms[roomIndex].roomName, buffer + 11, length - 11);
+/*
+ * NAME: findRoomByName
+ * PARAMS: Pointer to a room name
+ * RETURN: Int with the room index, -1 if no room has that name
+ * DESCRIPTION: Looks up a room through the hashed name index
+ */
+int findRoomByName(const char* roomName) {
+#ifdef EMBEDDED_WORLD
+    return (int)findNameIndex(embeddedNameIndex, EMBEDDED_NAME_INDEX_SIZE, roomName, embeddedNames,
+                              embeddedNameOffsets);
+#else
+    if (world.edited == TRUE) {
+        return (int)findEditedRoomByName(&edits, roomName);
+    }
+    return (int)findNameIndex(world.nameIndex, world.nameIndexSize, roomName, world.names, world.nameOffsets);
+#endif
+}
 
-        int connectionIndex = 0;
-        while (strstr(fgets(buffer, BUFFER_SIZE, (FILE*)filePtr), "CONNECTION") != NULL) {
-            rooms[roomIndex].connections[connectionIndex] = malloc(ROOM_NAME_SIZE * sizeof(char));
-            memset(rooms[roomIndex].connections[connectionIndex], '\0', ROOM_NAME_SIZE);
+/*
+ * NAME: pointWorldAtArena
+ * PARAMS: none
+ * RETURN: void
+ * DESCRIPTION: Points the world at its arrays in the arena. Called again
+ * whenever the arena grows, since growing may move it.
+ */
+void pointWorldAtArena() {
+    struct Arena* arena = &world.arena;
+
+    world.names = getArenaPointer(arena, arenaLayout.names);
+    world.nameOffsets = getArenaPointer(arena, arenaLayout.nameOffsets);
+    world.connectionOffsets = getArenaPointer(arena, arenaLayout.connectionOffsets);
+    world.nameIndex = getArenaPointer(arena, arenaLayout.nameIndex);
+    world.connections = getArenaPointer(arena, arenaLayout.connections);
+}
 
-            length = strcspn(buffer, "\n");
+/*
+ * NAME: buildNameIndex
+ * PARAMS: none
+ * RETURN: void
+ * DESCRIPTION: Builds the hashed name index for a world read from room files
+ */
+void buildNameIndex() {
+    uint32_t* nameIndex = (uint32_t*)world.nameIndex;
 
-            strncpy(rooms[roomIndex].connections[connectionIndex], buffer + 14, length - 14);
+    memset(nameIndex, 0, world.nameIndexSize * sizeof(uint32_t));
 
-            rooms[roomIndex].numConnections++;
-            connectionIndex++;
+    int i;
+    for (i = 0; i < numRooms; i++) {
+        if (findRoomByName(getRoomName(i)) != -1) {
+            printf("ERROR: More than one room is named %s. Exiting.\n", getRoomName(i));
+            exit(1);
         }
+        insertNameIndex(nameIndex, world.nameIndexSize, getRoomName(i), i);
+    }
+}
+
+/*
+ * NAME: readRoomNames
+ * PARAMS: none
+ * RETURN: void
+ * DESCRIPTION: Room files are named after their rooms, so the directory
+ * listing alone gives every room's name. The names are stored once, back to
+ * back at the start of the arena, and the rest of the world is laid out
+ * after them now that the number of rooms is known.
+ */
+void readRoomNames() {
+    struct Arena* arena = &world.arena;
+    struct dirent* fileInDir;
+    struct stat dirAttributes;
+    DIR* roomsDir = opendir(".");
+    assert(roomsDir != NULL);
 
-        length = strcspn(buffer, "\n");
+    /* A directory is at least as large as the names in it, so one allocation usually holds them */
+    int result = fstat(dirfd(roomsDir), &dirAttributes);
+    assert(result == TRUE);
+    initArena(arena, (dirAttributes.st_size > ARENA_START_SIZE) ? dirAttributes.st_size : ARENA_START_SIZE);
 
-        /* Copy the buffer starting after "ROOM TYPE: " excluding the newline */
-        strncpy(rooms[roomIndex].roomType, buffer + 11, length - 11);
+    arenaLayout.names = arena->used;
+    numRooms = 0;
+    while ((fileInDir = readdir(roomsDir))) {
+        stats.directoryEntries++;
 
-        if (strcmp(rooms[roomIndex].roomType, "START_ROOM") == TRUE) {
-            startRoomIndex = roomIndex;
-        } else if (strcmp(rooms[roomIndex].roomType, "END_ROOM") == TRUE) {
-            endRoomIndex = roomIndex;
+        /* Skip files of current and parent diretory */
+        if (!strcmp(fileInDir->d_name, ".")) {
+            continue;
+        }
+        if (!strcmp(fileInDir->d_name, "..")) {
+            continue;
         }
 
-        fclose(filePtr);
-        roomIndex++;
+        size_t length = strlen(fileInDir->d_name) + 1;
+        memcpy(getArenaPointer(arena, allocateArena(arena, length, 1)), fileInDir->d_name, length);
+        numRooms++;
     }
-
     closedir(roomsDir);
-    chdir("..");
+    size_t namesEnd = arena->used;
+
+    /* Lay out the rest of the world, leaving room for an average of
+     * NUM_CONNECTIONS connection names and indexes per room before the arena
+     * has to grow */
+    size_t namesSize = namesEnd - arenaLayout.names;
+    world.nameIndexSize = getNameIndexSize(numRooms);
+    reserveArena(arena, ((size_t)numRooms * (2 + NUM_CONNECTIONS) + world.nameIndexSize + 1) * sizeof(uint32_t)
+                        + namesSize * NUM_CONNECTIONS + 4 * ARENA_ALIGNMENT);
+    arenaLayout.nameOffsets = allocateArena(arena, (size_t)numRooms * sizeof(uint32_t), ARENA_ALIGNMENT);
+    arenaLayout.connectionOffsets = allocateArena(arena, ((size_t)numRooms + 1) * sizeof(uint32_t), ARENA_ALIGNMENT);
+    arenaLayout.nameIndex = allocateArena(arena, world.nameIndexSize * sizeof(uint32_t), ARENA_ALIGNMENT);
+    arenaLayout.connections = allocateArena(arena, 0, ARENA_ALIGNMENT);
+    pointWorldAtArena();
+
+    uint32_t* nameOffsets = (uint32_t*)world.nameOffsets;
+    size_t offset = 0;
+    int i;
+    for (i = 0; i < numRooms; i++) {
+        nameOffsets[i] = offset;
+        offset += strlen(world.names + offset) + 1;
+    }
+    assert(offset == namesSize);
 
-    return rooms;
+    buildNameIndex();
 }
 
 /*
- * NAME: printRoomInfo
- * PARAMS: Int holding the current room index
+ * NAME: resolveConnections
+ * PARAMS: Int holding the arena offset of the connection names
  * RETURN: void
- * DESCRIPTION: Prints the name and connections of the current room.
- * Then prompts for next room.
+ * DESCRIPTION: Turns the connection names read from the room files into room
+ * indexes, then moves the indexes down over the names so the world's arrays
+ * end the arena with nothing in between. The names are all looked up
+ * together, after the files are read, because the index and name table stay
+ * in cache between lookups then, which makes them several times faster than
+ * looking each one up between file reads.
  */
-void printRoomInfo(int roomIndex) {
-    printf("\nCURRENT LOCATION: %s\n", rooms[roomIndex].roomName);
+void resolveConnections(size_t connectionNamesStart) {
+    struct Arena* arena = &world.arena;
+    uint64_t numConnections = world.numConnections;
 
-    printf("POSSIBLE CONNECTIONS: ");
-    int i;
-    for (i = 0; i < rooms[roomIndex].numConnections; i++) {
-        /* If it's the last connection, print with a period instead of a comma */
-        if (i == rooms[roomIndex].numConnections - 1) {
-            printf("%s.\n", rooms[roomIndex].connections[i]);
-        } else {
-            printf("%s, ", rooms[roomIndex].connections[i]);
+    arenaLayout.connections = allocateArena(arena, numConnections * sizeof(uint32_t), ARENA_ALIGNMENT);
+    pointWorldAtArena();
+
+    uint32_t* connections = (uint32_t*)world.connections;
+    const char* name = getArenaPointer(arena, connectionNamesStart);
+    uint64_t i;
+    for (i = 0; i < numConnections; i++) {
+        int room = findRoomByName(name);
+
+        if (room == -1) {
+            printf("ERROR: Connection to unknown room %s. Exiting.\n", name);
+            exit(1);
         }
+        connections[i] = room;
+        name += strlen(name) + 1;
     }
 
-    printf("WHERE TO? >");
+    memmove(getArenaPointer(arena, connectionNamesStart), connections, numConnections * sizeof(uint32_t));
+    arena->used = connectionNamesStart + numConnections * sizeof(uint32_t);
+    arenaLayout.connections = connectionNamesStart;
+    pointWorldAtArena();
 }
 
 /*
- * NAME: checkRoomIsValid
- * PARAMS: Pointer to char array holding the room name
- * RETURN: Int with room index if valid, else -1
- * DESCRIPTION: If the user entered "time" returns int indicating as such.
- * Otherwise, checks if the room name matches any in the room structs.
- * Returns the index if found, -1 if not found.
+ * NAME: getRoomInfo
+ * PARAMS: none
+ * RETURN: void
+ * DESCRIPTION: Reads each room file in the current directory and builds the
+ * world from them in one arena. Connection names are only kept until they
+ * are resolved to room indexes, so each name ends up stored once and loading
+ * takes a few allocations whatever the size of the world.
  */
-int checkRoomIsValid(char* roomName, int currentRoomIndex) {
-    if (strcmp("time", roomName) == TRUE) {
-        return TIME_CODE;
-    }
+void getRoomInfo() {
+    struct Arena* arena = &world.arena;
+    char buffer[ROOM_FILE_SIZE];
+    uint64_t numConnections = 0;
+
+    readRoomNames();
+    size_t connectionNamesStart = arena->used;
+
+    int roomIndex;
+    for (roomIndex = 0; roomIndex < numRooms; roomIndex++) {
+        /* Connection names added to the arena may have moved it */
+        pointWorldAtArena();
+        const char* roomName = getRoomName(roomIndex);
+
+        ((uint32_t*)world.connectionOffsets)[roomIndex] = numConnections;
+
+        /* Read the whole file at once, a room file is a few short lines */
+        int fileDescriptor = open(roomName, O_RDONLY);
+        ssize_t size = (fileDescriptor >= 0) ? read(fileDescriptor, buffer, ROOM_FILE_SIZE) : -1;
+        if (size <= 0 || size == ROOM_FILE_SIZE) {
+            printf("ERROR: Failed to read file %s. Exiting. \n", roomName);
+            exit(1);
+        }
+        close(fileDescriptor);
+        buffer[size] = '\0';
+        stats.filesRead++;
+        stats.bytesRead += size;
+
+        char* line = buffer;
+        char* nextLine;
+        for (; *line != '\0'; line = nextLine) {
+            nextLine = line + strcspn(line, "\n");
+            if (*nextLine == '\n') {
+                *nextLine++ = '\0';
+            }
 
-    int i;
-    for (i = 0; i < rooms[currentRoomIndex].numConnections; i++) {
-        if (strcmp(rooms[currentRoomIndex].connections[i], roomName) == TRUE) {
-            int j;
-            for (j = 0; j < NUM_ROOMS; j++) {
-                if (strcmp(rooms[currentRoomIndex].connections[i], rooms[j].roomName) == TRUE) {
-                    return j;
+            if (strncmp(line, "ROOM NAME: ", 11) == TRUE) {
+                /* The name must match the file name */
+                if (strcmp(line + 11, roomName) != TRUE) {
+                    printf("ERROR: Room file %s holds room %s. Exiting.\n", roomName, line + 11);
+                    exit(1);
                 }
+            } else if (strncmp(line, "CONNECTION", 10) == TRUE) {
+                /* The connected room's name starts after "CONNECTION n: " */
+                char* colon = strchr(line, ':');
+                if (colon == NULL || colon[1] != ' ' || colon[2] == '\0') {
+                    printf("ERROR: Room file %s has a connection with no room name. Exiting.\n", roomName);
+                    exit(1);
+                }
+                char* name = colon + 2;
+                size_t length = strlen(name) + 1;
+
+                memcpy(getArenaPointer(arena, allocateArena(arena, length, 1)), name, length);
+                numConnections++;
+            } else if (strcmp(line, "ROOM TYPE: START_ROOM") == TRUE) {
+                startRoomIndex = roomIndex;
+            } else if (strcmp(line, "ROOM TYPE: END_ROOM") == TRUE) {
+                endRoomIndex = roomIndex;
             }
         }
     }
 
-    return -1;
+    pointWorldAtArena();
+    ((uint32_t*)world.connectionOffsets)[numRooms] = numConnections;
+    world.numConnections = numConnections;
+    world.mapping = NULL;
+
+    resolveConnections(connectionNamesStart);
 }
 
 /*
- * NAME: getUserInput
- * PARAMS: none
- * RETURN: Int with room index if valid, else -1
- * DESCRIPTION: Reads in the user input and gets the index
- * if the room is valid. If invalid, prompts the user to
- * try again and returns -1.
+ * NAME: pointWorldAtImage
+ * PARAMS: Pointer to a packed world's header
+ * RETURN: void
+ * DESCRIPTION: Points the world's arrays into a packed world, from a world
+ * file or a shared segment, whose header has been checked
  */
-int getUserInput(int currentRoomIndex) {
-    int roomIndex = -1;
-    char buffer[BUFFER_SIZE];
-    char roomChoice[BUFFER_SIZE];
+void pointWorldAtImage(const void* image) {
+    const struct WorldHeader* header = image;
+    const char* base = image;
+
+    world.image = header;
+    world.connectionOffsets = (const uint32_t*)(base + header->connectionOffsetsStart);
+    world.connections = (const uint32_t*)(base + header->connectionsStart);
+    world.nameOffsets = (const uint32_t*)(base + header->nameOffsetsStart);
+    world.names = base + header->namesStart;
+    world.nameIndex = (const uint32_t*)(base + header->nameIndexStart);
+    world.nameIndexSize = header->nameIndexSize;
+    world.numConnections = header->numConnections;
+
+    numRooms = header->numRooms;
+    startRoomIndex = header->startRoom;
+    endRoomIndex = header->endRoom;
+}
 
-    memset(buffer, '\0', sizeof(buffer));
-    memset(roomChoice, '\0', sizeof(roomChoice));
+/*
+ * NAME: mapWorldFile
+ * PARAMS: Pointer to the world file name
+ * RETURN: void
+ * DESCRIPTION: Maps a packed world file into memory and points the world at
+ * it. Nothing is parsed or copied. The sections are read through once to
+ * check that they stay inside the file, then used in place.
+ */
+void mapWorldFile(const char* fileName) {
+    struct stat fileAttributes;
+    const struct WorldHeader* header;
 
-    if (fgets(buffer, BUFFER_SIZE, stdin) == NULL) {
-        printf("ERROR: Failed to read user input. Exiting. \n");
+    int fileDescriptor = open(fileName, O_RDONLY);
+    if (fileDescriptor < 0 || fstat(fileDescriptor, &fileAttributes) != 0) {
+        printf("ERROR: Failed to open world file %s. Exiting.\n", fileName);
         exit(1);
     }
 
-    int length = strcspn(buffer, "\n");
-
-    strncpy(roomChoice, buffer, length);
+    if ((size_t)fileAttributes.st_size < sizeof(struct WorldHeader)) {
+        printf("ERROR: World file %s is too small. Exiting.\n", fileName);
+        exit(1);
+    }
 
-    roomIndex = checkRoomIsValid(roomChoice, currentRoomIndex);
+    world.mappingSize = fileAttributes.st_size;
+    stats.filesRead++;
+    stats.bytesMapped += world.mappingSize;
+    world.mapping = mmap(NULL, world.mappingSize, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+    assert(world.mapping != MAP_FAILED);
+    close(fileDescriptor);
 
-    if (roomIndex == -1) {
-        printf("\nHUH? I DON'T UNDERSTAND THAT ROOM. TRY AGAIN.\n");
+    header = world.mapping;
+    if (!isValidWorldHeader(header, world.mappingSize) || !isValidWorldImage(header)) {
+        printf("ERROR: %s is not a valid world file. Exiting.\n", fileName);
+        exit(1);
     }
 
-    return roomIndex;
+    /* Rooms are visited in no particular order, so skip readahead after the check */
+    madvise(world.mapping, world.mappingSize, MADV_RANDOM);
+
+    pointWorldAtImage(world.mapping);
 }
 
 /*
- * NAME: printFinalStats
+ * NAME: verifyWorldFile
  * PARAMS: none
  * RETURN: void
- * DESCRIPTION: Prints the number of rooms visited and their names
+ * DESCRIPTION: Checks the checksum of the mapped world file. This reads the
+ * whole file, so it is only done when asked for.
  */
-void printFinalStats() {
-    printf("YOU TOOK %d STEPS. YOUR PATH TO VICTORY WAS:\n", path.pathUsed);
-    int i;
-    for (i = 0; i < path.pathUsed; i++) {
-        printf("%s\n", rooms[path.path[i]].roomName);
+void verifyWorldFile() {
+    const struct WorldHeader* header = world.image;
+    uint64_t checksum = updateChecksum(CHECKSUM_SEED, (const char*)world.image + sizeof(struct WorldHeader),
+                                       header->fileSize - sizeof(struct WorldHeader));
+
+    if (checksum != header->checksum) {
+        printf("ERROR: World file checksum does not match. Exiting.\n");
+        exit(1);
     }
 }
 
 /*
- * NAME: getCurrentTime
+ * NAME: replayWorldJournal
  * PARAMS: none
- * RETURN: void*
- * DESCRIPTION: Gets the current time, creates a file, and stores the time
+ * RETURN: void
+ * DESCRIPTION: Applies the mapped world file's journal, if it has one, so
+ * an edited world loads in time for its edits rather than being rewritten.
+ * Room files are rewritten as they are edited, so their journal is not replayed.
  */
-void* getCurrentTime() {
-    char timeString[BUFFER_SIZE];
-    /* Format matches "1:03pm, Tuesday, September 13, 2016" */
-    char* timeFormat = "%l:%M%P, %A, %B %e, %Y%n%n";
-    FILE* filePtr;
-    time_t currentTime;
-
-    /* Locks the mutex. Will be blocked until the main thread unblocks */
-    pthread_mutex_lock(&lock);
+void replayWorldJournal() {
+    char journalName[BUFFER_SIZE + sizeof(JOURNAL_SUFFIX)];
+    int lineNumber;
 
-    filePtr = fopen(TIME_FILE_NAME, "w");
-    assert(filePtr != NULL);
-
-    currentTime = time(NULL);
+    makeJournalName(worldPath, journalName, sizeof(journalName));
+    initWorldEdits(&edits, world.mapping);
 
-    if (strftime(timeString, sizeof(timeString), timeFormat, localtime(&currentTime)) == 0) {
-        printf("\nERROR: Failed to get current time. Exiting.\n");
+    const char* error = replayJournal(&edits, journalName, &lineNumber);
+    if (error != NULL) {
+        printf("ERROR: Line %d of %s cannot be replayed, %s. Exiting.\n", lineNumber, journalName, error);
         exit(1);
     }
 
-    fprintf(filePtr, timeString);
-
-    fclose(filePtr);
+    if (edits.numEdits == 0) {
+        freeWorldEdits(&edits);
+        return;
+    }
 
-    /* Returns the lock to the main thread and destroys the thread */
-    pthread_mutex_unlock(&lock);
-    pthread_exit(NULL);
+    world.edited = TRUE;
+    world.numConnections += edits.connectionChange;
+    startRoomIndex = edits.startRoom;
+    endRoomIndex = edits.endRoom;
 }
 
 /*
- * NAME: createTimeThread
- * PARAMS: none
+ * NAME: loadWorld
+ * PARAMS: Int indicating whether to verify packed world files
  * RETURN: void
- * DESCRIPTION: Creates the thread to be used by the time function
+ * DESCRIPTION: Loads the world at worldPath, reading room files if it is a
+ * directory and mapping it, with its journal replayed, if it is a packed world
+ * file. An embedded build uses its compiled in world instead.
  */
-void createTimeThread() {
-    int result;
+void loadWorld(int verify) {
+    world.edited = FALSE;
+
+#ifdef EMBEDDED_WORLD
+    /* The world is compiled in, point at it rather than finding and reading it */
+    memset(worldPath, '\0', sizeof(worldPath));
+    strncpy(worldPath, EMBEDDED_WORLD_NAME, sizeof(worldPath) - 1);
+    world.connectionOffsets = embeddedConnectionOffsets;
+    world.connections = embeddedConnections;
+    world.nameOffsets = embeddedNameOffsets;
+    world.names = embeddedNames;
+    world.nameIndex = embeddedNameIndex;
+    world.nameIndexSize = EMBEDDED_NAME_INDEX_SIZE;
+    world.numConnections = EMBEDDED_NUM_CONNECTIONS;
+    numRooms = EMBEDDED_NUM_ROOMS;
+    startRoomIndex = EMBEDDED_START_ROOM;
+    endRoomIndex = EMBEDDED_END_ROOM;
+#else
+    struct stat worldAttributes;
+
+    if (stat(worldPath, &worldAttributes) != 0) {
+        printf("ERROR: Failed to find world %s. Exiting.\n", worldPath);
+        exit(1);
+    }
 
-    /* Locks the main thread */
-    pthread_mutex_lock(&lock);
+    if (S_ISDIR(worldAttributes.st_mode)) {
+        int previousDir = open(".", O_RDONLY);
+        assert(previousDir >= 0);
 
-    /* Creates the thread that will execute getCurrentTime */
-    result = pthread_create(&threadID, NULL, &getCurrentTime, NULL);
-    assert (result == TRUE);
+        int result = chdir(worldPath);
+        assert(result == TRUE);
+
+        getRoomInfo();
+
+        result = fchdir(previousDir);
+        assert(result == TRUE);
+        close(previousDir);
+    } else {
+        mapWorldFile(worldPath);
+        if (verify == TRUE) {
+            verifyWorldFile();
+        }
+        replayWorldJournal();
+    }
+
+    if (numRooms == 0 || startRoomIndex == -1 || endRoomIndex == -1) {
+        printf("ERROR: World %s has no start or end room. Exiting.\n", worldPath);
+        exit(1);
+    }
+#endif
+}
+
+/*
+ * NAME: freeWorld
+ * PARAMS: none
+ * RETURN: void
+ * DESCRIPTION: Releases the memory or mapping holding the world
+ */
+void freeWorld() {
+    if (world.edited == TRUE) {
+        freeWorldEdits(&edits);
+    }
+    if (world.mapping != NULL) {
+        munmap(world.mapping, world.mappingSize);
+    } else {
+        freeArena(&world.arena);
+    }
+}
+
+/*
+ * NAME: getWorldFingerprint
+ * PARAMS: none
+ * RETURN: 64 bit fingerprint of the loaded world
+ * DESCRIPTION: Identifies the world a game is saved in. A packed world is
+ * known by its checksum and how many journal edits were replayed over it,
+ * room files by a checksum of the world's arrays, worked out once. A world
+ * attached with --shared carries the fingerprint of the world it was
+ * published from.
+ */
+uint64_t getWorldFingerprint() {
+    uint64_t fingerprint;
+    int32_t rooms[2] = {startRoomIndex, endRoomIndex};
+
+    if (worldFingerprintKnown == TRUE) {
+        return worldFingerprint;
+    }
+
+    if (world.mapping != NULL) {
+        fingerprint = world.image->checksum;
+        if (world.edited == TRUE) {
+            fingerprint = updateChecksum(fingerprint, &edits.numEdits, sizeof(edits.numEdits));
+        }
+    } else {
+        const char* lastName = getRoomName(numRooms - 1);
+        fingerprint = updateChecksum(CHECKSUM_SEED, world.names, lastName + strlen(lastName) + 1 - world.names);
+        fingerprint = updateChecksum(fingerprint, world.connectionOffsets, ((size_t)numRooms + 1) * sizeof(uint32_t));
+        fingerprint = updateChecksum(fingerprint, world.connections, world.numConnections * sizeof(uint32_t));
+    }
+    fingerprint = updateChecksum(fingerprint, rooms, sizeof(rooms));
+
+    worldFingerprint = fingerprint;
+    worldFingerprintKnown = TRUE;
+    return fingerprint;
+}
+
+/*
+ * NAME: readSaveFile
+ * PARAMS: Pointer to a size_t for the file's size
+ * RETURN: Pointer to the whole save file, NULL if there is none
+ * DESCRIPTION: Reads the save file in one read. The caller frees it.
+ */
+char* readSaveFile(size_t* size) {
+    struct stat fileAttributes;
+
+    int fileDescriptor = open(saveFileName, O_RDONLY);
+    if (fileDescriptor < 0) {
+        return NULL;
+    }
+
+    int result = fstat(fileDescriptor, &fileAttributes);
+    assert(result == TRUE);
+    char* data = malloc(fileAttributes.st_size + 1);
+    assert(data != NULL);
+    *size = fileAttributes.st_size;
+    if (read(fileDescriptor, data, *size) != (ssize_t)*size) {
+        free(data);
+        data = NULL;
+    }
+    close(fileDescriptor);
+    return data;
+}
+
+/*
+ * NAME: saveGame
+ * PARAMS: Pointer to the path struct
+ * RETURN: NULL if the game was saved, otherwise why it was not
+ * DESCRIPTION: Writes the game to a temporary file with one write, syncs
+ * it, and renames it over the save file so a save is never half written
+ */
+const char* saveGame(struct UserPath* path) {
+    struct SaveHeader header;
+    char tempFileName[BUFFER_SIZE + 8];
+    char* spilled = NULL;
+    size_t spilledSize = 0;
+
+    if (path->spill != NULL) {
+        fflush(path->spill);
+        fseek(path->spill, 0, SEEK_END);
+        spilledSize = ftell(path->spill);
+        spilled = malloc(spilledSize + 1);
+        assert(spilled != NULL);
+        if (pread(fileno(path->spill), spilled, spilledSize, 0) != (ssize_t)spilledSize) {
+            free(spilled);
+            return "THE PATH LOG COULD NOT BE READ";
+        }
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SAVE_MAGIC, sizeof(SAVE_MAGIC));
+    header.version = SAVE_VERSION;
+    header.numRooms = numRooms;
+    header.worldFingerprint = getWorldFingerprint();
+    snprintf(header.worldPath, sizeof(header.worldPath), "%s", worldPath);
+    header.currentRoom = path->lastRoom;
+    header.steps = path->steps;
+    header.loops = path->loops;
+    header.uniqueRooms = path->uniqueRooms;
+    header.logSize = spilledSize + path->logUsed;
+    header.visitedSize = path->visitedSize;
+    header.checksum = updateChecksum(CHECKSUM_SEED, spilled, spilledSize);
+    header.checksum = updateChecksum(header.checksum, path->log, path->logUsed);
+    header.checksum = updateChecksum(header.checksum, path->visited, path->visitedSize * sizeof(uint32_t));
+
+    struct iovec parts[] = {
+        {&header, sizeof(header)},
+        {spilled, spilledSize},
+        {path->log, path->logUsed},
+        {path->visited, path->visitedSize * sizeof(uint32_t)}
+    };
+    ssize_t size = sizeof(header) + header.logSize + header.visitedSize * sizeof(uint32_t);
+
+    snprintf(tempFileName, sizeof(tempFileName), "%s.tmp", saveFileName);
+    int fileDescriptor = open(tempFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int saved = fileDescriptor >= 0 && writev(fileDescriptor, parts, 4) == size && fsync(fileDescriptor) == 0;
+    if (fileDescriptor >= 0 && close(fileDescriptor) != 0) {
+        saved = 0;
+    }
+    free(spilled);
+
+    if (!saved || rename(tempFileName, saveFileName) != 0) {
+        unlink(tempFileName);
+        return "THE SAVE FILE COULD NOT BE WRITTEN";
+    }
+    return NULL;
+}
+
+/*
+ * NAME: loadGame
+ * PARAMS: Pointer to the path struct
+ * RETURN: NULL if the game was loaded, otherwise why it was not
+ * DESCRIPTION: Replaces the path with the saved one. The visited set is
+ * taken as saved and the log is split between the path log file and
+ * memory, so nothing is decoded or replayed. The player is in the path's
+ * last room afterwards.
+ */
+const char* loadGame(struct UserPath* path) {
+    size_t size;
+    char* data = readSaveFile(&size);
+    const struct SaveHeader* header = (const struct SaveHeader*)data;
+    const char* error = NULL;
+
+    if (data == NULL) {
+        return "THERE IS NO SAVED GAME";
+    }
+
+    if (size < sizeof(struct SaveHeader) || memcmp(header->magic, SAVE_MAGIC, sizeof(SAVE_MAGIC)) != 0
+        || header->version != SAVE_VERSION) {
+        error = "THE SAVE FILE IS NOT A SAVED GAME";
+    } else if (header->numRooms != (uint32_t)numRooms || header->worldFingerprint != getWorldFingerprint()) {
+        error = "THE SAVED GAME IS FOR ANOTHER WORLD";
+    } else if (header->visitedSize < 16 || (header->visitedSize & (header->visitedSize - 1)) != 0
+               || header->currentRoom < 0 || header->currentRoom >= numRooms
+               || size != sizeof(struct SaveHeader) + header->logSize + header->visitedSize * sizeof(uint32_t)
+               || updateChecksum(CHECKSUM_SEED, data + sizeof(struct SaveHeader), size - sizeof(struct SaveHeader))
+                  != header->checksum) {
+        error = "THE SAVED GAME IS DAMAGED";
+    }
+    if (error != NULL) {
+        free(data);
+        return error;
+    }
+
+    const char* log = data + sizeof(struct SaveHeader);
+    size_t memoryPart = (header->logSize < PATH_LOG_SIZE / 2) ? header->logSize : PATH_LOG_SIZE / 2;
+    size_t spilledPart = header->logSize - memoryPart;
+
+    /* Older moves go back to the path log file, the newest stay in memory */
+    if (spilledPart > 0 || path->spill != NULL) {
+        openPathLog(path);
+        fflush(path->spill);
+        if (ftruncate(fileno(path->spill), 0) != 0
+            || pwrite(fileno(path->spill), log, spilledPart, 0) != (ssize_t)spilledPart) {
+            printf("ERROR: Failed to write the path log. Exiting.\n");
+            exit(1);
+        }
+        fseek(path->spill, 0, SEEK_END);
+    }
+    memcpy(path->log, log + spilledPart, memoryPart);
+    path->logUsed = memoryPart;
+
+    free(path->visited);
+    path->visitedSize = header->visitedSize;
+    path->visited = malloc(path->visitedSize * sizeof(uint32_t));
+    assert(path->visited != NULL);
+    memcpy(path->visited, log + header->logSize, path->visitedSize * sizeof(uint32_t));
+
+    path->lastRoom = header->currentRoom;
+    path->steps = header->steps;
+    path->loops = header->loops;
+    path->uniqueRooms = header->uniqueRooms;
+
+    free(data);
+    return NULL;
+}
+
+/*
+ * NAME: findSavedWorld
+ * PARAMS: none
+ * RETURN: Int indicating if the save file named a world
+ * DESCRIPTION: For --resume, takes the world to play from the save file.
+ * Returns 0 if worldPath was set, 1 if there is no usable save file.
+ */
+int findSavedWorld() {
+    size_t size;
+    char* data = readSaveFile(&size);
+    const struct SaveHeader* header = (const struct SaveHeader*)data;
+    int found = FALSE;
+
+    if (data != NULL && size >= sizeof(struct SaveHeader)
+        && memcmp(header->magic, SAVE_MAGIC, sizeof(SAVE_MAGIC)) == 0 && header->worldPath[0] != '\0') {
+        /* The saved path need not end in a NUL, so never read past it */
+        snprintf(worldPath, sizeof(worldPath), "%.*s", (int)sizeof(header->worldPath), header->worldPath);
+        found = TRUE;
+    }
+
+    free(data);
+    return found;
+}
+
+/*
+ * NAME: resumeSavedGame
+ * PARAMS: Pointer to the path struct
+ * RETURN: Int holding the room to continue from
+ * DESCRIPTION: With --resume, loads the saved game before play starts, or
+ * says why not and starts a new one
+ */
+int resumeSavedGame(struct UserPath* path) {
+    if (resumeGame != TRUE) {
+        return startRoomIndex;
+    }
+
+    const char* error = loadGame(path);
+    if (error != NULL) {
+        printf("\n%s, STARTING A NEW GAME.\n", error);
+        return startRoomIndex;
+    }
+    printf("\nRESUMING YOUR SAVED GAME AFTER %lld STEPS.\n", path->steps);
+    return path->lastRoom;
+}
+
+/*
+ * NAME: getSharedWorldKey
+ * PARAMS: none
+ * RETURN: 64 bit key of the world at worldPath as it is now
+ * DESCRIPTION: Identifies the version of a world in its shared segment by
+ * when it and its journal last changed. Editing a rooms directory replaces
+ * files in it, and editing a world file appends to its journal, so either
+ * changes the key.
+ */
+uint64_t getSharedWorldKey() {
+    char journalName[BUFFER_SIZE + sizeof(JOURNAL_SUFFIX)];
+    struct stat attributes[2];
+
+    if (stat(worldPath, &attributes[0]) != 0) {
+        printf("ERROR: Failed to find world %s. Exiting.\n", worldPath);
+        exit(1);
+    }
+    makeJournalName(worldPath, journalName, sizeof(journalName));
+    if (stat(journalName, &attributes[1]) != 0) {
+        memset(&attributes[1], 0, sizeof(attributes[1]));
+    }
+
+    uint64_t key = CHECKSUM_SEED;
+    int i;
+    for (i = 0; i < 2; i++) {
+        uint64_t parts[] = {attributes[i].st_dev, attributes[i].st_ino, attributes[i].st_size,
+                            attributes[i].st_mtim.tv_sec, attributes[i].st_mtim.tv_nsec};
+        key = updateChecksum(key, parts, sizeof(parts));
+    }
+    return key;
+}
+
+/*
+ * NAME: getWorldImageLayout
+ * PARAMS: Pointer to the header to fill in
+ * RETURN: void
+ * DESCRIPTION: Lays the loaded world out as a packed world, as
+ * eganch.buildrooms does for a world file
+ */
+void getWorldImageLayout(struct WorldHeader* header) {
+    uint64_t namesSize = 0;
+
+    int i;
+    for (i = 0; i < numRooms; i++) {
+        namesSize += strlen(getRoomName(i)) + 1;
+    }
+
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, WORLD_MAGIC, sizeof(WORLD_MAGIC));
+    header->version = WORLD_VERSION;
+    header->numRooms = numRooms;
+    header->numConnections = world.numConnections;
+    header->startRoom = startRoomIndex;
+    header->endRoom = endRoomIndex;
+    header->connectionOffsetsStart = alignWorldOffset(sizeof(*header));
+    header->connectionsStart = alignWorldOffset(header->connectionOffsetsStart
+                                                + ((uint64_t)numRooms + 1) * sizeof(uint32_t));
+    header->nameOffsetsStart = alignWorldOffset(header->connectionsStart
+                                                + header->numConnections * sizeof(uint32_t));
+    header->namesStart = alignWorldOffset(header->nameOffsetsStart + (uint64_t)numRooms * sizeof(uint32_t));
+    header->namesSize = namesSize;
+    header->nameIndexStart = alignWorldOffset(header->namesStart + namesSize);
+    header->nameIndexSize = getNameIndexSize(numRooms);
+    header->fileSize = header->nameIndexStart + header->nameIndexSize * sizeof(uint32_t);
+}
+
+/*
+ * NAME: writeWorldImage
+ * PARAMS: Pointer to zeroed memory of the header's file size and pointer to the header
+ * RETURN: void
+ * DESCRIPTION: Writes the loaded world, with any edits, into the memory as a
+ * packed world with its checksum
+ */
+void writeWorldImage(char* image, struct WorldHeader* header) {
+    uint32_t* connectionOffsets = (uint32_t*)(image + header->connectionOffsetsStart);
+    uint32_t* connections = (uint32_t*)(image + header->connectionsStart);
+    uint32_t* nameOffsets = (uint32_t*)(image + header->nameOffsetsStart);
+    char* names = image + header->namesStart;
+    uint32_t* nameIndex = (uint32_t*)(image + header->nameIndexStart);
+    uint32_t numConnections = 0;
+    uint32_t nameOffset = 0;
+
+    int i;
+    for (i = 0; i < numRooms; i++) {
+        connectionOffsets[i] = numConnections;
+        int j;
+        for (j = 0; j < getNumConnections(i); j++) {
+            connections[numConnections++] = getConnection(i, j);
+        }
+
+        size_t length = strlen(getRoomName(i)) + 1;
+        memcpy(names + nameOffset, getRoomName(i), length);
+        nameOffsets[i] = nameOffset;
+        nameOffset += length;
+        insertNameIndex(nameIndex, header->nameIndexSize, getRoomName(i), i);
+    }
+    connectionOffsets[numRooms] = numConnections;
+
+    header->checksum = updateChecksum(CHECKSUM_SEED, image + sizeof(*header), header->fileSize - sizeof(*header));
+    memcpy(image, header, sizeof(*header));
+}
+
+/*
+ * NAME: attachSharedWorld
+ * PARAMS: Pointer to the segment name, the world's key and int indicating whether to verify the checksum
+ * RETURN: Int indicating if the world was attached
+ * DESCRIPTION: Maps a published world read only and plays it in place. A
+ * segment published before the world last changed is left for
+ * publishSharedWorld to replace.
+ */
+int attachSharedWorld(const char* name, uint64_t key, int verify) {
+    struct stat attributes;
+
+    int fileDescriptor = shm_open(name, O_RDONLY, 0);
+    if (fileDescriptor < 0) {
+        return FALSE;
+    }
+
+    int result = fstat(fileDescriptor, &attributes);
+    assert(result == TRUE);
+
+    const struct SharedWorldHeader* shared = NULL;
+    size_t size = attributes.st_size;
+    if (size >= sizeof(struct SharedWorldHeader) + sizeof(struct WorldHeader)) {
+        shared = mmap(NULL, size, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+        assert(shared != MAP_FAILED);
+    }
+    close(fileDescriptor);
+
+    if (shared == NULL || memcmp(shared->magic, SHARED_WORLD_MAGIC, WORLD_MAGIC_SIZE) != 0
+        || shared->version != SHARED_WORLD_VERSION || shared->key != key || shared->worldStart >= size
+        || !isValidWorldHeader((const void*)((const char*)shared + shared->worldStart), size - shared->worldStart)
+        || !isValidWorldImage((const void*)((const char*)shared + shared->worldStart))) {
+        if (shared != NULL) {
+            munmap((void*)shared, size);
+        }
+        return FALSE;
+    }
+
+    world.mapping = (void*)shared;
+    world.mappingSize = size;
+    world.edited = FALSE;
+    stats.bytesMapped += size;
+    pointWorldAtImage((const char*)shared + shared->worldStart);
+    worldFingerprint = shared->fingerprint;
+    worldFingerprintKnown = TRUE;
+
+    if (verify == TRUE) {
+        verifyWorldFile();
+    }
+    return TRUE;
+}
+
+/*
+ * NAME: publishSharedWorld
+ * PARAMS: Pointer to the segment name and the world's key
+ * RETURN: void
+ * DESCRIPTION: Copies the loaded world into a new shared segment and moves
+ * this process onto it, freeing its own copy. The segment is filled under a
+ * name of its own and then renamed over the world's name, replacing any
+ * stale segment there, so attachers never see one half filled. POSIX has no
+ * rename for shared memory, so this uses the files Linux keeps them as. If
+ * two processes publish at once the last one's segment stays.
+ */
+void publishSharedWorld(const char* name, uint64_t key) {
+    struct SharedWorldHeader shared;
+    struct WorldHeader header;
+    char tempName[SHARED_WORLD_NAME_SIZE + 32];
+    char tempPath[sizeof(SHARED_MEMORY_DIRECTORY) + sizeof(tempName)];
+    char path[sizeof(SHARED_MEMORY_DIRECTORY) + SHARED_WORLD_NAME_SIZE];
+
+    snprintf(tempName, sizeof(tempName), "%s.%d.tmp", name, getpid());
+    snprintf(tempPath, sizeof(tempPath), "%s%s", SHARED_MEMORY_DIRECTORY, tempName);
+    snprintf(path, sizeof(path), "%s%s", SHARED_MEMORY_DIRECTORY, name);
+
+    getWorldImageLayout(&header);
+    memset(&shared, 0, sizeof(shared));
+    memcpy(shared.magic, SHARED_WORLD_MAGIC, WORLD_MAGIC_SIZE);
+    shared.version = SHARED_WORLD_VERSION;
+    shared.key = key;
+    shared.fingerprint = getWorldFingerprint();
+    shared.worldStart = alignWorldOffset(sizeof(shared));
+    size_t size = shared.worldStart + header.fileSize;
+
+    char* segment = MAP_FAILED;
+    int fileDescriptor = shm_open(tempName, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fileDescriptor >= 0 && ftruncate(fileDescriptor, size) == 0) {
+        segment = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+    }
+    if (segment == MAP_FAILED) {
+        printf("ERROR: Failed to create shared world %s. Exiting.\n", name);
+        shm_unlink(tempName);
+        exit(1);
+    }
+    close(fileDescriptor);
+
+    writeWorldImage(segment + shared.worldStart, &header);
+    memcpy(segment, &shared, sizeof(shared));
+    if (rename(tempPath, path) != 0) {
+        printf("ERROR: Failed to publish shared world %s. Exiting.\n", name);
+        shm_unlink(tempName);
+        exit(1);
+    }
+
+    /* Swap this process's copy for the segment, mapped read only like an attacher's */
+    freeWorld();
+    memset(&world.arena, 0, sizeof(world.arena));
+    mprotect(segment, size, PROT_READ);
+    world.mapping = segment;
+    world.mappingSize = size;
+    world.edited = FALSE;
+    pointWorldAtImage(segment + shared.worldStart);
+}
+
+/*
+ * NAME: findSharedWorldName
+ * PARAMS: Pointer to a SHARED_WORLD_NAME_SIZE buffer
+ * RETURN: void
+ * DESCRIPTION: Names the shared segment of the world at worldPath
+ */
+void findSharedWorldName(char* name) {
+    if (getSharedWorldName(worldPath, name) != 1) {
+        printf("ERROR: Failed to find world %s. Exiting.\n", worldPath);
+        exit(1);
+    }
+}
+
+/*
+ * NAME: loadSharedWorld
+ * PARAMS: Int indicating whether to verify the world's checksum
+ * RETURN: void
+ * DESCRIPTION: For --shared, attaches to the world at worldPath if another
+ * process has published it as it is now, otherwise loads it and publishes
+ * it. The key is taken before loading, so a world edited while it loads is
+ * published under its old key and replaced by the next process.
+ */
+void loadSharedWorld(int verify) {
+    char name[SHARED_WORLD_NAME_SIZE];
+
+    findSharedWorldName(name);
+    uint64_t key = getSharedWorldKey();
+    if (attachSharedWorld(name, key, verify) == TRUE) {
+        return;
+    }
+
+    loadWorld(verify);
+    publishSharedWorld(name, key);
+}
+
+/*
+ * NAME: unshareWorld
+ * PARAMS: none
+ * RETURN: void
+ * DESCRIPTION: For --unshare, removes the world at worldPath's shared
+ * segment. Processes attached to it keep it until they exit.
+ */
+void unshareWorld() {
+    char name[SHARED_WORLD_NAME_SIZE];
+
+    findSharedWorldName(name);
+    if (shm_unlink(name) == 0) {
+        printf("REMOVED SHARED WORLD %s\n", name);
+    } else {
+        printf("NO SHARED WORLD FOR %s\n", worldPath);
+    }
+}
+
+/*
+ * NAME: findShortestPath
+ * PARAMS: Int holding the room to start from, int holding the room to reach
+ * and pointer to an int for the first room to move to (may be NULL)
+ * RETURN: Int holding the number of steps on the shortest path, -1 if there is none
+ * DESCRIPTION: Bidirectional breadth first search over the world's
+ * connections. Whichever side has the smaller frontier is grown by a whole
+ * level until the two searches meet, so far fewer rooms are visited than
+ * searching from one side only.
+ */
+int findShortestPath(int fromRoom, int toRoom, int* nextRoom) {
+    if (fromRoom == toRoom) {
+        return 0;
+    }
+
+    int* search = malloc((size_t)numRooms * 6 * sizeof(int));
+    assert(search != NULL);
+    int* forwardDistance = search;
+    int* backwardDistance = search + numRooms;
+    int* forwardParent = search + 2 * (size_t)numRooms;
+    int* backwardParent = search + 3 * (size_t)numRooms;
+    int* forwardQueue = search + 4 * (size_t)numRooms;
+    int* backwardQueue = search + 5 * (size_t)numRooms;
+    int forwardHead = 0, forwardTail = 0, backwardHead = 0, backwardTail = 0;
+    int best = -1, meetRoom = -1;
+
+    memset(forwardDistance, -1, (size_t)numRooms * 2 * sizeof(int));
+    forwardDistance[fromRoom] = 0;
+    backwardDistance[toRoom] = 0;
+    forwardQueue[forwardTail++] = fromRoom;
+    backwardQueue[backwardTail++] = toRoom;
+
+    while (best == -1 && forwardHead < forwardTail && backwardHead < backwardTail) {
+        int forward = (forwardTail - forwardHead <= backwardTail - backwardHead);
+        int* distance = forward ? forwardDistance : backwardDistance;
+        int* otherDistance = forward ? backwardDistance : forwardDistance;
+        int* parent = forward ? forwardParent : backwardParent;
+        int* queue = forward ? forwardQueue : backwardQueue;
+        int* head = forward ? &forwardHead : &backwardHead;
+        int* tail = forward ? &forwardTail : &backwardTail;
+        int levelEnd = *tail;
+
+        while (*head < levelEnd) {
+            int roomIndex = queue[(*head)++];
+            int numConnections = getNumConnections(roomIndex);
+
+            int i;
+            for (i = 0; i < numConnections; i++) {
+                int connection = getConnection(roomIndex, i);
+                if (distance[connection] != -1) {
+                    continue;
+                }
+                distance[connection] = distance[roomIndex] + 1;
+                parent[connection] = roomIndex;
+                queue[(*tail)++] = connection;
+
+                if (otherDistance[connection] != -1
+                    && (best == -1 || distance[connection] + otherDistance[connection] < best)) {
+                    best = distance[connection] + otherDistance[connection];
+                    meetRoom = connection;
+                }
+            }
+        }
+    }
+
+    if (best != -1 && nextRoom != NULL) {
+        if (meetRoom == fromRoom) {
+            *nextRoom = backwardParent[fromRoom];
+        } else {
+            int roomIndex = meetRoom;
+            while (forwardParent[roomIndex] != fromRoom) {
+                roomIndex = forwardParent[roomIndex];
+            }
+            *nextRoom = roomIndex;
+        }
+    }
+
+    free(search);
+    return best;
+}
+
+/*
+ * NAME: buildDistanceTable
+ * PARAMS: none
+ * RETURN: void
+ * DESCRIPTION: Breadth first search out from the end room, storing every
+ * room's distance to it (-1 if it cannot be reached)
+ */
+void buildDistanceTable() {
+    int* queue = malloc((size_t)numRooms * sizeof(int));
+    int head = 0, tail = 0;
+
+    distanceToEnd = malloc((size_t)numRooms * sizeof(int));
+    assert(queue != NULL && distanceToEnd != NULL);
+    memset(distanceToEnd, -1, (size_t)numRooms * sizeof(int));
+
+    distanceToEnd[endRoomIndex] = 0;
+    queue[tail++] = endRoomIndex;
+    while (head < tail) {
+        int roomIndex = queue[head++];
+        int numConnections = getNumConnections(roomIndex);
+
+        int i;
+        for (i = 0; i < numConnections; i++) {
+            int connection = getConnection(roomIndex, i);
+            if (distanceToEnd[connection] == -1) {
+                distanceToEnd[connection] = distanceToEnd[roomIndex] + 1;
+                queue[tail++] = connection;
+            }
+        }
+    }
+
+    free(queue);
+}
+
+/*
+ * NAME: getDistanceToEnd
+ * PARAMS: Int holding the room index and pointer to an int for the first room
+ * to move to (may be NULL)
+ * RETURN: Int holding the number of steps to the end room, -1 if it cannot be reached
+ * DESCRIPTION: Reads the distance table when there is one, which makes a
+ * hint one lookup per connection, otherwise searches for the route
+ */
+int getDistanceToEnd(int roomIndex, int* nextRoom) {
+    if (distanceToEnd == NULL) {
+        return findShortestPath(roomIndex, endRoomIndex, nextRoom);
+    }
+
+    int distance = distanceToEnd[roomIndex];
+    if (distance > 0 && nextRoom != NULL) {
+        int numConnections = getNumConnections(roomIndex);
+
+        int i;
+        for (i = 0; i < numConnections; i++) {
+            if (distanceToEnd[getConnection(roomIndex, i)] == distance - 1) {
+                *nextRoom = getConnection(roomIndex, i);
+                break;
+            }
+        }
+    }
+    return distance;
+}
+
+/*
+ * NAME: prepareSolver
+ * PARAMS: none
+ * RETURN: void
+ * DESCRIPTION: Builds the distance table for large worlds and finds the
+ * length of the shortest path from the start room to the end room
+ */
+void prepareSolver() {
+    if (numRooms >= DISTANCE_TABLE_MIN_ROOMS) {
+        buildDistanceTable();
+    }
+    shortestPathLength = getDistanceToEnd(startRoomIndex, NULL);
+}
+
+/*
+ * NAME: formatHint
+ * PARAMS: Int holding the current room index and pointer to a buffer of BUFFER_SIZE chars
+ * RETURN: void
+ * DESCRIPTION: Describes the next room on the shortest path to the end room
+ */
+void formatHint(int roomIndex, char* hint) {
+    int nextRoom = -1;
+    int distance = getDistanceToEnd(roomIndex, &nextRoom);
+
+    if (distance == -1) {
+        snprintf(hint, BUFFER_SIZE, "HINT: THE END ROOM CAN'T BE REACHED FROM HERE.");
+    } else {
+        snprintf(hint, BUFFER_SIZE, "HINT: GO TO %s. THE END ROOM IS %d STEP%s AWAY.",
+                 getRoomName(nextRoom), distance, (distance == 1) ? "" : "S");
+    }
+}
+
+/*
+ * NAME: printHint
+ * PARAMS: Int holding the current room index
+ * RETURN: void
+ * DESCRIPTION: Prints the next room on the shortest path to the end room
+ */
+void printHint(int roomIndex) {
+    char hint[BUFFER_SIZE];
+
+    formatHint(roomIndex, hint);
+    printf("\n%s\n", hint);
+}
+
+/*
+ * NAME: getRoomTextLength
+ * PARAMS: Int holding the room index
+ * RETURN: Size of the room's turn text
+ * DESCRIPTION: Measures what renderRoomText writes for a room
+ */
+size_t getRoomTextLength(int roomIndex) {
+    size_t length = strlen(LOCATION_TEXT) + strlen(getRoomName(roomIndex)) + strlen(CONNECTIONS_TEXT)
+                    + strlen(PROMPT_TEXT);
+
+    int i;
+    int numConnections = getNumConnections(roomIndex);
+    for (i = 0; i < numConnections; i++) {
+        length += strlen(getRoomName(getConnection(roomIndex, i))) + 2;
+    }
+    return length;
+}
+
+/*
+ * NAME: appendText
+ * PARAMS: Pointer to where to copy to and pointer to the text
+ * RETURN: Pointer to just after the copied text
+ * DESCRIPTION: Copies text without its terminator
+ */
+char* appendText(char* destination, const char* text) {
+    size_t length = strlen(text);
+    memcpy(destination, text, length);
+    return destination + length;
+}
+
+/*
+ * NAME: renderRoomText
+ * PARAMS: Int holding the room index and pointer to getRoomTextLength chars
+ * RETURN: void
+ * DESCRIPTION: Writes the room's name and connections and the prompt for
+ * the next room, as one block of text with no terminator
+ */
+void renderRoomText(int roomIndex, char* text) {
+    text = appendText(text, LOCATION_TEXT);
+    text = appendText(text, getRoomName(roomIndex));
+    text = appendText(text, CONNECTIONS_TEXT);
+
+    int i;
+    int numConnections = getNumConnections(roomIndex);
+    for (i = 0; i < numConnections; i++) {
+        text = appendText(text, getRoomName(getConnection(roomIndex, i)));
+        /* The last connection ends with a period instead of a comma */
+        text = appendText(text, (i == numConnections - 1) ? ".\n" : ", ");
+    }
+
+    appendText(text, PROMPT_TEXT);
+}
+
+/*
+ * NAME: prepareRoomText
+ * PARAMS: none
+ * RETURN: void
+ * DESCRIPTION: Renders every room's turn text into one buffer, unless the
+ * world is too large for that to be worth the memory
+ */
+void prepareRoomText() {
+    if (numRooms > ROOM_TEXT_MAX_ROOMS) {
+        return;
+    }
+
+    roomText.offsets = malloc(((size_t)numRooms + 1) * sizeof(uint64_t));
+    assert(roomText.offsets != NULL);
+
+    int i;
+    roomText.offsets[0] = 0;
+    for (i = 0; i < numRooms; i++) {
+        roomText.offsets[i + 1] = roomText.offsets[i] + getRoomTextLength(i);
+    }
+
+    roomText.text = malloc(roomText.offsets[numRooms]);
+    assert(roomText.text != NULL);
+    for (i = 0; i < numRooms; i++) {
+        renderRoomText(i, roomText.text + roomText.offsets[i]);
+    }
+}
+
+/*
+ * NAME: getRoomText
+ * PARAMS: Int holding the room index and pointer to a size_t for the text's length
+ * RETURN: Pointer to the room's turn text, valid until the next call
+ * DESCRIPTION: Returns the pre-rendered text, or renders it into the scratch
+ * buffer for worlds too large to render ahead. Not for use by server threads.
+ */
+const char* getRoomText(int roomIndex, size_t* length) {
+    if (roomText.text != NULL) {
+        *length = roomText.offsets[roomIndex + 1] - roomText.offsets[roomIndex];
+        return roomText.text + roomText.offsets[roomIndex];
+    }
+
+    *length = getRoomTextLength(roomIndex);
+    if (*length > roomText.scratchSize) {
+        roomText.scratchSize = *length * 2;
+        roomText.scratch = realloc(roomText.scratch, roomText.scratchSize);
+        assert(roomText.scratch != NULL);
+    }
+    renderRoomText(roomIndex, roomText.scratch);
+    return roomText.scratch;
+}
+
+/*
+ * NAME: freeRoomText
+ * PARAMS: none
+ * RETURN: void
+ * DESCRIPTION: Frees the rendered room text
+ */
+void freeRoomText() {
+    free(roomText.text);
+    free(roomText.offsets);
+    free(roomText.scratch);
+    memset(&roomText, 0, sizeof(roomText));
+}
+
+/*
+ * NAME: printRoomInfo
+ * PARAMS: Int holding the current room index and int indicating whether the last input was invalid
+ * RETURN: void
+ * DESCRIPTION: Prints the name and connections of the current room.
+ * Then prompts for next room. Anything printf left buffered goes first,
+ * then the error for invalid input, if any, and the room text go out in
+ * one writev.
+ */
+void printRoomInfo(int roomIndex, int invalidInput) {
+    struct iovec parts[2];
+    int numParts = 0;
+
+    if (invalidInput == TRUE) {
+        parts[numParts].iov_base = INVALID_ROOM_TEXT;
+        parts[numParts++].iov_len = strlen(INVALID_ROOM_TEXT);
+    }
+    parts[numParts].iov_base = (void*)getRoomText(roomIndex, &parts[numParts].iov_len);
+    numParts++;
+
+    fflush(stdout);
+    ssize_t length = parts[0].iov_len + ((numParts > 1) ? parts[1].iov_len : 0);
+    ssize_t written = writev(STDOUT_FILENO, parts, numParts);
+    if (written != length) {
+        /* A short write to a pipe or terminal; let stdio finish it */
+        size_t skip = (written > 0) ? written : 0;
+        int i;
+        for (i = 0; i < numParts; i++) {
+            if (skip < parts[i].iov_len) {
+                fwrite((char*)parts[i].iov_base + skip, 1, parts[i].iov_len - skip, stdout);
+                skip = 0;
+            } else {
+                skip -= parts[i].iov_len;
+            }
+        }
+        fflush(stdout);
+    }
+
+    if (statsEnabled == TRUE) {
+        addStat(&stats.turnWrites, 1);
+        addStat(&stats.turnBytes, length);
+    }
+}
+
+/*
+ * NAME: checkRoomIsValid
+ * PARAMS: Pointer to char array holding the room name
+ * RETURN: Int with room index if valid, else -1
+ * DESCRIPTION: If the user entered "time" or "hint" returns int indicating as such.
+ * Otherwise, looks the name up in the name index and checks the room is
+ * one of the current room's connections. Returns the index if found, -1 if
+ * not found.
+ */
+int checkRoomIsValid(char* roomName, int currentRoomIndex) {
+    if (strcmp("time", roomName) == TRUE) {
+        return TIME_CODE;
+    }
+    if (strcmp("hint", roomName) == TRUE) {
+        return HINT_CODE;
+    }
+    if (strcmp("save", roomName) == TRUE) {
+        return SAVE_CODE;
+    }
+    if (strcmp("load", roomName) == TRUE) {
+        return LOAD_CODE;
+    }
+
+    int roomIndex = findRoomByName(roomName);
+    if (roomIndex == -1) {
+        return -1;
+    }
+
+    int i;
+    int numConnections = getNumConnections(currentRoomIndex);
+    for (i = 0; i < numConnections; i++) {
+        if (getConnection(currentRoomIndex, i) == roomIndex) {
+            return roomIndex;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * NAME: startCommandTimer
+ * PARAMS: none
+ * RETURN: Nanoseconds on the stats clock, or 0 without --stats
+ * DESCRIPTION: Marks when a command was read
+ */
+uint64_t startCommandTimer() {
+    return (statsEnabled == TRUE) ? getStatsTime() : 0;
+}
+
+/*
+ * NAME: recordCommand
+ * PARAMS: Int holding the room index or code checkRoomIsValid returned and
+ * the time from startCommandTimer
+ * RETURN: void
+ * DESCRIPTION: Adds how long a command took to the histogram for its kind
+ */
+void recordCommand(int requestedRoomIndex, uint64_t start) {
+    if (statsEnabled != TRUE) {
+        return;
+    }
+
+    uint64_t ns = getStatsTime() - start;
+    if (requestedRoomIndex == -1) {
+        recordLatency(&stats.invalidCommands, ns);
+    } else if (requestedRoomIndex == TIME_CODE) {
+        recordLatency(&stats.timeRequests, ns);
+    } else if (requestedRoomIndex == HINT_CODE) {
+        recordLatency(&stats.hints, ns);
+    } else if (requestedRoomIndex >= 0) {
+        recordLatency(&stats.moves, ns);
+    }
+}
+
+/*
+ * NAME: getUserInput
+ * PARAMS: none
+ * RETURN: Int with room index if valid, else -1
+ * DESCRIPTION: Reads in the user input and gets the index
+ * if the room is valid. If invalid, returns -1 and the room is
+ * printed again after the error.
+ */
+int getUserInput(int currentRoomIndex) {
+    int roomIndex = -1;
+    char buffer[BUFFER_SIZE];
+    char roomChoice[BUFFER_SIZE];
+
+    memset(buffer, '\0', sizeof(buffer));
+    memset(roomChoice, '\0', sizeof(roomChoice));
+
+    if (fgets(buffer, BUFFER_SIZE, stdin) == NULL) {
+        printf("ERROR: Failed to read user input. Exiting. \n");
+        exit(1);
+    }
+    commandStart = startCommandTimer();
+
+    int length = strcspn(buffer, "\n");
+
+    strncpy(roomChoice, buffer, length);
+
+    roomIndex = checkRoomIsValid(roomChoice, currentRoomIndex);
+
+    if (roomIndex == -1) {
+        recordCommand(roomIndex, commandStart);
+    }
+
+    return roomIndex;
+}
+
+/*
+ * NAME: printFinalStats
+ * PARAMS: Pointer to the path struct
+ * RETURN: void
+ * DESCRIPTION: Prints the number of rooms visited and their names, or with
+ * --path-summary the number of steps, different rooms and loops, then how
+ * the path compares to the shortest one
+ */
+void printFinalStats(struct UserPath* path) {
+    struct PathReader reader;
+    int roomIndex;
+
+    if (pathSummary == TRUE) {
+        printf("YOU TOOK %lld STEPS THROUGH %lld DIFFERENT ROOMS AND LOOPED BACK %lld TIMES.\n",
+               path->steps, path->uniqueRooms, path->loops);
+    } else {
+        printf("YOU TOOK %lld STEPS. YOUR PATH TO VICTORY WAS:\n", path->steps);
+        startPathReader(&reader, path);
+        while ((roomIndex = nextPathRoom(&reader)) != -1) {
+            printf("%s\n", getRoomName(roomIndex));
+        }
+    }
+
+    if (shortestPathLength > 0 && path->steps > 0) {
+        printf("THE SHORTEST PATH WAS %d STEPS, YOUR PATH EFFICIENCY WAS %.1f%%.\n",
+               shortestPathLength, 100.0 * shortestPathLength / path->steps);
+    }
+}
+
+/*
+ * NAME: formatCurrentTime
+ * PARAMS: Pointer to a buffer of BUFFER_SIZE chars
+ * RETURN: void
+ * DESCRIPTION: Formats the current local time into the buffer
+ */
+void formatCurrentTime(char* timeString) {
+    /* Format matches "1:03pm, Tuesday, September 13, 2016" */
+    time_t currentTime = time(NULL);
+    struct tm localTime;
+
+    if (strftime(timeString, BUFFER_SIZE, TIME_FORMAT, localtime_r(&currentTime, &localTime)) == 0) {
+        printf("\nERROR: Failed to get current time. Exiting.\n");
+        exit(1);
+    }
+}
+
+/*
+ * NAME: writeTimeFile
+ * PARAMS: Pointer to the formatted time
+ * RETURN: void
+ * DESCRIPTION: Stores the time in the time file
+ */
+void writeTimeFile(char* timeString) {
+    FILE* filePtr = fopen(TIME_FILE_NAME, "w");
+    assert(filePtr != NULL);
+
+    fputs(timeString, filePtr);
+
+    fclose(filePtr);
+}
+
+/*
+ * NAME: getCurrentTime
+ * PARAMS: none
+ * RETURN: void*
+ * DESCRIPTION: Gets the current time, creates a file, and stores the time.
+ * This is the original thread-per-request path, kept so --bench-time can
+ * compare it against the time service.
+ */
+void* getCurrentTime() {
+    char timeString[BUFFER_SIZE];
+
+    /* Locks the mutex. Will be blocked until the main thread unblocks */
+    pthread_mutex_lock(&lock);
+
+    formatCurrentTime(timeString);
+    writeTimeFile(timeString);
+
+    /* Returns the lock to the main thread and destroys the thread */
+    pthread_mutex_unlock(&lock);
+    pthread_exit(NULL);
+}
+
+/*
+ * NAME: createTimeThread
+ * PARAMS: none
+ * RETURN: void
+ * DESCRIPTION: Creates the thread to be used by the time function
+ */
+void createTimeThread() {
+    int result;
+
+    /* Locks the main thread */
+    pthread_mutex_lock(&lock);
+
+    /* Creates the thread that will execute getCurrentTime */
+    result = pthread_create(&threadID, NULL, &getCurrentTime, NULL);
+    assert (result == TRUE);
 }
 
 /*
  * NAME: readTimeFromFile
+ * PARAMS: Pointer to a buffer of BUFFER_SIZE chars
+ * RETURN: void
+ * DESCRIPTION: Reads the time that was stored in a file
+ */
+void readTimeFromFile(char* buffer) {
+    FILE* filePtr;
+
+    memset(buffer, '\0', BUFFER_SIZE);
+
+    filePtr = fopen(TIME_FILE_NAME, "r");
+    assert(filePtr != NULL);
+
+    if (fgets(buffer, BUFFER_SIZE, filePtr) == NULL) {
+        printf("ERROR: Failed to read file %s. Exiting. \n", TIME_FILE_NAME);
+        exit(1);
+    }
+
+    fclose(filePtr);
+}
+
+/*
+ * NAME: runTimeService
  * PARAMS: none
+ * RETURN: void*
+ * DESCRIPTION: Body of the time service thread. Waits for requests, answers
+ * every pending request with one formatted time, then writes the time file
+ * after the requesters have been released.
+ */
+void* runTimeService() {
+    char fileString[BUFFER_SIZE];
+
+    pthread_mutex_lock(&timeService.lock);
+
+    while (timeService.running == TRUE) {
+        if (timeService.completed == timeService.requested) {
+            pthread_cond_wait(&timeService.requestReady, &timeService.lock);
+            continue;
+        }
+
+        formatCurrentTime(timeService.timeString);
+        timeService.completed = timeService.requested;
+        pthread_cond_broadcast(&timeService.responseReady);
+
+        if (timeService.writeFile == TRUE) {
+            strcpy(fileString, timeService.timeString);
+            pthread_mutex_unlock(&timeService.lock);
+            writeTimeFile(fileString);
+            pthread_mutex_lock(&timeService.lock);
+        }
+    }
+
+    pthread_mutex_unlock(&timeService.lock);
+    return NULL;
+}
+
+/*
+ * NAME: startTimeService
+ * PARAMS: Int indicating whether to also store the time in the time file
+ * RETURN: void
+ * DESCRIPTION: Starts the time service thread
+ */
+void startTimeService(int writeFile) {
+    pthread_mutex_init(&timeService.lock, NULL);
+    pthread_cond_init(&timeService.requestReady, NULL);
+    pthread_cond_init(&timeService.responseReady, NULL);
+    timeService.requested = 0;
+    timeService.completed = 0;
+    timeService.writeFile = writeFile;
+    timeService.running = TRUE;
+
+    int result = pthread_create(&timeService.thread, NULL, &runTimeService, NULL);
+    assert(result == TRUE);
+}
+
+/*
+ * NAME: stopTimeService
+ * PARAMS: none
+ * RETURN: void
+ * DESCRIPTION: Stops the time service thread once it has finished any
+ * pending file write
+ */
+void stopTimeService() {
+    pthread_mutex_lock(&timeService.lock);
+    timeService.running = FALSE;
+    pthread_cond_signal(&timeService.requestReady);
+    pthread_mutex_unlock(&timeService.lock);
+
+    pthread_join(timeService.thread, NULL);
+
+    pthread_mutex_destroy(&timeService.lock);
+    pthread_cond_destroy(&timeService.requestReady);
+    pthread_cond_destroy(&timeService.responseReady);
+}
+
+/*
+ * NAME: requestCurrentTime
+ * PARAMS: Pointer to a buffer of BUFFER_SIZE chars
+ * RETURN: void
+ * DESCRIPTION: Asks the time service for the time and waits for the answer.
+ * Safe to call from any number of threads.
+ */
+void requestCurrentTime(char* timeString) {
+    pthread_mutex_lock(&timeService.lock);
+
+    unsigned long long ticket = ++timeService.requested;
+    pthread_cond_signal(&timeService.requestReady);
+
+    while (timeService.completed < ticket) {
+        pthread_cond_wait(&timeService.responseReady, &timeService.lock);
+    }
+    strcpy(timeString, timeService.timeString);
+
+    pthread_mutex_unlock(&timeService.lock);
+}
+
+/*
+ * NAME: printCurrentTime
+ * PARAMS: none
+ * RETURN: void
+ * DESCRIPTION: Prints the first line of the time from the time service
+ */
+void printCurrentTime() {
+    char timeString[BUFFER_SIZE];
+
+    requestCurrentTime(timeString);
+    timeString[strcspn(timeString, "\n") + 1] = '\0';
+
+    printf("\n %s\n", timeString);
+}
+
+/*
+ * NAME: printSaveResult
+ * PARAMS: Pointer to the error from saveGame or loadGame and pointer to the message on success
+ * RETURN: void
+ * DESCRIPTION: Tells the player whether their game was saved or loaded
+ */
+void printSaveResult(const char* error, const char* success) {
+    printf("\n%s.\n", (error != NULL) ? error : success);
+}
+
+/*
+ * NAME: runRoomProgram
+ * PARAMS: none
+ * RETURN: void
+ * DESCRIPTION: Main loop for the program, which continues until the
+ * user reaches the end room. At each new room, prints the room
+ * info and gets the next user input. If the user requests the time,
+ * asks the time service for it, and if they ask for a hint, prints the
+ * next room on the shortest path. Upon finding the end room, calls the
+ * function to print the stats.
+ */
+void runRoomProgram() {
+    int currentRoomIndex;
+    int requestedRoomIndex = -1;
+
+    initPath(&path, pathLogName);
+    currentRoomIndex = resumeSavedGame(&path);
+
+    while (currentRoomIndex != endRoomIndex) {
+        int invalidInput = FALSE;
+        do {
+            printRoomInfo(currentRoomIndex, invalidInput);
+            requestedRoomIndex = getUserInput(currentRoomIndex);
+            invalidInput = (requestedRoomIndex == -1) ? TRUE : FALSE;
+        } while (requestedRoomIndex == -1);
+
+        /* If they requested the time, print it.
+         * Else, if they requested a new room, updates the path*/
+        int command = requestedRoomIndex;
+        if (requestedRoomIndex == TIME_CODE) {
+            printCurrentTime();
+            requestedRoomIndex = currentRoomIndex;
+        } else if (requestedRoomIndex == HINT_CODE) {
+            printHint(currentRoomIndex);
+            requestedRoomIndex = currentRoomIndex;
+        } else if (requestedRoomIndex == SAVE_CODE) {
+            printSaveResult(saveGame(&path), "GAME SAVED");
+            requestedRoomIndex = currentRoomIndex;
+        } else if (requestedRoomIndex == LOAD_CODE) {
+            const char* error = loadGame(&path);
+            printSaveResult(error, "GAME LOADED");
+            requestedRoomIndex = (error == NULL) ? path.lastRoom : currentRoomIndex;
+        } else if (currentRoomIndex != requestedRoomIndex){
+            addToPath(&path, requestedRoomIndex);
+        }
+        recordCommand(command, commandStart);
+
+        currentRoomIndex = requestedRoomIndex;
+    }
+
+    printf("\nYOU'VE FOUND THE END ROOM. CONGRATULATIONS!\n");
+    printFinalStats(&path);
+}
+
+/*
+ * NAME: printUsage
+ * PARAMS: Pointer to the program name
+ * RETURN: void
+ * DESCRIPTION: Prints the command line options
+ */
+void printUsage(char* programName) {
+    printf("USAGE: %s [OPTIONS]\n", programName);
+    printf("  --world PATH  play the rooms directory or world file at PATH, or \"%s\" for the newest\n",
+           LATEST_WORLD);
+    printf("  --id ID       play the world with this id in %s\n", CATALOG_FILE_NAME);
+    printf("  --verify      check the checksum of a packed world file before playing\n");
+    printf("  --load-only   load the world, report how long it took and exit\n");
+    printf("  --no-time-file  do not store the time in %s\n", TIME_FILE_NAME);
+    printf("  --bench-time N  time N time requests on the old and new time paths and exit\n");
+    printf("  --bench-moves N time N room lookups along a random walk through the world and exit\n");
+    printf("  --bench-solver N  time the shortest path search and N hints and exit\n");
+    printf("  --batch FILE    play the commands in FILE (- for standard input) without prompts\n");
+    printf("  --transcript    with --batch, also print the game output (fully buffered)\n");
+    printf("  --server SOCKET serve the world to many players on a Unix domain socket\n");
+    printf("  --workers N     with --server, number of event loop threads (default 1)\n");
+    printf("  --path-summary  end with step, room and loop counts instead of the whole path\n");
+    printf("  --path-log FILE keep the compact log of the player's path in FILE\n");
+    printf("  --bench-save N  time saving and loading a game of N random moves and exit\n");
+    printf("  --save-file FILE  save and load games in FILE (default %s)\n", SAVE_FILE_NAME);
+    printf("  --resume        continue the saved game, in its world unless --world or --id is given\n");
+    printf("  --simulate N    play N games as each simulated player, report their step counts and exit\n");
+    printf("  --threads N     with --simulate, number of threads (default one per processor)\n");
+    printf("  --seed N        with --simulate, seed for the simulated players (default 1)\n");
+    printf("  --max-steps N   with --simulate, give up on a game after N steps (default %d)\n",
+           SIMULATION_MAX_STEPS);
+    printf("  --shared        load the world from shared memory, publishing it there if no other process has\n");
+    printf("  --unshare       remove the world's shared memory copy and exit\n");
+    printf("  --stats FILE    append load counts and command latencies to FILE (- for standard error)\n");
+    printf("                  as JSON at exit and on SIGUSR1\n");
+}
+
+/*
+ * NAME: getElapsedSeconds
+ * PARAMS: Pointer to the starting time
+ * RETURN: Double holding the seconds since the starting time
+ * DESCRIPTION: Measures elapsed wall time with the monotonic clock
+ */
+double getElapsedSeconds(struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * NAME: compareDoubles
+ * PARAMS: Two pointers to doubles
+ * RETURN: Int ordering the doubles
+ * DESCRIPTION: qsort comparator for ascending doubles
+ */
+int compareDoubles(const void* x, const void* y) {
+    double a = *(const double*)x;
+    double b = *(const double*)y;
+    return (a > b) - (a < b);
+}
+
+/*
+ * NAME: printLatencySummary
+ * PARAMS: Pointer to a label, array of latencies in seconds, the count and total seconds
+ * RETURN: void
+ * DESCRIPTION: Prints mean, median and p99 latency and throughput. Sorts the latencies.
+ */
+void printLatencySummary(char* label, double* latencies, int count, double totalSeconds) {
+    double sum = 0;
+    int i;
+    for (i = 0; i < count; i++) {
+        sum += latencies[i];
+    }
+    qsort(latencies, count, sizeof(double), compareDoubles);
+
+    printf("%s: REQUESTS %d MEAN %.2f US MEDIAN %.2f US P99 %.2f US THROUGHPUT %.0f PER SECOND\n",
+           label, count, sum / count * 1e6, latencies[count / 2] * 1e6,
+           latencies[(int)(count * 0.99)] * 1e6, count / totalSeconds);
+}
+
+/*
+ * NAME: benchmarkTimeRequests
+ * PARAMS: Int holding the number of requests and int indicating whether the service writes the time file
+ * RETURN: void
+ * DESCRIPTION: Times the original thread-per-request time path (spawn, write
+ * file, join, read file back) against requests to the time service
+ */
+void benchmarkTimeRequests(int numRequests, int writeFile) {
+    char timeString[BUFFER_SIZE];
+    double* latencies = malloc(numRequests * sizeof(double));
+    struct timespec start, requestStart;
+    assert(latencies != NULL);
+
+    int i;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < numRequests; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &requestStart);
+        createTimeThread();
+        pthread_mutex_unlock(&lock);
+        pthread_join(threadID, NULL);
+        readTimeFromFile(timeString);
+        latencies[i] = getElapsedSeconds(&requestStart);
+    }
+    printLatencySummary("TIME THREAD PER REQUEST", latencies, numRequests, getElapsedSeconds(&start));
+
+    startTimeService(writeFile);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < numRequests; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &requestStart);
+        requestCurrentTime(timeString);
+        latencies[i] = getElapsedSeconds(&requestStart);
+    }
+    printLatencySummary("TIME SERVICE", latencies, numRequests, getElapsedSeconds(&start));
+    stopTimeService();
+
+    free(latencies);
+}
+
+/*
+ * NAME: benchmarkMoves
+ * PARAMS: Int holding the number of moves
+ * RETURN: void
+ * DESCRIPTION: Builds a random walk from the start room as typed room names,
+ * then times checkRoomIsValid over the whole walk. The walk is seeded so runs
+ * over the same world are comparable.
+ */
+void benchmarkMoves(int numMoves) {
+    size_t* inputOffsets = malloc((size_t)numMoves * sizeof(size_t));
+    size_t inputsSize = 0;
+    struct timespec start;
+    assert(inputOffsets != NULL);
+
+    /* Walk first, keeping the rooms in inputOffsets, so the names can be
+     * copied into one block of exactly the size they need */
+    srand(1);
+    int currentRoomIndex = startRoomIndex;
+    int i;
+    for (i = 0; i < numMoves; i++) {
+        currentRoomIndex = getConnection(currentRoomIndex, rand() % getNumConnections(currentRoomIndex));
+        inputOffsets[i] = currentRoomIndex;
+        inputsSize += strlen(getRoomName(currentRoomIndex)) + 1;
+    }
+
+    char* inputs = malloc(inputsSize);
+    size_t inputsUsed = 0;
+    assert(inputs != NULL);
+    for (i = 0; i < numMoves; i++) {
+        const char* name = getRoomName(inputOffsets[i]);
+        size_t length = strlen(name) + 1;
+
+        memcpy(inputs + inputsUsed, name, length);
+        inputOffsets[i] = inputsUsed;
+        inputsUsed += length;
+    }
+
+    currentRoomIndex = startRoomIndex;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < numMoves; i++) {
+        currentRoomIndex = checkRoomIsValid(inputs + inputOffsets[i], currentRoomIndex);
+        assert(currentRoomIndex >= 0);
+    }
+    double seconds = getElapsedSeconds(&start);
+
+    printf("MOVES %d IN %.6f SECONDS: %.0f MOVES PER SECOND, %.1f NS PER MOVE\n",
+           numMoves, seconds, numMoves / seconds, seconds / numMoves * 1e9);
+
+    free(inputs);
+    free(inputOffsets);
+}
+
+/*
+ * NAME: benchmarkSave
+ * PARAMS: Int holding the number of moves
  * RETURN: void
- * DESCRIPTION: Reads the time that was stored in a file
+ * DESCRIPTION: Walks randomly from the start room for numMoves moves, then
+ * times saving that game and loading it back into a new path. The save file
+ * is removed afterwards.
  */
-void readTimeFromFile() {
-    FILE* filePtr;
-    char buffer[BUFFER_SIZE];
+void benchmarkSave(int numMoves) {
+    struct UserPath savedPath, loadedPath;
+    struct stat fileAttributes;
+    struct timespec start;
 
-    memset(buffer, '\0', BUFFER_SIZE);
+    initPath(&savedPath, NULL);
+    srand(1);
+    int currentRoomIndex = startRoomIndex;
+    int i;
+    for (i = 0; i < numMoves; i++) {
+        currentRoomIndex = getConnection(currentRoomIndex, rand() % getNumConnections(currentRoomIndex));
+        addToPath(&savedPath, currentRoomIndex);
+    }
 
-    filePtr = fopen(TIME_FILE_NAME, "r");
-    assert(filePtr != NULL);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    const char* error = saveGame(&savedPath);
+    double saveSeconds = getElapsedSeconds(&start);
+    if (error != NULL) {
+        printf("ERROR: %s. Exiting.\n", error);
+        exit(1);
+    }
+    stat(saveFileName, &fileAttributes);
 
-    if (fgets(buffer, BUFFER_SIZE, filePtr) == NULL) {
-        printf("ERROR: Failed to read file %s. Exiting. \n");
+    initPath(&loadedPath, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    error = loadGame(&loadedPath);
+    double loadSeconds = getElapsedSeconds(&start);
+    assert(error == NULL && loadedPath.steps == savedPath.steps && loadedPath.lastRoom == currentRoomIndex);
+
+    printf("SAVE %d MOVES (%lld BYTES) IN %.6f SECONDS, LOAD IN %.6f SECONDS\n",
+           numMoves, (long long)fileAttributes.st_size, saveSeconds, loadSeconds);
+
+    unlink(saveFileName);
+    freePath(&savedPath);
+    freePath(&loadedPath);
+}
+
+/*
+ * NAME: simulateWalk
+ * PARAMS: Pointer to the worker, pointer to the walk's random stream and the walk's visit stamp
+ * RETURN: Steps taken to reach the end room, simulationMaxSteps if it was not reached
+ * DESCRIPTION: Plays one game from the start room as the worker's player
+ */
+uint32_t simulateWalk(struct SimulationWorker* worker, struct RandomStream* stream, uint32_t stamp) {
+    int roomIndex = startRoomIndex;
+    uint32_t steps = 0;
+
+    worker->lastVisit[roomIndex] = stamp;
+    while (roomIndex != endRoomIndex && steps < simulationMaxSteps) {
+        int numConnections = getNumConnections(roomIndex);
+        int next = -1;
+
+        if (worker->player == GREEDY_PLAYER) {
+            /* Pick uniformly among the unseen neighbors in one pass */
+            int numUnseen = 0;
+            int i;
+            for (i = 0; i < numConnections; i++) {
+                int neighbor = getConnection(roomIndex, i);
+                if (worker->lastVisit[neighbor] != stamp && getRandomBelow(stream, ++numUnseen) == 0) {
+                    next = neighbor;
+                }
+            }
+        }
+        if (next < 0) {
+            next = getConnection(roomIndex, getRandomBelow(stream, numConnections));
+        }
+
+        roomIndex = next;
+        worker->lastVisit[roomIndex] = stamp;
+        steps++;
+    }
+    return steps;
+}
+
+/*
+ * NAME: runSimulationWorker
+ * PARAMS: Pointer to the worker
+ * RETURN: NULL
+ * DESCRIPTION: Plays the worker's range of walks
+ */
+void* runSimulationWorker(void* argument) {
+    struct SimulationWorker* worker = argument;
+    struct RandomStream stream;
+
+    long long i;
+    for (i = 0; i < worker->numWalks; i++) {
+        long long walk = worker->firstWalk + i;
+        seedRandomStream(&stream, simulationSeed, (uint64_t)walk * NUM_PLAYERS + worker->player);
+        worker->steps[i] = simulateWalk(worker, &stream, (uint32_t)i + 1);
+        if (worker->steps[i] == simulationMaxSteps && worker->lastVisit[endRoomIndex] != (uint32_t)i + 1) {
+            worker->unfinished++;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * NAME: compareSteps
+ * PARAMS: Two pointers to step counts
+ * RETURN: Int ordering the step counts
+ * DESCRIPTION: qsort comparator for ascending step counts
+ */
+int compareSteps(const void* x, const void* y) {
+    uint32_t a = *(const uint32_t*)x;
+    uint32_t b = *(const uint32_t*)y;
+    return (a > b) - (a < b);
+}
+
+/*
+ * NAME: simulatePlayers
+ * PARAMS: Int holding the number of walks per player and int holding the number of threads
+ * RETURN: void
+ * DESCRIPTION: Rates the world's difficulty by playing numWalks games as
+ * each simulated player, split across numThreads threads, and printing the
+ * mean, median, 99th percentile and longest step counts. Walks that reach
+ * --max-steps are counted at that length and reported as unfinished.
+ */
+void simulatePlayers(long long numWalks, int numThreads) {
+    struct SimulationWorker workers[MAX_WORKERS];
+    uint32_t* steps = malloc(numWalks * sizeof(uint32_t));
+    struct timespec start;
+    assert(steps != NULL);
+
+    printf("SIMULATING %lld WALKS PER PLAYER OF %d ROOMS ON %d THREADS, SHORTEST PATH %d STEPS\n",
+           numWalks, numRooms, numThreads, shortestPathLength);
+
+    int player;
+    for (player = 0; player < NUM_PLAYERS; player++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        int i;
+        for (i = 0; i < numThreads; i++) {
+            memset(&workers[i], 0, sizeof(workers[i]));
+            workers[i].player = player;
+            workers[i].firstWalk = numWalks * i / numThreads;
+            workers[i].numWalks = numWalks * (i + 1) / numThreads - workers[i].firstWalk;
+            workers[i].steps = steps + workers[i].firstWalk;
+            workers[i].lastVisit = calloc(numRooms, sizeof(uint32_t));
+            assert(workers[i].lastVisit != NULL);
+
+            int result = pthread_create(&workers[i].thread, NULL, &runSimulationWorker, &workers[i]);
+            assert(result == TRUE);
+        }
+
+        long long unfinished = 0;
+        for (i = 0; i < numThreads; i++) {
+            pthread_join(workers[i].thread, NULL);
+            unfinished += workers[i].unfinished;
+            free(workers[i].lastVisit);
+        }
+        double seconds = getElapsedSeconds(&start);
+
+        double totalSteps = 0;
+        long long walk;
+        for (walk = 0; walk < numWalks; walk++) {
+            totalSteps += steps[walk];
+        }
+        qsort(steps, numWalks, sizeof(uint32_t), compareSteps);
+
+        printf("%s WALKS %lld IN %.6f SECONDS: MEAN %.1f MEDIAN %u P99 %u MAX %u STEPS, "
+               "%lld UNFINISHED, %.0f WALKS PER SECOND\n",
+               playerNames[player], numWalks, seconds, totalSteps / numWalks, steps[numWalks / 2],
+               steps[(long long)(numWalks * 0.99)], steps[numWalks - 1], unfinished, numWalks / seconds);
+    }
+
+    free(steps);
+}
+
+/*
+ * NAME: benchmarkSolver
+ * PARAMS: Int holding the number of hints to time
+ * RETURN: void
+ * DESCRIPTION: Times a bidirectional search from the start room to the end
+ * room, building the distance table, and hints from random rooms both with
+ * the table and with a search per hint
+ */
+void benchmarkSolver(int numHints) {
+    struct timespec start;
+    long long checksum = 0;
+    int numSearches = (numHints < BENCH_SOLVER_SEARCHES) ? numHints : BENCH_SOLVER_SEARCHES;
+    int nextRoom;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int searchLength = findShortestPath(startRoomIndex, endRoomIndex, &nextRoom);
+    double searchSeconds = getElapsedSeconds(&start);
+
+    srand(1);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int i;
+    for (i = 0; i < numSearches; i++) {
+        checksum += findShortestPath(rand() % numRooms, endRoomIndex, &nextRoom);
+    }
+    double searchHintSeconds = getElapsedSeconds(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    buildDistanceTable();
+    double tableSeconds = getElapsedSeconds(&start);
+    assert(distanceToEnd[startRoomIndex] == searchLength);
+
+    srand(1);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < numHints; i++) {
+        checksum += getDistanceToEnd(rand() % numRooms, &nextRoom);
+    }
+    double tableHintSeconds = getElapsedSeconds(&start);
+
+    printf("SHORTEST PATH %d STEPS: SEARCH %.6f SECONDS, TABLE %.6f SECONDS (%lld)\n",
+           searchLength, searchSeconds, tableSeconds, checksum);
+    printf("HINTS %d: SEARCH %.1f US PER HINT, TABLE %.1f NS PER HINT\n", numHints,
+           (numSearches > 0) ? searchHintSeconds / numSearches * 1e6 : 0,
+           (numHints > 0) ? tableHintSeconds / numHints * 1e9 : 0);
+}
+
+/*
+ * NAME: printJsonString
+ * PARAMS: Pointer to the string
+ * RETURN: void
+ * DESCRIPTION: Prints a string as a quoted JSON string
+ */
+void printJsonString(const char* string) {
+    putchar('"');
+    for (; *string != '\0'; string++) {
+        if (*string == '"' || *string == '\\') {
+            putchar('\\');
+        }
+        if ((unsigned char)*string < 0x20) {
+            printf("\\u%04x", *string);
+        } else {
+            putchar(*string);
+        }
+    }
+    putchar('"');
+}
+
+/*
+ * NAME: runBatchProgram
+ * PARAMS: Pointer to the script file name ("-" for standard input) and int
+ * indicating whether to print the game transcript
+ * RETURN: void
+ * DESCRIPTION: Plays the game from a script with one command per line and no
+ * prompts, stopping at the end room or the end of the script. With a
+ * transcript the usual game output is printed, fully buffered. Finishes with
+ * a one line JSON summary of the run.
+ */
+void runBatchProgram(char* scriptName, int showTranscript) {
+    FILE* script = (strcmp(scriptName, "-") == TRUE) ? stdin : fopen(scriptName, "r");
+    char timeString[BUFFER_SIZE];
+    char* line = NULL;
+    size_t lineSize = 0;
+    ssize_t length;
+    long long commands = 0,
+              invalidCommands = 0,
+              timeRequests = 0,
+              hints = 0,
+              saves = 0,
+              loads = 0;
+    int currentRoomIndex;
+    struct timespec start;
+
+    if (script == NULL) {
+        printf("ERROR: Failed to open script %s. Exiting.\n", scriptName);
         exit(1);
     }
+    setvbuf(script, NULL, _IOFBF, BATCH_BUFFER_SIZE);
+    if (showTranscript == TRUE) {
+        setvbuf(stdout, NULL, _IOFBF, BATCH_BUFFER_SIZE);
+    }
 
-    fclose(filePtr);
+    initPath(&path, pathLogName);
+    currentRoomIndex = resumeSavedGame(&path);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (currentRoomIndex != endRoomIndex && (length = getline(&line, &lineSize, script)) != -1) {
+        line[strcspn(line, "\n")] = '\0';
+        commands++;
+        uint64_t commandStart = startCommandTimer();
+
+        /* stdout is fully buffered here, so the room text is only copied */
+        if (showTranscript == TRUE) {
+            size_t textLength;
+            const char* text = getRoomText(currentRoomIndex, &textLength);
+            fwrite(text, 1, textLength, stdout);
+        }
+
+        int requestedRoomIndex = checkRoomIsValid(line, currentRoomIndex);
 
-    printf("\n %s\n", buffer);
+        if (requestedRoomIndex == -1) {
+            invalidCommands++;
+            if (showTranscript == TRUE) {
+                fputs(INVALID_ROOM_TEXT, stdout);
+            }
+        } else if (requestedRoomIndex == TIME_CODE) {
+            timeRequests++;
+            if (showTranscript == TRUE) {
+                printCurrentTime();
+            } else {
+                requestCurrentTime(timeString);
+            }
+        } else if (requestedRoomIndex == HINT_CODE) {
+            hints++;
+            if (showTranscript == TRUE) {
+                printHint(currentRoomIndex);
+            }
+        } else if (requestedRoomIndex == SAVE_CODE) {
+            const char* error = saveGame(&path);
+            saves += (error == NULL);
+            if (showTranscript == TRUE) {
+                printSaveResult(error, "GAME SAVED");
+            }
+        } else if (requestedRoomIndex == LOAD_CODE) {
+            const char* error = loadGame(&path);
+            if (error == NULL) {
+                loads++;
+                currentRoomIndex = path.lastRoom;
+            }
+            if (showTranscript == TRUE) {
+                printSaveResult(error, "GAME LOADED");
+            }
+        } else {
+            addToPath(&path, requestedRoomIndex);
+            currentRoomIndex = requestedRoomIndex;
+        }
+        recordCommand(requestedRoomIndex, commandStart);
+    }
+
+    double wallSeconds = getElapsedSeconds(&start);
+
+    if (showTranscript == TRUE && currentRoomIndex == endRoomIndex) {
+        printf("\nYOU'VE FOUND THE END ROOM. CONGRATULATIONS!\n");
+        printFinalStats(&path);
+    } else if (showTranscript == TRUE) {
+        printf("\n");
+    }
+
+    printf("{\"commands\": %lld, \"steps\": %lld, \"unique_rooms\": %lld, \"loops\": %lld, ",
+           commands, path.steps, path.uniqueRooms, path.loops);
+    printf("\"invalid_commands\": %lld, \"time_requests\": %lld, \"hints\": %lld, \"saves\": %lld, \"loads\": %lld, ",
+           invalidCommands, timeRequests, hints, saves, loads);
+    printf("\"shortest_path\": %d, ", shortestPathLength);
+    printf("\"final_room\": ");
+    printJsonString(getRoomName(currentRoomIndex));
+    printf(", \"reached_end\": %s, \"wall_seconds\": %.6f, \"commands_per_second\": %.0f}\n",
+           (currentRoomIndex == endRoomIndex) ? "true" : "false", wallSeconds,
+           (wallSeconds > 0) ? commands / wallSeconds : 0);
+    fflush(stdout);
+
+    free(line);
+    if (script != stdin) {
+        fclose(script);
+    }
 }
 
 /*
- * NAME: runRoomProgram
- * PARAMS: none
+ * NAME: appendOutput
+ * PARAMS: Pointer to the output buffer, printf style format and arguments
  * RETURN: void
- * DESCRIPTION: Main loop for the program, which continues until the
- * user reaches the end room. At each new room, prints the room
- * info and gets the next user input. If the user requests the time,
- * creates a thread and transfers the lock to it. Upon finding the end
- * room, calls the function to print the stats.
+ * DESCRIPTION: Formats text onto the end of an output buffer, growing it as needed
  */
-void runRoomProgram() {
-    int currentRoomIndex = startRoomIndex;
-    int requestedRoomIndex = -1;
+void appendOutput(struct OutputBuffer* output, const char* format, ...) {
+    va_list args;
+    int length;
 
-    initPath();
+    va_start(args, format);
+    length = vsnprintf(output->data + output->used, output->size - output->used, format, args);
+    va_end(args);
 
-    while (currentRoomIndex != endRoomIndex) {
-        do {
-            printRoomInfo(currentRoomIndex);
-            requestedRoomIndex = getUserInput(currentRoomIndex);
-        } while (requestedRoomIndex == -1);
+    if ((size_t)length >= output->size - output->used) {
+        while ((size_t)length >= output->size - output->used) {
+            output->size *= 2;
+        }
+        output->data = realloc(output->data, output->size);
+        assert(output->data != NULL);
 
-        /* If they requested the time, transfer the lock.
-         * Else, if they requested a new room, updates the path*/
-        if (requestedRoomIndex == TIME_CODE) {
-            createTimeThread();
-            pthread_mutex_unlock(&lock);
-            pthread_join(threadID, NULL);
-            readTimeFromFile();
-            requestedRoomIndex = currentRoomIndex;
-        } else if (currentRoomIndex != requestedRoomIndex){
-            addToPath(requestedRoomIndex);
+        va_start(args, format);
+        vsnprintf(output->data + output->used, output->size - output->used, format, args);
+        va_end(args);
+    }
+
+    output->used += length;
+}
+
+/*
+ * NAME: appendRoomInfo
+ * PARAMS: Pointer to the output buffer and int holding the room index
+ * RETURN: void
+ * DESCRIPTION: Same text as printRoomInfo, copied to an output buffer, or
+ * rendered straight into it for worlds whose text is not rendered ahead
+ */
+void appendRoomInfo(struct OutputBuffer* output, int roomIndex) {
+    size_t length = (roomText.text != NULL) ? roomText.offsets[roomIndex + 1] - roomText.offsets[roomIndex]
+                                            : getRoomTextLength(roomIndex);
+
+    if (length >= output->size - output->used) {
+        while (length >= output->size - output->used) {
+            output->size *= 2;
         }
+        output->data = realloc(output->data, output->size);
+        assert(output->data != NULL);
+    }
 
-        currentRoomIndex = requestedRoomIndex;
+    if (roomText.text != NULL) {
+        memcpy(output->data + output->used, roomText.text + roomText.offsets[roomIndex], length);
+    } else {
+        renderRoomText(roomIndex, output->data + output->used);
     }
+    output->used += length;
+    output->data[output->used] = '\0';
+}
 
-    printf("\nYOU'VE FOUND THE END ROOM. CONGRATULATIONS!\n");
-    printFinalStats();
+/*
+ * NAME: appendFinalStats
+ * PARAMS: Pointer to the output buffer and pointer to the path struct
+ * RETURN: void
+ * DESCRIPTION: Same text as printFinalStats, written to an output buffer
+ */
+void appendFinalStats(struct OutputBuffer* output, struct UserPath* path) {
+    struct PathReader reader;
+    int roomIndex;
+
+    if (pathSummary == TRUE) {
+        appendOutput(output, "YOU TOOK %lld STEPS THROUGH %lld DIFFERENT ROOMS AND LOOPED BACK %lld TIMES.\n",
+                     path->steps, path->uniqueRooms, path->loops);
+    } else {
+        appendOutput(output, "YOU TOOK %lld STEPS. YOUR PATH TO VICTORY WAS:\n", path->steps);
+        startPathReader(&reader, path);
+        while ((roomIndex = nextPathRoom(&reader)) != -1) {
+            appendOutput(output, "%s\n", getRoomName(roomIndex));
+        }
+    }
+
+    if (shortestPathLength > 0 && path->steps > 0) {
+        appendOutput(output, "THE SHORTEST PATH WAS %d STEPS, YOUR PATH EFFICIENCY WAS %.1f%%.\n",
+                     shortestPathLength, 100.0 * shortestPathLength / path->steps);
+    }
+}
+
+/*
+ * NAME: createSession
+ * PARAMS: Int holding the connected socket
+ * RETURN: Pointer to the new session
+ * DESCRIPTION: Starts a player in the start room and queues the first room info
+ */
+struct Session* createSession(int socket) {
+    struct Session* session = malloc(sizeof(struct Session));
+    assert(session != NULL);
+
+    session->socket = socket;
+    session->currentRoomIndex = startRoomIndex;
+    session->finished = FALSE;
+    session->inputUsed = 0;
+    initPath(&session->path, NULL);
+
+    session->output.size = BUFFER_SIZE;
+    session->output.used = 0;
+    session->output.sent = 0;
+    session->output.data = malloc(session->output.size);
+    assert(session->output.data != NULL);
+
+    appendRoomInfo(&session->output, session->currentRoomIndex);
+
+    return session;
+}
+
+/*
+ * NAME: closeSession
+ * PARAMS: Pointer to the session
+ * RETURN: void
+ * DESCRIPTION: Closes the session's socket and frees it
+ */
+void closeSession(struct Session* session) {
+    close(session->socket);
+    freePath(&session->path);
+    free(session->output.data);
+    free(session);
+}
+
+/*
+ * NAME: handleSessionCommand
+ * PARAMS: Pointer to the session and pointer to one line of input
+ * RETURN: void
+ * DESCRIPTION: Plays one command for a session and queues the response,
+ * which is the same text the interactive game prints
+ */
+void handleSessionCommand(struct Session* session, char* command) {
+    uint64_t commandStart = startCommandTimer();
+    char timeString[BUFFER_SIZE];
+    int requestedRoomIndex = checkRoomIsValid(command, session->currentRoomIndex);
+
+    if (requestedRoomIndex == -1) {
+        appendOutput(&session->output, INVALID_ROOM_TEXT);
+    } else if (requestedRoomIndex == TIME_CODE) {
+        requestCurrentTime(timeString);
+        timeString[strcspn(timeString, "\n") + 1] = '\0';
+        appendOutput(&session->output, "\n %s\n", timeString);
+    } else if (requestedRoomIndex == HINT_CODE) {
+        formatHint(session->currentRoomIndex, timeString);
+        appendOutput(&session->output, "\n%s\n", timeString);
+    } else if (requestedRoomIndex == SAVE_CODE || requestedRoomIndex == LOAD_CODE) {
+        appendOutput(&session->output, "\nGAMES CANNOT BE SAVED OR LOADED ON THE SERVER.\n");
+    } else {
+        addToPath(&session->path, requestedRoomIndex);
+        session->currentRoomIndex = requestedRoomIndex;
+    }
+
+    if (session->currentRoomIndex == endRoomIndex) {
+        appendOutput(&session->output, "\nYOU'VE FOUND THE END ROOM. CONGRATULATIONS!\n");
+        appendFinalStats(&session->output, &session->path);
+        session->finished = TRUE;
+    } else {
+        appendRoomInfo(&session->output, session->currentRoomIndex);
+    }
+    recordCommand(requestedRoomIndex, commandStart);
+}
+
+/*
+ * NAME: flushSession
+ * PARAMS: Pointer to the worker and pointer to the session
+ * RETURN: Int indicating the session is still open
+ * DESCRIPTION: Sends as much queued output as the socket takes. Waits for
+ * the socket to become writable if output is left over, and closes the
+ * session once a finished game is fully sent. Returns 0 if the session is
+ * still open, 1 if it was closed.
+ */
+int flushSession(struct ServerWorker* worker, struct Session* session) {
+    struct epoll_event event;
+
+    while (session->output.sent < session->output.used) {
+        ssize_t sent = send(session->socket, session->output.data + session->output.sent,
+                            session->output.used - session->output.sent, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EAGAIN) {
+            break;
+        } else if (sent < 0) {
+            closeSession(session);
+            return FALSE;
+        }
+        session->output.sent += sent;
+    }
+
+    if (session->output.sent == session->output.used) {
+        session->output.sent = 0;
+        session->output.used = 0;
+        if (session->finished == TRUE) {
+            worker->sessionsFinished++;
+            closeSession(session);
+            return FALSE;
+        }
+    }
+
+    event.events = EPOLLIN | ((session->output.used > 0) ? EPOLLOUT : 0);
+    event.data.ptr = session;
+    epoll_ctl(worker->epollFd, EPOLL_CTL_MOD, session->socket, &event);
+
+    return TRUE;
+}
+
+/*
+ * NAME: readSession
+ * PARAMS: Pointer to the worker and pointer to the session
+ * RETURN: void
+ * DESCRIPTION: Reads what the player sent, plays every complete line and
+ * sends the responses. Closes the session when the player disconnects.
+ */
+void readSession(struct ServerWorker* worker, struct Session* session) {
+    while (session->finished == FALSE) {
+        ssize_t received = recv(session->socket, session->input + session->inputUsed,
+                                BUFFER_SIZE - 1 - session->inputUsed, 0);
+        if (received < 0 && errno == EAGAIN) {
+            break;
+        } else if (received <= 0) {
+            closeSession(session);
+            return;
+        }
+        session->inputUsed += received;
+        session->input[session->inputUsed] = '\0';
+
+        char* line = session->input;
+        char* newline;
+        while (session->finished == FALSE && (newline = strchr(line, '\n')) != NULL) {
+            *newline = '\0';
+            worker->commands++;
+            handleSessionCommand(session, line);
+            line = newline + 1;
+        }
+
+        /* Keep a partial line for the next read, drop a line too long to ever fit */
+        session->inputUsed -= line - session->input;
+        memmove(session->input, line, session->inputUsed);
+        if (session->inputUsed == BUFFER_SIZE - 1) {
+            session->inputUsed = 0;
+            handleSessionCommand(session, "");
+        }
+    }
+
+    flushSession(worker, session);
+}
+
+/*
+ * NAME: acceptSessions
+ * PARAMS: Pointer to the worker
+ * RETURN: void
+ * DESCRIPTION: Accepts every waiting connection into this worker
+ */
+void acceptSessions(struct ServerWorker* worker) {
+    struct epoll_event event;
+    int socket;
+
+    while ((socket = accept4(listenSocket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        struct Session* session = createSession(socket);
+        worker->sessionsStarted++;
+
+        event.events = EPOLLIN;
+        event.data.ptr = session;
+        epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, socket, &event);
+
+        flushSession(worker, session);
+    }
+}
+
+/*
+ * NAME: runServerWorker
+ * PARAMS: Pointer to the worker
+ * RETURN: void*
+ * DESCRIPTION: Event loop for one server thread. Every worker waits on the
+ * listening socket (exclusively, so only one wakes per connection) and on
+ * the sessions it accepted.
+ */
+void* runServerWorker(void* argument) {
+    struct ServerWorker* worker = argument;
+    struct epoll_event events[MAX_EVENTS];
+    struct epoll_event event;
+
+    event.events = EPOLLIN | EPOLLEXCLUSIVE;
+    event.data.ptr = NULL;
+    epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, listenSocket, &event);
+
+    while (serverRunning == TRUE) {
+        int numEvents = epoll_wait(worker->epollFd, events, MAX_EVENTS, SERVER_POLL_MS);
+
+        int i;
+        for (i = 0; i < numEvents; i++) {
+            struct Session* session = events[i].data.ptr;
+
+            if (session == NULL) {
+                acceptSessions(worker);
+            } else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                readSession(worker, session);
+            } else if (events[i].events & EPOLLOUT) {
+                flushSession(worker, session);
+            }
+        }
+    }
+
+    return NULL;
 }
 
-int main() {
+/*
+ * NAME: stopServer
+ * PARAMS: Int holding the signal number
+ * RETURN: void
+ * DESCRIPTION: Signal handler that asks the server threads to stop
+ */
+void stopServer(int signalNumber) {
+    (void)signalNumber;
+    serverRunning = FALSE;
+}
+
+/*
+ * NAME: raiseFileLimit
+ * PARAMS: none
+ * RETURN: void
+ * DESCRIPTION: Raises the open file limit as far as allowed so the server
+ * can hold thousands of sessions
+ */
+void raiseFileLimit() {
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+/*
+ * NAME: runServer
+ * PARAMS: Pointer to the socket path and int holding the number of worker threads
+ * RETURN: void
+ * DESCRIPTION: Serves the loaded world on a Unix domain socket until
+ * interrupted, then prints a JSON summary of the sessions served
+ */
+void runServer(char* socketPath, int numWorkers) {
+    struct sockaddr_un address;
+    struct ServerWorker workers[MAX_WORKERS];
+    struct sigaction action;
+    struct timespec start;
+
+    if (numWorkers < 1 || numWorkers > MAX_WORKERS) {
+        printf("ERROR: Number of workers must be between 1 and %d. Exiting.\n", MAX_WORKERS);
+        exit(1);
+    }
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        printf("ERROR: Socket path %s is too long. Exiting.\n", socketPath);
+        exit(1);
+    }
+
+    raiseFileLimit();
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath);
+    unlink(socketPath);
+
+    listenSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenSocket < 0
+        || bind(listenSocket, (struct sockaddr*)&address, sizeof(address)) != 0
+        || listen(listenSocket, SOMAXCONN) != 0) {
+        printf("ERROR: Failed to listen on %s. Exiting.\n", socketPath);
+        exit(1);
+    }
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopServer;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    printf("SERVING %d ROOMS ON %s WITH %d WORKERS\n", numRooms, socketPath, numWorkers);
+    fflush(stdout);
+
+    serverRunning = TRUE;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int i;
+    for (i = 0; i < numWorkers; i++) {
+        memset(&workers[i], 0, sizeof(workers[i]));
+        workers[i].epollFd = epoll_create1(EPOLL_CLOEXEC);
+        assert(workers[i].epollFd >= 0);
+
+        int result = pthread_create(&workers[i].thread, NULL, &runServerWorker, &workers[i]);
+        assert(result == TRUE);
+    }
+
+    long long sessionsStarted = 0,
+              sessionsFinished = 0,
+              commands = 0;
+    for (i = 0; i < numWorkers; i++) {
+        pthread_join(workers[i].thread, NULL);
+        close(workers[i].epollFd);
+        sessionsStarted += workers[i].sessionsStarted;
+        sessionsFinished += workers[i].sessionsFinished;
+        commands += workers[i].commands;
+    }
+
+    close(listenSocket);
+    unlink(socketPath);
+
+    printf("{\"sessions_started\": %lld, \"sessions_finished\": %lld, \"commands\": %lld, \"wall_seconds\": %.6f}\n",
+           sessionsStarted, sessionsFinished, commands, getElapsedSeconds(&start));
+}
+
+/*
+ * NAME: writeStats
+ * PARAMS: none
+ * RETURN: void
+ * DESCRIPTION: Appends the statistics so far to the --stats file as one line of JSON
+ */
+void writeStats(void) {
+    FILE* file = openStatsFile(statsFileName);
+    if (file == NULL) {
+        return;
+    }
+
+    fprintf(file, "{\"program\": \"eganch.adventure\", \"pid\": %d, \"seconds\": %.6f, ",
+            getpid(), (getStatsTime() - statsStart) / 1e9);
+    fprintf(file, "\"rooms\": %d, \"directory_entries\": %llu, \"files_read\": %llu, \"bytes_read\": %llu, "
+            "\"bytes_mapped\": %llu, \"load_seconds\": %.6f, ", numRooms,
+            (unsigned long long)readStat(&stats.directoryEntries), (unsigned long long)readStat(&stats.filesRead),
+            (unsigned long long)readStat(&stats.bytesRead), (unsigned long long)readStat(&stats.bytesMapped),
+            readStat(&stats.loadNs) / 1e9);
+    fprintf(file, "\"turn_writes\": %llu, \"turn_bytes\": %llu, ",
+            (unsigned long long)readStat(&stats.turnWrites), (unsigned long long)readStat(&stats.turnBytes));
+    printHistogramJson(file, "moves", &stats.moves);
+    fprintf(file, ", ");
+    printHistogramJson(file, "invalid_commands", &stats.invalidCommands);
+    fprintf(file, ", ");
+    printHistogramJson(file, "time_requests", &stats.timeRequests);
+    fprintf(file, ", ");
+    printHistogramJson(file, "hints", &stats.hints);
+    fprintf(file, "}");
+    closeStatsFile(file);
+}
+
+int main(int argc, char** argv) {
+    static struct option longOptions[] = {
+        {"world", required_argument, NULL, 'w'},
+        {"id", required_argument, NULL, 'i'},
+        {"verify", no_argument, NULL, 'v'},
+        {"load-only", no_argument, NULL, 'l'},
+        {"no-time-file", no_argument, NULL, 'n'},
+        {"bench-time", required_argument, NULL, 'T'},
+        {"bench-moves", required_argument, NULL, 'M'},
+        {"bench-solver", required_argument, NULL, 'S'},
+        {"batch", required_argument, NULL, 'b'},
+        {"transcript", no_argument, NULL, 't'},
+        {"server", required_argument, NULL, 's'},
+        {"workers", required_argument, NULL, 'W'},
+        {"path-summary", no_argument, NULL, 'p'},
+        {"path-log", required_argument, NULL, 'P'},
+        {"stats", required_argument, NULL, 'd'},
+        {"bench-save", required_argument, NULL, 'B'},
+        {"save-file", required_argument, NULL, 'F'},
+        {"resume", no_argument, NULL, 'R'},
+        {"simulate", required_argument, NULL, 'C'},
+        {"threads", required_argument, NULL, 'j'},
+        {"seed", required_argument, NULL, 'e'},
+        {"max-steps", required_argument, NULL, 'x'},
+        {"shared", no_argument, NULL, 'm'},
+        {"unshare", no_argument, NULL, 'u'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    char* requestedWorld = NULL;
+    char* requestedId = NULL;
+    char* batchScript = NULL;
+    char* serverSocket = NULL;
+    int numWorkers = 1;
+    int showTranscript = FALSE;
+    int loadOnly = FALSE;
+    int verify = FALSE;
+    int storeTimeFile = TRUE;
+    int benchTimeRequests = 0;
+    int benchMoves = 0;
+    int benchHints = 0;
+    int benchSaves = 0;
+    int unshare = FALSE;
+    long long numSimulations = 0;
+    int numThreads = (sysconf(_SC_NPROCESSORS_ONLN) < MAX_WORKERS) ? (int)sysconf(_SC_NPROCESSORS_ONLN) : MAX_WORKERS;
+    int option;
+
+    while ((option = getopt_long(argc, argv, "w:i:vlnT:M:S:b:ts:W:pP:d:B:F:RC:j:e:x:muh", longOptions, NULL)) != -1) {
+        switch (option) {
+            case 'w':
+                requestedWorld = optarg;
+                break;
+            case 'i':
+                requestedId = optarg;
+                break;
+            case 'v':
+                verify = TRUE;
+                break;
+            case 'l':
+                loadOnly = TRUE;
+                break;
+            case 'n':
+                storeTimeFile = FALSE;
+                break;
+            case 'T':
+                benchTimeRequests = atoi(optarg);
+                break;
+            case 'M':
+                benchMoves = atoi(optarg);
+                break;
+            case 'S':
+                benchHints = atoi(optarg);
+                break;
+            case 'b':
+                batchScript = optarg;
+                break;
+            case 't':
+                showTranscript = TRUE;
+                break;
+            case 's':
+                serverSocket = optarg;
+                break;
+            case 'W':
+                numWorkers = atoi(optarg);
+                break;
+            case 'p':
+                pathSummary = TRUE;
+                break;
+            case 'P':
+                pathLogName = optarg;
+                break;
+            case 'd':
+                statsFileName = optarg;
+                statsEnabled = TRUE;
+                break;
+            case 'B':
+                benchSaves = atoi(optarg);
+                break;
+            case 'F':
+                saveFileName = optarg;
+                break;
+            case 'R':
+                resumeGame = TRUE;
+                break;
+            case 'C':
+                numSimulations = atoll(optarg);
+                break;
+            case 'j':
+                numThreads = atoi(optarg);
+                break;
+            case 'e':
+                simulationSeed = strtoull(optarg, NULL, 10);
+                break;
+            case 'x':
+                simulationMaxSteps = (uint32_t)strtoul(optarg, NULL, 10);
+                break;
+            case 'm':
+                sharedWorld = TRUE;
+                break;
+            case 'u':
+                unshare = TRUE;
+                break;
+            case 'h':
+                printUsage(argv[0]);
+                return 0;
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (numThreads < 1 || numThreads > MAX_WORKERS || simulationMaxSteps < 1) {
+        printf("ERROR: --threads must be 1 to %d and --max-steps at least 1. Exiting.\n", MAX_WORKERS);
+        return 1;
+    }
+
+    /* Start before any other thread so they all leave the stats signal to it */
+    if (statsEnabled == TRUE) {
+        statsStart = getStatsTime();
+        startStatsThread(writeStats);
+    }
+
     /* Create a mutex for thread synchronization*/
     int result = pthread_mutex_init(&lock, NULL);
     assert(result == TRUE);
 
+    if (benchTimeRequests > 0) {
+        benchmarkTimeRequests(benchTimeRequests, storeTimeFile);
+        pthread_mutex_destroy(&lock);
+        return 0;
+    }
+
     /* Set up necessary structs */
-    getRoomsDirectory();
-    getRoomInfo();
+    struct timespec loadStart;
+    clock_gettime(CLOCK_MONOTONIC, &loadStart);
+
+#ifdef EMBEDDED_WORLD
+    if (requestedId != NULL || requestedWorld != NULL || sharedWorld == TRUE || unshare == TRUE) {
+        printf("ERROR: This build only plays its embedded world %s. Exiting.\n", EMBEDDED_WORLD_NAME);
+        return 1;
+    }
+#else
+    if (requestedId != NULL) {
+        findCatalogWorld(requestedId);
+    } else if (requestedWorld != NULL && strcmp(requestedWorld, LATEST_WORLD) != TRUE) {
+        strncpy(worldPath, requestedWorld, sizeof(worldPath) - 1);
+    } else if (requestedWorld != NULL || resumeGame != TRUE || findSavedWorld() != TRUE) {
+        getRoomsDirectory();
+    }
 
-    /* Run the main loop */
-    runRoomProgram();
+    if (unshare == TRUE) {
+        unshareWorld();
+        pthread_mutex_destroy(&lock);
+        return 0;
+    }
+#endif
+    if (sharedWorld == TRUE) {
+        loadSharedWorld(verify);
+    } else {
+        loadWorld(verify);
+    }
+    stats.loadNs = (uint64_t)(getElapsedSeconds(&loadStart) * 1e9);
+
+    if (benchMoves > 0) {
+        benchmarkMoves(benchMoves);
+    } else if (benchHints > 0) {
+        benchmarkSolver(benchHints);
+    } else if (benchSaves > 0) {
+        benchmarkSave(benchSaves);
+    } else if (numSimulations > 0) {
+        prepareSolver();
+        simulatePlayers(numSimulations, numThreads);
+    } else if (loadOnly == TRUE) {
+        printf("LOADED %d ROOMS (%llu CONNECTIONS) IN %.6f SECONDS WITH %lld ALLOCATIONS\n",
+               numRooms, (unsigned long long)world.numConnections, getElapsedSeconds(&loadStart),
+               (world.mapping != NULL) ? 1 : world.arena.allocations);
+    } else if (serverSocket != NULL) {
+        prepareSolver();
+        prepareRoomText();
+        startTimeService(storeTimeFile);
+        runServer(serverSocket, numWorkers);
+        stopTimeService();
+    } else if (batchScript != NULL) {
+        prepareSolver();
+        prepareRoomText();
+        startTimeService(storeTimeFile);
+        runBatchProgram(batchScript, showTranscript);
+        stopTimeService();
+    } else {
+        /* Run the main loop */
+        prepareSolver();
+        prepareRoomText();
+        startTimeService(storeTimeFile);
+        runRoomProgram();
+        stopTimeService();
+    }
 
     /* Free allocated memory */
-    int i, j;
-    for (i = 0; i < NUM_ROOMS; i++) {
-        for (j = 0; j < rooms[i].numConnections; j++) {
-            free(rooms[i].connections[j]);
-        }
+    freeWorld();
+    freePath(&path);
+    free(distanceToEnd);
+    freeRoomText();
+
+    if (statsEnabled == TRUE) {
+        finishStats(writeStats);
     }
-    free(rooms);
-    free(path.path);
 
     /* Destroy the mutex */
     pthread_mutex_destroy(&lock);
 
     return 0;
-}
\ No newline at end of file
+}
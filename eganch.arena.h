@@ -0,0 +1,101 @@
+/*
+ * FILE NAME: eganch.arena.h
+ * DESCRIPTION: Arena allocation shared by eganch.buildrooms and
+ * eganch.adventure. A world's rooms, names and connections are carved one
+ * after another out of a single block, so a world takes a handful of
+ * allocations however large it is, lies contiguously in memory and is freed
+ * with one call. An arena sized up front never moves. One that runs out is
+ * reallocated to twice the size, which may move it, so code that lets an
+ * arena grow keeps offsets into it rather than pointers.
+ * AUTHOR: Chelsea Egan (eganch@oregonstate.edu)
+ */
+
+#ifndef EGANCH_ARENA_H
+#define EGANCH_ARENA_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#define ARENA_ALIGNMENT 8
+
+struct Arena {
+    char* base;
+    size_t used;
+    size_t size;
+    long long allocations;
+};
+
+/*
+ * NAME: initArena
+ * PARAMS: Pointer to the arena and its starting size in bytes
+ * RETURN: void
+ * DESCRIPTION: Allocates the arena's block
+ */
+static inline void initArena(struct Arena* arena, size_t size) {
+    arena->size = (size > 0) ? size : ARENA_ALIGNMENT;
+    arena->base = malloc(arena->size);
+    assert(arena->base != NULL);
+    arena->used = 0;
+    arena->allocations = 1;
+}
+
+/*
+ * NAME: reserveArena
+ * PARAMS: Pointer to the arena and number of bytes
+ * RETURN: void
+ * DESCRIPTION: Makes sure the next size bytes fit without growing again,
+ * doubling the block until they do. May move the arena.
+ */
+static inline void reserveArena(struct Arena* arena, size_t size) {
+    if (arena->used + size <= arena->size) {
+        return;
+    }
+
+    while (arena->used + size > arena->size) {
+        arena->size *= 2;
+    }
+    arena->base = realloc(arena->base, arena->size);
+    assert(arena->base != NULL);
+    arena->allocations++;
+}
+
+/*
+ * NAME: allocateArena
+ * PARAMS: Pointer to the arena, number of bytes and their alignment (a power of two)
+ * RETURN: Offset of the bytes from the start of the arena
+ * DESCRIPTION: Takes the next size bytes of the arena. May move the arena.
+ */
+static inline size_t allocateArena(struct Arena* arena, size_t size, size_t alignment) {
+    size_t offset = (arena->used + alignment - 1) & ~(alignment - 1);
+
+    arena->used = offset;
+    reserveArena(arena, size);
+    arena->used = offset + size;
+    return offset;
+}
+
+/*
+ * NAME: getArenaPointer
+ * PARAMS: Pointer to the arena and an offset into it
+ * RETURN: Pointer to the byte at that offset
+ * DESCRIPTION: Only good until the arena next grows
+ */
+static inline void* getArenaPointer(struct Arena* arena, size_t offset) {
+    return arena->base + offset;
+}
+
+/*
+ * NAME: freeArena
+ * PARAMS: Pointer to the arena
+ * RETURN: void
+ * DESCRIPTION: Frees everything allocated from the arena at once
+ */
+static inline void freeArena(struct Arena* arena) {
+    free(arena->base);
+    arena->base = NULL;
+    arena->used = 0;
+    arena->size = 0;
+}
+
+#endif
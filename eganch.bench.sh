@@ -0,0 +1,188 @@
+#!/bin/bash
+#
+# PROGRAM NAME: eganch.bench.sh
+# DESCRIPTION: Benchmark suite for eganch.buildrooms and eganch.adventure.
+# Measures, over a range of world sizes and for both the text and the packed
+# binary formats:
+#   generate  world generation time (eganch.buildrooms)
+#   load      world load time and allocations (eganch.adventure --load-only)
+#   moves     room lookups per second along a random walk (--bench-moves)
+#   solver    shortest path search and distance table build times, and the
+#             cost of a hint with and without the table (--bench-solver)
+#   save      time to save and to load a game of --moves random moves
+#             (--bench-save)
+#   simulate  --simulations games each by the random and greedy simulated
+#             players: mean steps and walks per second (--simulate)
+# and once per run:
+#   bulk      worlds and files written per second by buildrooms --count
+#   files     room files written per second for a text world of --file-rooms
+#             rooms, with no syncing and with --sync batches of 64
+#   startup   time to find and load the newest of those worlds, through the
+#             catalog's latest link and by scanning the directory
+#   stream    bytes written per second and peak RSS of buildrooms --stream,
+#             binary worlds of --stream-sizes rooms
+#   time      time command latency, thread per request vs the time service
+# Worlds are built from a fixed seed so runs are comparable. Results are
+# printed as CSV and, with --json FILE, also written as JSON so runs can be
+# compared across commits.
+# USAGE: ./eganch.bench.sh [--sizes "N ..."] [--stream-sizes "N ..."] [--file-rooms N] [--moves N]
+#                          [--simulations N] [--time-requests N] [--csv FILE] [--json FILE]
+# AUTHOR: Chelsea Egan (eganch@oregonstate.edu)
+#
+
+SIZES="1000 10000 100000"
+STREAM_SIZES="1000000"
+FILE_ROOMS=100000
+MOVES=1000000
+SIMULATIONS=1000
+TIME_REQUESTS=2000
+SEED=1
+BULK_WORLDS=1000
+CSV_FILE=""
+JSON_FILE=""
+ROWS=()
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --sizes) SIZES="$2"; shift ;;
+        --stream-sizes) STREAM_SIZES="$2"; shift ;;
+        --file-rooms) FILE_ROOMS="$2"; shift ;;
+        --moves) MOVES="$2"; shift ;;
+        --simulations) SIMULATIONS="$2"; shift ;;
+        --time-requests) TIME_REQUESTS="$2"; shift ;;
+        --csv) CSV_FILE="$2"; shift ;;
+        --json) JSON_FILE="$2"; shift ;;
+        *) echo "USAGE: $0 [--sizes \"N ...\"] [--stream-sizes \"N ...\"] [--file-rooms N] [--moves N] [--simulations N] [--time-requests N] [--csv FILE] [--json FILE]"; exit 1 ;;
+    esac
+    shift
+done
+
+COMMIT=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+WORK_DIR=$(mktemp -d eganch.bench.XXXXXX)
+
+#
+# NAME: now
+# DESCRIPTION: Prints the current time in seconds with nanoseconds
+#
+now() {
+    date +%s.%N
+}
+
+#
+# NAME: addRow
+# DESCRIPTION: Records one result: benchmark, format, rooms, metric, value, unit
+#
+addRow() {
+    ROWS+=("$COMMIT,$1,$2,$3,$4,$5,$6")
+    echo "$COMMIT,$1,$2,$3,$4,$5,$6"
+}
+
+#
+# NAME: field
+# DESCRIPTION: Prints the number that follows a label in a line of output
+#
+field() {
+    echo "$1" | sed -n "s/.*$2 \([0-9.]*\).*/\1/p"
+}
+
+cp eganch.buildrooms eganch.adventure "$WORK_DIR" || exit 1
+cd "$WORK_DIR" || exit 1
+
+echo "commit,benchmark,format,rooms,metric,value,unit"
+for format in text binary; do
+    for rooms in $SIZES; do
+        start=$(now)
+        ./eganch.buildrooms --rooms "$rooms" --format "$format" --seed "$SEED" || exit 1
+        end=$(now)
+        addRow generate "$format" "$rooms" seconds "$(awk "BEGIN { printf \"%.6f\", $end - $start }")" s
+
+        loadLine=$(./eganch.adventure --load-only) || exit 1
+        addRow load "$format" "$rooms" connections "$(echo "$loadLine" | sed 's/.*(\([0-9]*\) CONNECTIONS).*/\1/')" count
+        addRow load "$format" "$rooms" seconds "$(field "$loadLine" IN)" s
+        addRow load "$format" "$rooms" allocations "$(field "$loadLine" WITH)" count
+
+        movesLine=$(./eganch.adventure --bench-moves "$MOVES") || exit 1
+        addRow moves "$format" "$rooms" moves_per_second "$(echo "$movesLine" | sed 's/.*: \([0-9]*\) MOVES PER SECOND.*/\1/')" 1/s
+        addRow moves "$format" "$rooms" ns_per_move "$(echo "$movesLine" | sed 's/.*, \([0-9.]*\) NS PER MOVE/\1/')" ns
+
+        solverLines=$(./eganch.adventure --bench-solver "$MOVES") || exit 1
+        pathLine=$(echo "$solverLines" | head -1)
+        hintLine=$(echo "$solverLines" | tail -1)
+        addRow solver "$format" "$rooms" search_seconds "$(field "$pathLine" "SEARCH")" s
+        addRow solver "$format" "$rooms" table_seconds "$(field "$pathLine" "TABLE")" s
+        addRow solver "$format" "$rooms" search_hint_us "$(field "$hintLine" "SEARCH")" us
+        addRow solver "$format" "$rooms" table_hint_ns "$(field "$hintLine" "TABLE")" ns
+
+        saveLine=$(./eganch.adventure --bench-save "$MOVES") || exit 1
+        addRow save "$format" "$rooms" save_seconds "$(field "$saveLine" "BYTES) IN")" s
+        addRow save "$format" "$rooms" load_seconds "$(field "$saveLine" "LOAD IN")" s
+        addRow save "$format" "$rooms" bytes "$(echo "$saveLine" | sed 's/.*(\([0-9]*\) BYTES).*/\1/')" B
+
+        while read -r walkLine; do
+            player=$(echo "$walkLine" | sed 's/ .*//' | tr 'A-Z' 'a-z')
+            addRow simulate "$format" "$rooms" "${player}_mean_steps" "$(field "$walkLine" MEAN)" count
+            addRow simulate "$format" "$rooms" "${player}_walks_per_second" "$(field "$walkLine" "UNFINISHED,")" 1/s
+        done < <(./eganch.adventure --simulate "$SIMULATIONS" | tail -n +2)
+
+        ./eganch.buildrooms --prune 0 > /dev/null
+    done
+done
+
+for format in text binary; do
+    bulkLine=$(./eganch.buildrooms --count "$BULK_WORLDS" --format "$format" --seed "$SEED") || exit 1
+    addRow bulk "$format" 7 worlds_per_second "$(field "$bulkLine" "WORLDS PER SECOND:")" 1/s
+    addRow bulk "$format" 7 files_per_second "$(field "$bulkLine" "FILES PER SECOND:")" 1/s
+
+    start=$(now)
+    ./eganch.adventure --load-only > /dev/null || exit 1
+    end=$(now)
+    addRow startup "$format" 7 catalog_seconds "$(awk "BEGIN { printf \"%.6f\", $end - $start }")" s
+
+    rm -f eganch.latest
+    start=$(now)
+    ./eganch.adventure --load-only > /dev/null || exit 1
+    end=$(now)
+    addRow startup "$format" 7 scan_seconds "$(awk "BEGIN { printf \"%.6f\", $end - $start }")" s
+
+    ./eganch.buildrooms --prune 0 > /dev/null
+done
+
+# Only the store phase writes room files, so time that rather than the whole run
+for sync in none 64; do
+    syncOption=$([ "$sync" = none ] || echo "--sync $sync")
+    statsLine=$(./eganch.buildrooms --rooms "$FILE_ROOMS" --seed "$SEED" $syncOption --stats - 2>&1 > /dev/null) || exit 1
+    addRow files "sync_$sync" "$FILE_ROOMS" files_per_second \
+           "$(awk "BEGIN { printf \"%.1f\", $FILE_ROOMS / $(field "$statsLine" '"store":') }")" 1/s
+    ./eganch.buildrooms --prune 0 > /dev/null
+done
+
+for rooms in $STREAM_SIZES; do
+    streamLine=$(./eganch.buildrooms --stream --rooms "$rooms" --format binary --seed "$SEED" --report | tail -1) || exit 1
+    addRow stream binary "$rooms" bytes_per_second "$(field "$streamLine" "BYTES PER SECOND:")" B/s
+    addRow stream binary "$rooms" peak_rss "$(field "$streamLine" "PEAK RSS:")" KB
+    ./eganch.buildrooms --prune 0 > /dev/null
+done
+
+while read -r timeLine; do
+    path=$(echo "$timeLine" | sed 's/:.*//' | tr 'A-Z ' 'a-z_')
+    addRow time "$path" - mean_latency "$(field "$timeLine" MEAN)" us
+    addRow time "$path" - p99_latency "$(field "$timeLine" P99)" us
+    addRow time "$path" - requests_per_second "$(field "$timeLine" THROUGHPUT)" 1/s
+done < <(./eganch.adventure --bench-time "$TIME_REQUESTS" --no-time-file)
+
+cd .. && rm -rf "$WORK_DIR"
+
+if [ -n "$CSV_FILE" ]; then
+    echo "commit,benchmark,format,rooms,metric,value,unit" > "$CSV_FILE"
+    printf "%s\n" "${ROWS[@]}" >> "$CSV_FILE"
+fi
+
+if [ -n "$JSON_FILE" ]; then
+    printf "%s\n" "${ROWS[@]}" | awk -F, '
+        BEGIN { print "[" }
+        {
+            printf "%s  {\"commit\": \"%s\", \"benchmark\": \"%s\", \"format\": \"%s\", \"rooms\": \"%s\", \"metric\": \"%s\", \"value\": %s, \"unit\": \"%s\"}",
+                   (NR > 1 ? ",\n" : ""), $1, $2, $3, $4, $5, $6, $7
+        }
+        END { print "\n]" }' > "$JSON_FILE"
+fi
@@ -1,91 +1,443 @@
 /*
  * PROGRAM NAME: eganch.buildrooms.c
  * DESCRIPTION: This program generates files that will be used by the
- * eganch.adventure program. The files represent seven "rooms" and hold
- * information about their name, rooms they are connected to, and the
- * start and end rooms.
+ * eganch.adventure program. The files represent "rooms" (seven by default,
+ * configurable from the command line) and hold information about their
+ * name, rooms they are connected to, and the start and end rooms. With
+ * --format binary the whole world is instead written to one packed file
+ * laid out as described in eganch.world.h. With --count many worlds are
+ * built at once on a pool of --jobs threads, and --stream writes rooms as
+ * they are finished so worlds too large for memory can be generated. Every
+ * world is built as one connected piece so the end room can always be
+ * reached, and is recorded in the catalog described in eganch.catalog.h.
+ * Each room file is formatted in memory and written with one open, write and
+ * close relative to its directory, and --sync makes the files durable in
+ * batches. --edit changes an existing world in place and records the change
+ * in its journal, described in eganch.journal.h. --embed instead writes the
+ * world as a C header of static const arrays that eganch.adventure can be
+ * built with, so it plays that world without reading any files. An embedded
+ * world is not stored, catalogued or made the latest world.
  * AUTHOR: Chelsea Egan (eganch@oregonstate.edu)
  */
 
+#define _GNU_SOURCE
+
 #include <assert.h>
 #include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "eganch.arena.h"
+#include "eganch.catalog.h"
+#include "eganch.journal.h"
+#include "eganch.random.h"
+#include "eganch.stats.h"
+#include "eganch.world.h"
+
 #define MAX_PATH_LENGTH 4096
 #define MIN_NUM_CONNECTIONS 3
 #define NUM_CONNECTIONS 6
 #define NUM_ROOMS 7
 #define NUM_ROOM_NAMES 10
+#define NUM_NAME_SYLLABLES 75
+#define MAX_NAME_SYLLABLES 6
+#define GENERATED_NAME_SIZE (2 * MAX_NAME_SYLLABLES + 1)
+#define MAX_NUM_ROOMS 10000000
+#define MAX_STREAM_ROOMS 100000000
+#define ROOM_NAME_SIZE (GENERATED_NAME_SIZE + 1)
+#define MAX_CONNECTION_RETRIES 64
+#define MAX_JOBS 256
+#define WORLD_BATCH_SIZE 16
+#define MEMORY_LIMIT_MB 64
+#define STREAM_BUFFER_SIZE (1 << 20)
+#define STREAM_OFFSET_BATCH 65536
+#define ROOM_LINE_SIZE 64
+#define EMBEDDED_VALUES_PER_LINE 12
+#define MAX_SYNC_BATCH 64
+#define NO_PARENT_ROOM UINT32_MAX
 #define TRUE 0
 #define FALSE 1
 
 enum roomTypes {START_ROOM, END_ROOM, MID_ROOM};
-char* directoryName;
+enum generators {LEGACY_GENERATOR, LINEAR_GENERATOR};
+enum formats {TEXT_FORMAT, BINARY_FORMAT};
+enum buildPhases {NAMES_PHASE, ROOMS_PHASE, CONNECT_PHASE, JOIN_PHASE, STORE_PHASE, STREAM_PHASE, NUM_PHASES};
+const char* phaseNames[] = {"names", "rooms", "connect", "join", "store", "stream"};
+
+/* World dimensions, defaulting to the classic seven room layout */
+int numRooms = NUM_ROOMS;
+int minConnections = MIN_NUM_CONNECTIONS;
+int maxConnections = NUM_CONNECTIONS;
+enum generators generator = LINEAR_GENERATOR;
+enum formats format = TEXT_FORMAT;
+int printReport = FALSE;
+
+/* Streaming generation keeps at most memoryLimit bytes of rooms per world */
+int streaming = FALSE;
+long long memoryLimit = (long long)MEMORY_LIMIT_MB << 20;
+
+/* With --sync, files are fsynced syncBatch at a time, 0 leaves them to the kernel */
+int syncBatch = 0;
+
+/* World i is built from stream i of the seed so a seed reproduces every world */
+uint64_t seed;
+int seedGiven = FALSE;
+
+/* Bulk generation, numWorlds worlds built by numJobs threads */
+int numWorlds = 1;
+int numJobs = 0;
+int nextWorld = 0;
+long long filesWritten = 0;
+char latestWorldName[CATALOG_NAME_SIZE];
+
+/* Totals over every finished world, dumped with --stats (see eganch.stats.h) */
+char* statsFileName = NULL;
+int statsEnabled = FALSE;
+uint64_t statsStart;
+struct BuildStats {
+    uint64_t worlds;
+    uint64_t rooms;
+    uint64_t connectionsAdded;
+    uint64_t connectionRetries;
+    uint64_t connectionChecks;
+    uint64_t fallbackScans;
+    uint64_t edgeSwaps;
+    uint64_t componentsJoined;
+    uint64_t filesCreated;
+    uint64_t bytesWritten;
+    uint64_t phaseNs[NUM_PHASES];
+} stats;
+
+/* C header --embed writes the built world to, NULL when not embedding */
+char* embedFileName = NULL;
+
+/* World --edit changes, NULL when building worlds */
+char* editWorldName = NULL;
+
+/* Number of worlds --prune keeps, -1 when not pruning */
+int pruneKeep = -1;
+pthread_mutex_t reportLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Generated names are syllables of one of these consonants and one of these vowels */
+const char nameConsonants[] = "bdfghklmnprstvz";
+const char nameVowels[] = "aeiou";
+
+/* Set of room indexes supporting constant time add, remove and random pick */
+struct RoomSet {
+    int* members;
+    int* positions;
+    int size;
+};
+
+/* Buffered output for the streaming generator, written with pwrite */
+struct StreamOutput {
+    int fd;
+    char* buffer;
+    size_t used;
+    uint64_t position;
+    uint32_t* offsets;
+    int offsetsUsed;
+    uint64_t offsetsPosition;
+    uint64_t bytesWritten;
+};
 
 struct Room {
     char* roomName;
     enum roomTypes type;
-    int connections[NUM_CONNECTIONS];
+    int* connections;
     int index;
     int numConnections;
 };
 
+/* Everything needed to build one world, so worlds can be built side by side */
+struct World {
+    int worldNumber;
+    char* directoryName;
+    int directoryFd;
+    char* worldFileName;
+    char** fileNames;
+    struct Room* rooms;
+
+    /* Room ids are shuffled by (id * nameMultiplier + nameKey) & nameMask and a
+     * shift, repeated until the result is below numRooms, before they are
+     * spelled out as names */
+    uint32_t nameMultiplier;
+    uint32_t nameKey;
+    uint32_t nameMask;
+    int nameShift;
+
+    /* Holds the names, rooms, adjacency and components, sized up front so it never moves */
+    struct Arena arena;
+
+    /* One room file's text, and with --sync the written files not yet synced */
+    char* roomText;
+    int* unsyncedFiles;
+    int numUnsyncedFiles;
+
+    /* Adjacency for every room, maxConnections slots per room */
+    int* adjacency;
+    int numConnectedRooms;
+
+    struct RandomStream random;
+    struct RoomSet underMinimumRooms;
+    struct RoomSet openRooms;
+
+    /* Generation counters reported with --report */
+    long long connectionsAdded;
+    long long connectionRetries;
+    long long fallbackScans;
+    long long edgeSwaps;
+    long long componentsJoined;
+    long long connectionChecks;
+
+    /* Only kept with --stats */
+    long long filesCreated;
+    long long bytesWritten;
+    uint64_t phaseNs[NUM_PHASES];
+    uint64_t phaseStart;
+
+    /* Union-find over the rooms, kept up to date as connections are added */
+    int* componentParents;
+    int* componentSizes;
+    int numComponents;
+    int componentsStale;
+
+    /* Streaming generator window, room id lives in slot id % windowSize */
+    int windowSize;
+    uint32_t* windowIds;
+    int* windowDegrees;
+    uint32_t* windowParents;
+    uint32_t* windowConnections;
+    uint32_t oldestRoom;
+    uint32_t newestRoom;
+    uint32_t startRoom;
+    uint32_t endRoom;
+    uint32_t connectionsWritten;
+    uint64_t namesSize;
+    struct StreamOutput output;
+    double streamSeconds;
+};
+
 /*
- * NAME: makeDirectory
+ * NAME: getWorldArenaSize
  * PARAMS: none
+ * RETURN: Number of bytes a world's arena needs
+ * DESCRIPTION: Adds up everything buildWorld allocates from the arena, with
+ * room for each block's alignment. Streamed worlds only keep the shuffled
+ * names of small worlds.
+ */
+size_t getWorldArenaSize() {
+    int numNames = (numRooms > NUM_ROOM_NAMES) ? numRooms : NUM_ROOM_NAMES;
+    size_t size = (size_t)numNames * (sizeof(char*) + ROOM_NAME_SIZE) + 2 * ARENA_ALIGNMENT;
+
+    if (streaming == FALSE) {
+        size += (size_t)numRooms * (sizeof(struct Room) + maxConnections * sizeof(int) + 2 * sizeof(int))
+                + 4 * ARENA_ALIGNMENT;
+    }
+    if (format == TEXT_FORMAT) {
+        size += ((size_t)maxConnections + 2) * ROOM_LINE_SIZE + MAX_SYNC_BATCH * sizeof(int) + 2 * ARENA_ALIGNMENT;
+    }
+    return size;
+}
+
+/*
+ * NAME: allocateWorldBlock
+ * PARAMS: Pointer to the world and number of bytes
+ * RETURN: Pointer to the bytes
+ * DESCRIPTION: Takes the next block of the world's arena
+ */
+void* allocateWorldBlock(struct World* world, size_t size) {
+    size_t offset = allocateArena(&world->arena, size, ARENA_ALIGNMENT);
+
+    /* The arena was sized by getWorldArenaSize, so the block never moves */
+    assert(world->arena.allocations == 1);
+    return getArenaPointer(&world->arena, offset);
+}
+
+/*
+ * NAME: makeDirectory
+ * PARAMS: Pointer to the world
  * RETURN: void
- * DESCRIPTION: Creates directory to hold room files
+ * DESCRIPTION: Creates directory to hold room files and opens it, so room
+ * files are created relative to it without building their paths. When
+ * building more than one world the world number is added to the name. With
+ * --embed the world is only named, since it is not written out.
  */
-void makeDirectory() {
+void makeDirectory(struct World* world) {
     int pid = getpid();
     char* mypid = malloc(21);
 
     sprintf(mypid, "%d", pid);
-    directoryName = malloc(35);
-    strcpy(directoryName, "eganch.rooms.");
-    strcat(directoryName, mypid);
+    world->directoryName = malloc(48);
+    strcpy(world->directoryName, "eganch.rooms.");
+    strcat(world->directoryName, mypid);
+    if (numWorlds > 1) {
+        sprintf(world->directoryName + strlen(world->directoryName), ".%d", world->worldNumber);
+    }
+    free(mypid);
+    if (embedFileName != NULL) {
+        return;
+    }
 
-    int result = mkdir(directoryName, 0755);
+    int result = mkdir(world->directoryName, 0755);
     assert(result == TRUE);
+    world->directoryFd = open(world->directoryName, O_RDONLY | O_DIRECTORY);
+    assert(world->directoryFd >= 0);
+}
 
-    free(mypid);
+/*
+ * NAME: makeWorldFileName
+ * PARAMS: Pointer to the world
+ * RETURN: void
+ * DESCRIPTION: Creates the name of the packed world file
+ */
+void makeWorldFileName(struct World* world) {
+    world->worldFileName = malloc(64);
+    if (numWorlds > 1) {
+        sprintf(world->worldFileName, "eganch.rooms.%d.%d%s", getpid(), world->worldNumber, WORLD_FILE_SUFFIX);
+    } else {
+        sprintf(world->worldFileName, "eganch.rooms.%d%s", getpid(), WORLD_FILE_SUFFIX);
+    }
+}
+
+/*
+ * NAME: initRoomNames
+ * PARAMS: Pointer to the world
+ * RETURN: void
+ * DESCRIPTION: Picks the shuffle that generated names are made with, so each
+ * world's names come out in a different order
+ */
+void initRoomNames(struct World* world) {
+    int bits = 1;
+    while (bits < 32 && (1ULL << bits) < (uint64_t)numRooms) {
+        bits++;
+    }
+
+    world->nameMask = (uint32_t)((1ULL << bits) - 1);
+    world->nameShift = bits / 2 + 1;
+    world->nameMultiplier = (uint32_t)nextRandom(&world->random) | 1;
+    world->nameKey = (uint32_t)nextRandom(&world->random);
+}
+
+/*
+ * NAME: makeRoomName
+ * PARAMS: Pointer to the world, the room id and pointer to a GENERATED_NAME_SIZE buffer
+ * RETURN: Length of the name
+ * DESCRIPTION: Spells out a name for a room of a large world. The room id is
+ * shuffled by a permutation of 0 .. numRooms - 1, then written in bijective
+ * base NUM_NAME_SYLLABLES with one consonant and vowel syllable per digit,
+ * starting at two syllables. Both steps are one to one, so every room gets a
+ * different name with no checking, and names are as short as the world
+ * allows: "Kobe", "Tamu", ... four letters up to 5,625 rooms, six up to
+ * 427,500 and eight up to 32 million. Names are capitalised, so they never
+ * clash with the player's commands.
+ */
+int makeRoomName(struct World* world, uint32_t roomId, char* buffer) {
+    char syllables[GENERATED_NAME_SIZE];
+    int length = 0;
+
+    /* Walk the cycle of a permutation of 0 .. nameMask until it is back in range */
+    uint32_t shuffled = roomId;
+    do {
+        shuffled = (shuffled * world->nameMultiplier + world->nameKey) & world->nameMask;
+        shuffled ^= shuffled >> world->nameShift;
+    } while (shuffled >= (uint32_t)numRooms);
+
+    uint64_t value = (uint64_t)shuffled + 1 + NUM_NAME_SYLLABLES;
+    while (value > 0) {
+        value--;
+        int syllable = value % NUM_NAME_SYLLABLES;
+        syllables[length++] = nameVowels[syllable % 5];
+        syllables[length++] = nameConsonants[syllable / 5];
+        value /= NUM_NAME_SYLLABLES;
+    }
+
+    int i;
+    for (i = 0; i < length; i++) {
+        buffer[i] = syllables[length - 1 - i];
+    }
+    buffer[0] -= 'a' - 'A';
+    buffer[length] = '\0';
+    return length;
+}
+
+/*
+ * NAME: getNameLength
+ * PARAMS: Pointer to a name from randomizeFileNames
+ * RETURN: Length of the name
+ * DESCRIPTION: Reads the length stored in front of the name
+ */
+size_t getNameLength(const char* name) {
+    return (unsigned char)name[-1];
+}
+
+/*
+ * NAME: addRoomName
+ * PARAMS: Pointer to the end of the name table, pointer to the name and its length
+ * RETURN: Pointer to the end of the name table after the name
+ * DESCRIPTION: Adds a name to the table as a length byte, the name and a NUL
+ */
+char* addRoomName(char* table, const char* name, size_t length) {
+    assert(length <= UINT8_MAX);
+    *table = (char)length;
+    memcpy(table + 1, name, length + 1);
+    return table + length + 2;
 }
 
 /*
  * NAME: randomizeFileNames
- * PARAMS: none
+ * PARAMS: Pointer to the world
  * RETURN: Array of pointers to strings holding room names
  * DESCRIPTION: Creates an array filled with potential room names and
- * randomizes the order
+ * randomizes the order. Worlds larger than the list of potential names
+ * use generated names (see makeRoomName) instead. Every name is stored
+ * once, in one table in the world's arena with its length in the byte
+ * before it, so writing the names never has to measure them.
  */
-char** randomizeFileNames() {
-    const int NAME_LENGTH = 9;
-    char** roomNames = malloc(NUM_ROOM_NAMES * sizeof(char*));
+char** randomizeFileNames(struct World* world) {
+    const char* classicNames[NUM_ROOM_NAMES] = {"Reptiles", "Cats", "Dogs", "Monkeys", "Birds",
+                                                "Insects", "Rodents", "Turtles", "Octopi", "Humans"};
+
+    if (numRooms > NUM_ROOM_NAMES) {
+        char** roomNames = allocateWorldBlock(world, numRooms * sizeof(char*));
+        char* table = allocateWorldBlock(world, (size_t)numRooms * ROOM_NAME_SIZE);
+        char name[GENERATED_NAME_SIZE];
+
+        initRoomNames(world);
+        int i;
+        for (i = 0; i < numRooms; i++) {
+            roomNames[i] = table + 1;
+            table = addRoomName(table, name, makeRoomName(world, i, name));
+        }
+
+        return roomNames;
+    }
+
+    char** roomNames = allocateWorldBlock(world, NUM_ROOM_NAMES * sizeof(char*));
+    char* table = allocateWorldBlock(world, NUM_ROOM_NAMES * ROOM_NAME_SIZE);
 
     int i;
     for (i = 0; i < NUM_ROOM_NAMES; i++) {
-        roomNames[i] = malloc(NAME_LENGTH * sizeof(char));
+        roomNames[i] = table + 1;
+        table = addRoomName(table, classicNames[i], strlen(classicNames[i]));
     }
 
-    strncpy(roomNames[0], "Reptiles", NAME_LENGTH);
-    strncpy(roomNames[1], "Cats", NAME_LENGTH);
-    strncpy(roomNames[2], "Dogs", NAME_LENGTH);
-    strncpy(roomNames[3], "Monkeys", NAME_LENGTH);
-    strncpy(roomNames[4], "Birds", NAME_LENGTH);
-    strncpy(roomNames[5], "Insects", NAME_LENGTH);
-    strncpy(roomNames[6], "Rodents", NAME_LENGTH);
-    strncpy(roomNames[7], "Turtles", NAME_LENGTH);
-    strncpy(roomNames[8], "Octopi", NAME_LENGTH);
-    strncpy(roomNames[9], "Humans", NAME_LENGTH);
-
     for (i = 0; i < NUM_ROOM_NAMES - 1; i++) {
-        int c = rand() / (RAND_MAX/(NUM_ROOM_NAMES - i) + 1);
+        int c = getRandomBelow(&world->random, NUM_ROOM_NAMES - i);
         char* t = roomNames[i];
         roomNames[i] = roomNames[i + c];
         roomNames[i + c] = t;
@@ -96,35 +448,37 @@ char** randomizeFileNames() {
 
 /*
  * NAME: setRoomInfo
- * PARAMS: Array of pointers to strings holding room names
+ * PARAMS: Pointer to the world and array of pointers to strings holding room names
  * RETURN: Array of structs containing info about the rooms
  * DESCRIPTION: Creates an array filled with structs holding room
  * information.
  */
-struct Room* setRoomInfo(char** fileNames) {
+struct Room* setRoomInfo(struct World* world, char** fileNames) {
     int endRoomIndex,
         isDuplicate = TRUE,
         startRoomIndex;
 
-    struct Room* rooms = malloc(NUM_ROOMS * sizeof(struct Room));
+    struct Room* rooms = allocateWorldBlock(world, numRooms * sizeof(struct Room));
+    world->adjacency = allocateWorldBlock(world, (size_t)numRooms * maxConnections * sizeof(int));
 
     int i;
-    for (i = 0; i < NUM_ROOMS; i++) {
+    for (i = 0; i < numRooms; i++) {
         rooms[i].roomName = fileNames[i];
         rooms[i].type = MID_ROOM;
         rooms[i].index = i;
         rooms[i].numConnections = 0;
+        rooms[i].connections = world->adjacency + (size_t)i * maxConnections;
 
         int j;
-        for (j = 0; j < NUM_CONNECTIONS; j++) {
+        for (j = 0; j < maxConnections; j++) {
             rooms[i].connections[j] = -1;
         }
     }
 
-    startRoomIndex = rand() % NUM_ROOMS;
+    startRoomIndex = getRandomBelow(&world->random, numRooms);
 
     while (isDuplicate == TRUE) {
-        endRoomIndex = rand() % NUM_ROOMS;
+        endRoomIndex = getRandomBelow(&world->random, numRooms);
         if (endRoomIndex != startRoomIndex) {
             isDuplicate = FALSE;
         }
@@ -137,75 +491,107 @@ struct Room* setRoomInfo(char** fileNames) {
 }
 
 /*
- * NAME: createFilePath
- * PARAMS: Pointer to a filename and pointer to a file path
+ * NAME: syncRoomFiles
+ * PARAMS: Pointer to the world
  * RETURN: void
- * DESCRIPTION: Constructs the file path
+ * DESCRIPTION: Waits for the written room files to reach the disk, closes
+ * them, then syncs the directory so their names are durable too. Their
+ * writeback was started as each was written, so most of it is already done.
  */
-void createFilePath(char* fileName, char* pathFile) {
-    memset(pathFile, '\0', MAX_PATH_LENGTH);
-    strcpy(pathFile, directoryName);
-    strcat(pathFile, "/");
-    strcat(pathFile, fileName);
+void syncRoomFiles(struct World* world) {
+    int i;
+    for (i = 0; i < world->numUnsyncedFiles; i++) {
+        if (fsync(world->unsyncedFiles[i]) != 0 || close(world->unsyncedFiles[i]) != 0) {
+            printf("ERROR: Failed to sync room files in %s. Exiting.\n", world->directoryName);
+            exit(1);
+        }
+    }
+    world->numUnsyncedFiles = 0;
+
+    if (fsync(world->directoryFd) != 0) {
+        printf("ERROR: Failed to sync room directory %s. Exiting.\n", world->directoryName);
+        exit(1);
+    }
 }
 
 /*
- * NAME: createFiles
- * PARAMS: Pointer to an array of filenames
+ * NAME: writeRoomFile
+ * PARAMS: Pointer to the world, pointer to the room name, pointer to the
+ * file's text and its length
  * RETURN: void
- * DESCRIPTION: For each room, creates a file in the room directory
+ * DESCRIPTION: Creates a room file in the world's directory and writes all of
+ * it at once. With --sync the file is kept open and its writeback started,
+ * and every syncBatch files are synced together.
  */
-void createFiles(char** fileNames) {
-    char* pathFile = malloc(MAX_PATH_LENGTH * sizeof(char));
+void writeRoomFile(struct World* world, const char* roomName, const char* text, size_t length) {
+    int fileDescriptor = openat(world->directoryFd, roomName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fileDescriptor < 0 || write(fileDescriptor, text, length) != (ssize_t)length) {
+        printf("ERROR: Failed to write room file %s/%s. Exiting.\n", world->directoryName, roomName);
+        exit(1);
+    }
+    world->filesCreated++;
+    world->bytesWritten += length;
 
-    int i;
-    for (i = 0; i < NUM_ROOMS; i++) {
-        createFilePath(fileNames[i], pathFile);
-        int fileDescriptor = open(pathFile, O_CREAT, 0644);
+    if (syncBatch == 0) {
         close(fileDescriptor);
+        return;
     }
 
-    free(pathFile);
+    sync_file_range(fileDescriptor, 0, 0, SYNC_FILE_RANGE_WRITE);
+    world->unsyncedFiles[world->numUnsyncedFiles++] = fileDescriptor;
+    if (world->numUnsyncedFiles == syncBatch) {
+        syncRoomFiles(world);
+    }
 }
 
 /*
- * NAME: getNumConnectedRooms
- * PARAMS: Pointer to the array of room structs
- * RETURN: Number of rooms with 3+ connections
- * DESCRIPTION: Returns the number of rooms that have 3-6 outbound connections
+ * NAME: finishRoomFiles
+ * PARAMS: Pointer to the world
+ * RETURN: void
+ * DESCRIPTION: Once every room is written, syncs the last partial batch and
+ * closes the world's directory
  */
-int getNumConnectedRooms(struct Room *rooms) {
-    int i,
-        connected = 0;
-
-    for (i = 0; i < NUM_ROOMS; i++) {
-        if (rooms[i].numConnections >= MIN_NUM_CONNECTIONS) {
-            connected++;
-        }
+void finishRoomFiles(struct World* world) {
+    if (syncBatch > 0) {
+        syncRoomFiles(world);
     }
-    return connected;
+    close(world->directoryFd);
+}
+
+/*
+ * NAME: getNumConnectedRooms
+ * PARAMS: Pointer to the world
+ * RETURN: Number of rooms with at least the minimum number of connections
+ * DESCRIPTION: Returns the number of rooms that have between the minimum and
+ * maximum number of outbound connections. The count is kept up to date by
+ * connectRoom so this does not need to scan every room.
+ */
+int getNumConnectedRooms(struct World* world) {
+    return world->numConnectedRooms;
 }
 
 /*
  * NAME: getRandomRoom
- * PARAMS: Pointer to an array of room structs
+ * PARAMS: Pointer to the world
  * RETURN: Pointer to a single room struct
  * DESCRIPTION: Returns a random Room, does NOT validate if connection can be added
  */
-struct Room* getRandomRoom(struct Room *rooms) {
-    int roomIndex = rand() % NUM_ROOMS;
-    return &rooms[roomIndex];
+struct Room* getRandomRoom(struct World* world) {
+    int roomIndex = getRandomBelow(&world->random, numRooms);
+    return &world->rooms[roomIndex];
 }
 
 /*
  * NAME: connectionAlreadyExists
- * PARAMS: Two pointers to room structs
+ * PARAMS: Pointer to the world and two pointers to room structs
  * RETURN: Int indicating connection
  * DESCRIPTION: Returns 0 if a connection from Room x to Room y already exists, 1 otherwise
  */
-int connectionAlreadyExists(struct Room *x, struct Room *y) {
+int connectionAlreadyExists(struct World* world, struct Room *x, struct Room *y) {
+    world->connectionChecks++;
+
     int i;
-    for (i = 0; i < NUM_CONNECTIONS; i++) {
+    for (i = 0; i < x->numConnections; i++) {
         if (x->connections[i] == y->index) {
             return TRUE;
         }
@@ -215,34 +601,111 @@ int connectionAlreadyExists(struct Room *x, struct Room *y) {
 }
 
 /*
- * NAME: connectRoom
- * PARAMS: Two pointers to room structs
+ * NAME: initComponents
+ * PARAMS: Pointer to the world
  * RETURN: void
- * DESCRIPTION: Connects Rooms x and y together, does not check if this connection is valid
+ * DESCRIPTION: Starts the union-find with every room in a component of its own
  */
-void connectRoom(struct Room* x, struct Room* y) {
-    int i,
-        xConnected = FALSE,
-        yConnected = FALSE;
+void initComponents(struct World* world) {
+    world->componentParents = allocateWorldBlock(world, (size_t)numRooms * sizeof(int));
+    world->componentSizes = allocateWorldBlock(world, (size_t)numRooms * sizeof(int));
 
-    for (i = 0; i < NUM_CONNECTIONS; i++) {
-        if (xConnected == FALSE && x->connections[i] == -1) {
-            xConnected = TRUE;
-            x->connections[i] = y->index;
-            x->numConnections++;
-        }
-        if (yConnected == FALSE && y->connections[i] == -1) {
-            yConnected = TRUE;
-            y->connections[i] = x->index;
-            y->numConnections++;
-        }
+    int i;
+    for (i = 0; i < numRooms; i++) {
+        world->componentParents[i] = i;
+        world->componentSizes[i] = 1;
+    }
+    world->numComponents = numRooms;
+    world->componentsStale = FALSE;
+}
 
-        if (xConnected == TRUE && yConnected == TRUE) {
-            break;
+/*
+ * NAME: findComponent
+ * PARAMS: Pointer to the world and int holding the room index
+ * RETURN: Int holding the index of the room that stands for the component
+ * DESCRIPTION: Union-find lookup, halving the path on the way up so repeated
+ * lookups stay close to constant time
+ */
+int findComponent(struct World* world, int roomIndex) {
+    int* parents = world->componentParents;
+
+    while (parents[roomIndex] != roomIndex) {
+        parents[roomIndex] = parents[parents[roomIndex]];
+        roomIndex = parents[roomIndex];
+    }
+    return roomIndex;
+}
+
+/*
+ * NAME: joinComponents
+ * PARAMS: Pointer to the world and two ints holding room indexes
+ * RETURN: void
+ * DESCRIPTION: Merges the components of the two rooms, the smaller one under the larger
+ */
+void joinComponents(struct World* world, int x, int y) {
+    x = findComponent(world, x);
+    y = findComponent(world, y);
+    if (x == y) {
+        return;
+    }
+
+    if (world->componentSizes[x] < world->componentSizes[y]) {
+        int swap = x;
+        x = y;
+        y = swap;
+    }
+    world->componentParents[y] = x;
+    world->componentSizes[x] += world->componentSizes[y];
+    world->numComponents--;
+}
+
+/*
+ * NAME: rebuildComponents
+ * PARAMS: Pointer to the world
+ * RETURN: void
+ * DESCRIPTION: A union-find cannot split a component when a connection is
+ * removed, so after edge swaps the components are worked out again from
+ * the final connections
+ */
+void rebuildComponents(struct World* world) {
+    struct Room* rooms = world->rooms;
+
+    int i;
+    for (i = 0; i < numRooms; i++) {
+        world->componentParents[i] = i;
+        world->componentSizes[i] = 1;
+    }
+    world->numComponents = numRooms;
+
+    for (i = 0; i < numRooms; i++) {
+        int j;
+        for (j = 0; j < rooms[i].numConnections; j++) {
+            joinComponents(world, i, rooms[i].connections[j]);
         }
     }
+    world->componentsStale = FALSE;
+}
+
+/*
+ * NAME: connectRoom
+ * PARAMS: Pointer to the world and two pointers to room structs
+ * RETURN: void
+ * DESCRIPTION: Connects Rooms x and y together and merges their components,
+ * does not check if this connection is valid
+ */
+void connectRoom(struct World* world, struct Room* x, struct Room* y) {
+    assert(x->numConnections < maxConnections && y->numConnections < maxConnections);
 
-    assert(xConnected == TRUE && yConnected == TRUE);
+    x->connections[x->numConnections++] = y->index;
+    y->connections[y->numConnections++] = x->index;
+    joinComponents(world, x->index, y->index);
+
+    if (x->numConnections == minConnections) {
+        world->numConnectedRooms++;
+    }
+    if (y->numConnections == minConnections) {
+        world->numConnectedRooms++;
+    }
 }
 
 /*
@@ -257,89 +720,2554 @@ int isSameRoom(struct Room* x, struct Room* y) {
 
 /*
  * NAME: addRandomConnection
- * PARAMS: Pointer to array of room structs
+ * PARAMS: Pointer to the world
  * RETURN: void
  * DESCRIPTION: Adds a random, valid outbound connection from a Room to another Room
  */
-void addRandomConnection(struct Room* rooms) {
+void addRandomConnection(struct World* world) {
     struct Room* roomA;
     struct Room* roomB;
 
     while (FALSE) {
-        roomA = getRandomRoom(rooms);
+        roomA = getRandomRoom(world);
 
-        if (roomA->numConnections < NUM_CONNECTIONS) {
+        if (roomA->numConnections < maxConnections) {
             break;
         }
     }
 
     do {
-        roomB = getRandomRoom(rooms);
-    } while(roomB->numConnections >= NUM_CONNECTIONS
+        roomB = getRandomRoom(world);
+        world->connectionRetries++;
+    } while(roomB->numConnections >= maxConnections
             || isSameRoom(roomA, roomB) == TRUE
-            || connectionAlreadyExists(roomA, roomB) == TRUE);
+            || connectionAlreadyExists(world, roomA, roomB) == TRUE);
 
-    connectRoom(roomA, roomB);
+    /* The successful draw was not a retry */
+    world->connectionRetries--;
+    world->connectionsAdded++;
+    connectRoom(world, roomA, roomB);
 }
 
 /*
- * NAME: storeInfoToFiles
- * PARAMS: Pointer to array of room structs
+ * NAME: initRoomSet
+ * PARAMS: Pointer to the set to fill
  * RETURN: void
- * DESCRIPTION: Print the info from the room structs into the files
-] */
-void storeInfoToFiles(struct Room* rooms) {
-    const char * roomTypesLabel[] = {"START_ROOM", "END_ROOM", "MID_ROOM"};
-    char* pathFile = malloc(MAX_PATH_LENGTH * sizeof(char));
-    FILE* filePtr;
+ * DESCRIPTION: Allocates a set and fills it with every room index
+ */
+void initRoomSet(struct RoomSet* set) {
+    set->members = malloc((size_t)numRooms * sizeof(int));
+    set->positions = malloc((size_t)numRooms * sizeof(int));
+    assert(set->members != NULL && set->positions != NULL);
 
     int i;
-    for (i = 0; i < NUM_ROOMS; i++) {
-        createFilePath(rooms[i].roomName, pathFile);
+    for (i = 0; i < numRooms; i++) {
+        set->members[i] = i;
+        set->positions[i] = i;
+    }
+    set->size = numRooms;
+}
 
-        filePtr = fopen(pathFile, "w");
-        assert(filePtr != NULL);
+/*
+ * NAME: initEmptyRoomSet
+ * PARAMS: Pointer to the set to fill and int holding the largest index it can hold
+ * RETURN: void
+ * DESCRIPTION: Allocates an empty set
+ */
+void initEmptyRoomSet(struct RoomSet* set, int capacity) {
+    set->members = calloc(capacity, sizeof(int));
+    set->positions = calloc(capacity, sizeof(int));
+    assert(set->members != NULL && set->positions != NULL);
+    set->size = 0;
+}
 
-        fprintf(filePtr, "ROOM NAME: %s\n", rooms[i].roomName);
+/*
+ * NAME: isInRoomSet
+ * PARAMS: Pointer to the set and int holding the room index
+ * RETURN: Int indicating membership
+ * DESCRIPTION: Returns 0 if the room is in the set, 1 otherwise
+ */
+int isInRoomSet(struct RoomSet* set, int roomIndex) {
+    int position = set->positions[roomIndex];
+    return (position < set->size && set->members[position] == roomIndex) ? TRUE : FALSE;
+}
 
-        int j;
-        for (j = 0; j < rooms[i].numConnections; j++) {
-            fprintf(filePtr, "CONNECTION %d: %s\n", j + 1, rooms[rooms[i].connections[j]].roomName);
-        }
+/*
+ * NAME: addToRoomSet
+ * PARAMS: Pointer to the set and int holding the room index
+ * RETURN: void
+ * DESCRIPTION: Adds a room to the end of the set if it is not already a member
+ */
+void addToRoomSet(struct RoomSet* set, int roomIndex) {
+    if (isInRoomSet(set, roomIndex) == TRUE) {
+        return;
+    }
+    set->members[set->size] = roomIndex;
+    set->positions[roomIndex] = set->size;
+    set->size++;
+}
+
+/*
+ * NAME: removeFromRoomSet
+ * PARAMS: Pointer to the set and int holding the room index
+ * RETURN: void
+ * DESCRIPTION: Removes a room from the set by moving the last member into its slot
+ */
+void removeFromRoomSet(struct RoomSet* set, int roomIndex) {
+    if (isInRoomSet(set, roomIndex) == FALSE) {
+        return;
+    }
+
+    int position = set->positions[roomIndex];
+    int last = set->members[set->size - 1];
+
+    set->members[position] = last;
+    set->positions[last] = position;
+    set->size--;
+}
+
+/*
+ * NAME: freeRoomSet
+ * PARAMS: Pointer to the set
+ * RETURN: void
+ * DESCRIPTION: Frees the memory held by a set
+ */
+void freeRoomSet(struct RoomSet* set) {
+    free(set->members);
+    free(set->positions);
+}
+
+/*
+ * NAME: isValidConnection
+ * PARAMS: Pointer to the world and two pointers to room structs
+ * RETURN: Int indicating if the connection can be added
+ * DESCRIPTION: Returns 0 if Rooms x and y are different, not yet connected and
+ * y has room for another connection, 1 otherwise. x is assumed to have room.
+ */
+int isValidConnection(struct World* world, struct Room* x, struct Room* y) {
+    if (y->numConnections >= maxConnections
+        || isSameRoom(x, y) == TRUE
+        || connectionAlreadyExists(world, x, y) == TRUE) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * NAME: updateRoomSets
+ * PARAMS: Pointer to the world and pointer to a room struct
+ * RETURN: void
+ * DESCRIPTION: Puts a room in or takes it out of the generator sets to match
+ * its current number of connections
+ */
+void updateRoomSets(struct World* world, struct Room* room) {
+    if (room->numConnections < minConnections) {
+        addToRoomSet(&world->underMinimumRooms, room->index);
+    } else {
+        removeFromRoomSet(&world->underMinimumRooms, room->index);
+    }
+
+    if (room->numConnections < maxConnections) {
+        addToRoomSet(&world->openRooms, room->index);
+    } else {
+        removeFromRoomSet(&world->openRooms, room->index);
+    }
+}
+
+/*
+ * NAME: connectAndUpdateSets
+ * PARAMS: Pointer to the world and two pointers to room structs
+ * RETURN: void
+ * DESCRIPTION: Connects Rooms x and y and moves them out of the generator sets
+ * once they reach the minimum or maximum number of connections
+ */
+void connectAndUpdateSets(struct World* world, struct Room* x, struct Room* y) {
+    connectRoom(world, x, y);
+    world->connectionsAdded++;
+
+    updateRoomSets(world, x);
+    updateRoomSets(world, y);
+}
 
-        fprintf(filePtr, "ROOM TYPE: %s\n", roomTypesLabel[rooms[i].type]);
+/*
+ * NAME: removeConnection
+ * PARAMS: Pointer to the world, pointer to a room struct and int holding the index of the connected room
+ * RETURN: void
+ * DESCRIPTION: Removes one side of a connection by moving the last connection into its slot
+ */
+void removeConnection(struct World* world, struct Room* x, int roomIndex) {
+    int i;
+    for (i = 0; i < x->numConnections; i++) {
+        if (x->connections[i] == roomIndex) {
+            x->connections[i] = x->connections[x->numConnections - 1];
+            x->connections[x->numConnections - 1] = -1;
+            x->numConnections--;
+            break;
+        }
+    }
 
-        fclose(filePtr);
+    if (x->numConnections == minConnections - 1) {
+        world->numConnectedRooms--;
     }
+    world->componentsStale = TRUE;
+}
+
+/*
+ * NAME: disconnectAndUpdateSets
+ * PARAMS: Pointer to the world and two pointers to room structs
+ * RETURN: void
+ * DESCRIPTION: Removes the connection between Rooms x and y and returns them
+ * to the generator sets if they drop below the minimum or maximum
+ */
+void disconnectAndUpdateSets(struct World* world, struct Room* x, struct Room* y) {
+    removeConnection(world, x, y->index);
+    removeConnection(world, y, x->index);
+    world->connectionsAdded--;
 
-    free(pathFile);
+    updateRoomSets(world, x);
+    updateRoomSets(world, y);
 }
 
-int main() {
-    time_t t;
-    srand((unsigned) time(&t));
+/*
+ * NAME: swapInConnection
+ * PARAMS: Pointer to the world and pointer to the room needing a connection
+ * RETURN: Int indicating if a swap was made
+ * DESCRIPTION: When no open room can take a connection from Room a, finds an
+ * existing connection u-v where neither end is connected to a, removes it and
+ * connects a to u (and to v if a still has space). Returns 0 on success, 1 if
+ * no such connection exists.
+ */
+int swapInConnection(struct World* world, struct Room* roomA) {
+    struct Room* rooms = world->rooms;
+    int start = getRandomBelow(&world->random, numRooms);
 
-    makeDirectory();
+    int i;
+    for (i = 0; i < numRooms; i++) {
+        struct Room* roomU = &rooms[(start + i) % numRooms];
 
-    char** fileNames = randomizeFileNames();
+        if (isSameRoom(roomA, roomU) == TRUE || connectionAlreadyExists(world, roomA, roomU) == TRUE) {
+            continue;
+        }
 
-    createFiles(fileNames);
+        int j;
+        for (j = 0; j < roomU->numConnections; j++) {
+            struct Room* roomV = &rooms[roomU->connections[j]];
 
-    struct Room* rooms = setRoomInfo(fileNames);
+            if (isSameRoom(roomA, roomV) == TRUE || connectionAlreadyExists(world, roomA, roomV) == TRUE) {
+                continue;
+            }
 
-    while (getNumConnectedRooms(rooms) != NUM_ROOMS) {
-        addRandomConnection(rooms);
+            world->edgeSwaps++;
+            disconnectAndUpdateSets(world, roomU, roomV);
+            connectAndUpdateSets(world, roomA, roomU);
+            if (roomA->numConnections < maxConnections) {
+                connectAndUpdateSets(world, roomA, roomV);
+            }
+            return TRUE;
+        }
     }
 
-    storeInfoToFiles(rooms);
+    return FALSE;
+}
+
+/*
+ * NAME: findConnectionByScan
+ * PARAMS: Pointer to the world and pointer to the room needing a connection
+ * RETURN: Pointer to a room that can be connected, NULL if there is none
+ * DESCRIPTION: Checks every open room in turn. Only used once random draws keep
+ * failing, which happens when almost every room is full.
+ */
+struct Room* findConnectionByScan(struct World* world, struct Room* roomA) {
+    struct Room* rooms = world->rooms;
+    world->fallbackScans++;
 
     int i;
-    for (i = 0; i < NUM_ROOM_NAMES; i++) {
-        free(fileNames[i]);
+    for (i = 0; i < world->openRooms.size; i++) {
+        struct Room* roomB = &rooms[world->openRooms.members[i]];
+        if (isValidConnection(world, roomA, roomB) == TRUE) {
+            return roomB;
+        }
     }
-    free(fileNames);
-    free(rooms);
-    free(directoryName);
+    return NULL;
+}
 
-    return 0;
-}
\ No newline at end of file
+/*
+ * NAME: addLinearConnections
+ * PARAMS: Pointer to the world
+ * RETURN: void
+ * DESCRIPTION: Connects rooms until every room has the minimum number of
+ * connections. Each step takes a room that is still under the minimum and
+ * pairs it with a random room that still has space, so the work is
+ * proportional to rooms + connections rather than spinning on full rooms.
+ * If no open room fits, an existing connection is swapped to make space.
+ */
+void addLinearConnections(struct World* world) {
+    struct Room* rooms = world->rooms;
+
+    initRoomSet(&world->underMinimumRooms);
+    initRoomSet(&world->openRooms);
+
+    while (world->underMinimumRooms.size > 0) {
+        struct Room* roomA = &rooms[world->underMinimumRooms.members[getRandomBelow(&world->random, world->underMinimumRooms.size)]];
+        struct Room* roomB = NULL;
+
+        int attempt;
+        for (attempt = 0; attempt < MAX_CONNECTION_RETRIES; attempt++) {
+            struct Room* candidate = &rooms[world->openRooms.members[getRandomBelow(&world->random, world->openRooms.size)]];
+            if (isValidConnection(world, roomA, candidate) == TRUE) {
+                roomB = candidate;
+                break;
+            }
+            world->connectionRetries++;
+        }
+
+        if (roomB == NULL) {
+            roomB = findConnectionByScan(world, roomA);
+        }
+
+        if (roomB != NULL) {
+            connectAndUpdateSets(world, roomA, roomB);
+        } else if (world->edgeSwaps >= numRooms || swapInConnection(world, roomA) == FALSE) {
+            printf("ERROR: Cannot give room %s %d connections with at most %d per room. Exiting.\n",
+                   roomA->roomName, minConnections, maxConnections);
+            exit(1);
+        }
+    }
+
+    freeRoomSet(&world->underMinimumRooms);
+    freeRoomSet(&world->openRooms);
+}
+
+/*
+ * NAME: findCycleConnection
+ * PARAMS: Pointer to the world, int holding a room in the component, pointer
+ * to a breadth first search queue, pointer to the per room search marks, the
+ * mark for this search and pointers to ints for the connection found
+ * RETURN: Int indicating if a connection was found
+ * DESCRIPTION: Searches a component for a connection that is not part of the
+ * search tree. Such a connection is on a cycle, so removing it leaves the
+ * component in one piece. Returns 0 if one was found, 1 if the component is a tree.
+ */
+int findCycleConnection(struct World* world, int roomIndex, int* queue, int* marks, int mark,
+                        int* x, int* y) {
+    struct Room* rooms = world->rooms;
+    int* parents = queue + numRooms;
+    int head = 0, tail = 0;
+
+    marks[roomIndex] = mark;
+    parents[roomIndex] = -1;
+    queue[tail++] = roomIndex;
+    while (head < tail) {
+        int u = queue[head++];
+
+        int i;
+        for (i = 0; i < rooms[u].numConnections; i++) {
+            int v = rooms[u].connections[i];
+            if (marks[v] != mark) {
+                marks[v] = mark;
+                parents[v] = u;
+                queue[tail++] = v;
+            } else if (v != parents[u]) {
+                *x = u;
+                *y = v;
+                return TRUE;
+            }
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * NAME: connectComponents
+ * PARAMS: Pointer to the world
+ * RETURN: void
+ * DESCRIPTION: Joins every component to the one holding the first room so
+ * the end room can always be reached from the start room. Each component is
+ * linked through a room with space for another connection on both sides.
+ * When either side is full, a connection on a cycle in one component and
+ * any connection in the other are crossed over instead, which keeps every
+ * room's number of connections. Rooms are grouped by component once, so the
+ * work is linear in rooms and connections.
+ */
+void connectComponents(struct World* world) {
+    struct Room* rooms = world->rooms;
+
+    if (world->componentsStale == TRUE) {
+        rebuildComponents(world);
+    }
+    if (world->numComponents == 1) {
+        return;
+    }
+
+    /* Group the rooms by component with a counting sort on the component root */
+    int* roots = malloc((size_t)numRooms * sizeof(int));
+    int* groupStarts = calloc((size_t)numRooms + 1, sizeof(int));
+    int* members = malloc((size_t)numRooms * sizeof(int));
+    int* spareRooms = malloc((size_t)numRooms * sizeof(int));
+    int* queue = malloc((size_t)numRooms * 2 * sizeof(int));
+    int* marks = calloc((size_t)numRooms, sizeof(int));
+    int numSpare = 0, mark = 0;
+    assert(roots != NULL && groupStarts != NULL && members != NULL);
+    assert(spareRooms != NULL && queue != NULL && marks != NULL);
+
+    int i;
+    for (i = 0; i < numRooms; i++) {
+        roots[i] = findComponent(world, i);
+        groupStarts[roots[i] + 1]++;
+    }
+    for (i = 0; i < numRooms; i++) {
+        groupStarts[i + 1] += groupStarts[i];
+    }
+    for (i = 0; i < numRooms; i++) {
+        members[groupStarts[roots[i]]++] = i;
+    }
+    for (i = numRooms; i > 0; i--) {
+        groupStarts[i] = groupStarts[i - 1];
+    }
+    groupStarts[0] = 0;
+
+    int mainRoot = roots[0];
+    for (i = groupStarts[mainRoot]; i < groupStarts[mainRoot + 1]; i++) {
+        if (rooms[members[i]].numConnections < maxConnections) {
+            spareRooms[numSpare++] = members[i];
+        }
+    }
+
+    int root;
+    for (root = 0; root < numRooms; root++) {
+        if (root == mainRoot || roots[root] != root) {
+            continue;
+        }
+
+        int* group = members + groupStarts[root];
+        int groupSize = groupStarts[root + 1] - groupStarts[root];
+        int spareRoom = -1;
+
+        for (i = 0; i < groupSize; i++) {
+            if (rooms[group[i]].numConnections < maxConnections) {
+                spareRoom = group[i];
+                break;
+            }
+        }
+        while (numSpare > 0 && rooms[spareRooms[numSpare - 1]].numConnections >= maxConnections) {
+            numSpare--;
+        }
+
+        if (spareRoom != -1 && numSpare > 0) {
+            connectRoom(world, &rooms[spareRooms[numSpare - 1]], &rooms[spareRoom]);
+            world->connectionsAdded++;
+        } else {
+            int x, y, u, v;
+
+            if (findCycleConnection(world, group[0], queue, marks, ++mark, &x, &y) == TRUE) {
+                u = members[groupStarts[mainRoot]];
+            } else if (findCycleConnection(world, members[groupStarts[mainRoot]], queue, marks, ++mark,
+                                           &x, &y) == TRUE) {
+                u = group[0];
+            } else {
+                printf("ERROR: Cannot join room %s to the rest of the world with at most %d connections. Exiting.\n",
+                       rooms[group[0]].roomName, maxConnections);
+                exit(1);
+            }
+            v = rooms[u].connections[0];
+
+            /* x-y is on a cycle and u-v is in the other component, so crossing
+             * them over to x-u and y-v joins the two and splits neither */
+            removeConnection(world, &rooms[x], y);
+            removeConnection(world, &rooms[y], x);
+            removeConnection(world, &rooms[u], v);
+            removeConnection(world, &rooms[v], u);
+            connectRoom(world, &rooms[x], &rooms[u]);
+            connectRoom(world, &rooms[y], &rooms[v]);
+            world->componentsStale = FALSE;
+            world->edgeSwaps++;
+        }
+        world->componentsJoined++;
+
+        for (i = 0; i < groupSize; i++) {
+            if (rooms[group[i]].numConnections < maxConnections) {
+                spareRooms[numSpare++] = group[i];
+            }
+        }
+    }
+    assert(world->numComponents == 1);
+
+    free(roots);
+    free(groupStarts);
+    free(members);
+    free(spareRooms);
+    free(queue);
+    free(marks);
+}
+
+/*
+ * NAME: storeInfoToFiles
+ * PARAMS: Pointer to the world
+ * RETURN: void
+ * DESCRIPTION: Formats each room's info into one buffer and writes it to the
+ * room's file
+ */
+void storeInfoToFiles(struct World* world) {
+    struct Room* rooms = world->rooms;
+    const char * roomTypesLabel[] = {"START_ROOM", "END_ROOM", "MID_ROOM"};
+    char* text = world->roomText;
+
+    int i;
+    for (i = 0; i < numRooms; i++) {
+        int length = sprintf(text, "ROOM NAME: %s\n", rooms[i].roomName);
+
+        int j;
+        for (j = 0; j < rooms[i].numConnections; j++) {
+            length += sprintf(text + length, "CONNECTION %d: %s\n", j + 1, rooms[rooms[i].connections[j]].roomName);
+        }
+
+        length += sprintf(text + length, "ROOM TYPE: %s\n", roomTypesLabel[rooms[i].type]);
+
+        writeRoomFile(world, rooms[i].roomName, text, length);
+    }
+
+    finishRoomFiles(world);
+}
+
+/*
+ * NAME: writeWorldBytes
+ * PARAMS: Pointer to the world, file pointer, pointer to the data, its size in bytes and pointer to the running checksum
+ * RETURN: void
+ * DESCRIPTION: Writes part of a world file section and adds it to the checksum
+ */
+void writeWorldBytes(struct World* world, FILE* filePtr, const void* data, size_t size, uint64_t* checksum) {
+    if (fwrite(data, 1, size, filePtr) != size) {
+        printf("ERROR: Failed to write world file %s. Exiting.\n", world->worldFileName);
+        exit(1);
+    }
+    *checksum = updateChecksum(*checksum, data, size);
+}
+
+/*
+ * NAME: padWorldFile
+ * PARAMS: Pointer to the world, file pointer, byte offset of the next section and pointer to the running checksum
+ * RETURN: void
+ * DESCRIPTION: Writes zeros until the file position reaches the next section
+ */
+void padWorldFile(struct World* world, FILE* filePtr, uint64_t sectionStart, uint64_t* checksum) {
+    const char zeros[WORLD_ALIGNMENT] = {0};
+    uint64_t position = (uint64_t)ftell(filePtr);
+
+    assert(sectionStart >= position && sectionStart - position <= WORLD_ALIGNMENT);
+    writeWorldBytes(world, filePtr, zeros, sectionStart - position, checksum);
+}
+
+/*
+ * NAME: storeInfoToWorldFile
+ * PARAMS: Pointer to the world
+ * RETURN: void
+ * DESCRIPTION: Writes the whole world to one packed binary file. The file is
+ * written under a temporary name and renamed into place so readers never see
+ * a partial world.
+ */
+void storeInfoToWorldFile(struct World* world) {
+    struct Room* rooms = world->rooms;
+    struct WorldHeader header;
+    char* tempFileName = malloc(MAX_PATH_LENGTH * sizeof(char));
+    uint32_t* connectionOffsets = malloc(((size_t)numRooms + 1) * sizeof(uint32_t));
+    uint32_t* nameOffsets = malloc((size_t)numRooms * sizeof(uint32_t));
+    uint32_t* nameIndex;
+    uint64_t checksum = CHECKSUM_SEED;
+    uint64_t namesSize = 0;
+    FILE* filePtr;
+
+    assert(tempFileName != NULL && connectionOffsets != NULL && nameOffsets != NULL);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, WORLD_MAGIC, sizeof(WORLD_MAGIC));
+    header.version = WORLD_VERSION;
+    header.numRooms = numRooms;
+
+    int i;
+    connectionOffsets[0] = 0;
+    for (i = 0; i < numRooms; i++) {
+        connectionOffsets[i + 1] = connectionOffsets[i] + rooms[i].numConnections;
+        nameOffsets[i] = (uint32_t)namesSize;
+        namesSize += getNameLength(rooms[i].roomName) + 1;
+
+        if (rooms[i].type == START_ROOM) {
+            header.startRoom = i;
+        } else if (rooms[i].type == END_ROOM) {
+            header.endRoom = i;
+        }
+    }
+
+    header.numConnections = connectionOffsets[numRooms];
+    header.connectionOffsetsStart = alignWorldOffset(sizeof(header));
+    header.connectionsStart = alignWorldOffset(header.connectionOffsetsStart
+                                               + ((uint64_t)numRooms + 1) * sizeof(uint32_t));
+    header.nameOffsetsStart = alignWorldOffset(header.connectionsStart
+                                               + header.numConnections * sizeof(uint32_t));
+    header.namesStart = alignWorldOffset(header.nameOffsetsStart + (uint64_t)numRooms * sizeof(uint32_t));
+    header.namesSize = namesSize;
+    header.nameIndexStart = alignWorldOffset(header.namesStart + namesSize);
+    header.nameIndexSize = getNameIndexSize(numRooms);
+    header.fileSize = header.nameIndexStart + header.nameIndexSize * sizeof(uint32_t);
+
+    nameIndex = calloc(header.nameIndexSize, sizeof(uint32_t));
+    assert(nameIndex != NULL);
+    for (i = 0; i < numRooms; i++) {
+        insertNameIndex(nameIndex, header.nameIndexSize, rooms[i].roomName, i);
+    }
+
+    snprintf(tempFileName, MAX_PATH_LENGTH, "%s.tmp", world->worldFileName);
+    filePtr = fopen(tempFileName, "w");
+    assert(filePtr != NULL);
+
+    /* Reserve space for the header, it is written once the checksum is known */
+    if (fwrite(&header, sizeof(header), 1, filePtr) != 1) {
+        printf("ERROR: Failed to write world file %s. Exiting.\n", world->worldFileName);
+        exit(1);
+    }
+
+    padWorldFile(world, filePtr, header.connectionOffsetsStart, &checksum);
+    writeWorldBytes(world, filePtr, connectionOffsets, ((size_t)numRooms + 1) * sizeof(uint32_t), &checksum);
+
+    padWorldFile(world, filePtr, header.connectionsStart, &checksum);
+    for (i = 0; i < numRooms; i++) {
+        writeWorldBytes(world, filePtr, rooms[i].connections, rooms[i].numConnections * sizeof(int), &checksum);
+    }
+
+    padWorldFile(world, filePtr, header.nameOffsetsStart, &checksum);
+    writeWorldBytes(world, filePtr, nameOffsets, (size_t)numRooms * sizeof(uint32_t), &checksum);
+
+    padWorldFile(world, filePtr, header.namesStart, &checksum);
+    for (i = 0; i < numRooms; i++) {
+        writeWorldBytes(world, filePtr, rooms[i].roomName, getNameLength(rooms[i].roomName) + 1, &checksum);
+    }
+
+    padWorldFile(world, filePtr, header.nameIndexStart, &checksum);
+    writeWorldBytes(world, filePtr, nameIndex, header.nameIndexSize * sizeof(uint32_t), &checksum);
+
+    header.checksum = checksum;
+    rewind(filePtr);
+    if (fwrite(&header, sizeof(header), 1, filePtr) != 1
+        || (syncBatch > 0 && (fflush(filePtr) != 0 || fsync(fileno(filePtr)) != 0))
+        || fclose(filePtr) != 0) {
+        printf("ERROR: Failed to write world file %s. Exiting.\n", world->worldFileName);
+        exit(1);
+    }
+    world->filesCreated++;
+    world->bytesWritten += header.fileSize;
+
+    int result = rename(tempFileName, world->worldFileName);
+    assert(result == TRUE);
+
+    free(tempFileName);
+    free(connectionOffsets);
+    free(nameOffsets);
+    free(nameIndex);
+}
+
+/*
+ * NAME: getEmbeddedSeparator
+ * PARAMS: Index of a value in an embedded array
+ * RETURN: Pointer to what to print before the value
+ * DESCRIPTION: Puts EMBEDDED_VALUES_PER_LINE values on each line
+ */
+const char* getEmbeddedSeparator(size_t index) {
+    if (index == 0) {
+        return "\n    ";
+    }
+    return (index % EMBEDDED_VALUES_PER_LINE == 0) ? ",\n    " : ", ";
+}
+
+/*
+ * NAME: printEmbeddedArray
+ * PARAMS: File pointer, pointer to the array's name, pointer to the values and their count
+ * RETURN: void
+ * DESCRIPTION: Prints a static const uint32_t array definition
+ */
+void printEmbeddedArray(FILE* filePtr, const char* name, const uint32_t* values, size_t count) {
+    fprintf(filePtr, "\nstatic const uint32_t %s[] = {", name);
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        fprintf(filePtr, "%s%u", getEmbeddedSeparator(i), values[i]);
+    }
+    fprintf(filePtr, "\n};\n");
+}
+
+/*
+ * NAME: storeInfoToEmbeddedFile
+ * PARAMS: Pointer to the world
+ * RETURN: void
+ * DESCRIPTION: Writes the world for --embed as a C header holding the same
+ * sections as a packed world file (see eganch.world.h) as static const
+ * arrays, and its size and start and end rooms as constants. Names are one
+ * string with a NUL after each name, written as octal escapes so a digit
+ * after one cannot be read as part of it.
+ */
+void storeInfoToEmbeddedFile(struct World* world) {
+    struct Room* rooms = world->rooms;
+    char* tempFileName = malloc(MAX_PATH_LENGTH * sizeof(char));
+    uint32_t* connectionOffsets = malloc(((size_t)numRooms + 1) * sizeof(uint32_t));
+    uint32_t* nameOffsets = malloc((size_t)numRooms * sizeof(uint32_t));
+    uint64_t nameIndexSize = getNameIndexSize(numRooms);
+    uint32_t* nameIndex = calloc(nameIndexSize, sizeof(uint32_t));
+    uint32_t startRoom = 0,
+             endRoom = 0;
+    uint64_t namesSize = 0;
+
+    assert(tempFileName != NULL && connectionOffsets != NULL && nameOffsets != NULL && nameIndex != NULL);
+
+    int i;
+    connectionOffsets[0] = 0;
+    for (i = 0; i < numRooms; i++) {
+        connectionOffsets[i + 1] = connectionOffsets[i] + rooms[i].numConnections;
+        nameOffsets[i] = (uint32_t)namesSize;
+        namesSize += getNameLength(rooms[i].roomName) + 1;
+        insertNameIndex(nameIndex, nameIndexSize, rooms[i].roomName, i);
+
+        if (rooms[i].type == START_ROOM) {
+            startRoom = i;
+        } else if (rooms[i].type == END_ROOM) {
+            endRoom = i;
+        }
+    }
+
+    snprintf(tempFileName, MAX_PATH_LENGTH, "%s.tmp", embedFileName);
+    FILE* filePtr = fopen(tempFileName, "w");
+    if (filePtr == NULL) {
+        printf("ERROR: Failed to write embedded world %s. Exiting.\n", embedFileName);
+        exit(1);
+    }
+
+    fprintf(filePtr, "/*\n * FILE NAME: %s\n", embedFileName);
+    fprintf(filePtr, " * DESCRIPTION: World %s (seed %llu, world %d) embedded by\n",
+            (format == TEXT_FORMAT) ? world->directoryName : world->worldFileName,
+            (unsigned long long)seed, world->worldNumber);
+    fprintf(filePtr, " * eganch.buildrooms --embed. Generated, do not edit.\n */\n\n");
+    fprintf(filePtr, "#define EMBEDDED_WORLD_NAME \"%s\"\n",
+            (format == TEXT_FORMAT) ? world->directoryName : world->worldFileName);
+    fprintf(filePtr, "#define EMBEDDED_NUM_ROOMS %d\n", numRooms);
+    fprintf(filePtr, "#define EMBEDDED_NUM_CONNECTIONS %u\n", connectionOffsets[numRooms]);
+    fprintf(filePtr, "#define EMBEDDED_START_ROOM %u\n", startRoom);
+    fprintf(filePtr, "#define EMBEDDED_END_ROOM %u\n", endRoom);
+    fprintf(filePtr, "#define EMBEDDED_NAME_INDEX_SIZE %llu\n", (unsigned long long)nameIndexSize);
+
+    printEmbeddedArray(filePtr, "embeddedConnectionOffsets", connectionOffsets, (size_t)numRooms + 1);
+
+    fprintf(filePtr, "\nstatic const uint32_t embeddedConnections[] = {");
+    uint32_t connection = 0;
+    for (i = 0; i < numRooms; i++) {
+        int j;
+        for (j = 0; j < rooms[i].numConnections; j++, connection++) {
+            fprintf(filePtr, "%s%d", getEmbeddedSeparator(connection), rooms[i].connections[j]);
+        }
+    }
+    fprintf(filePtr, "\n};\n");
+
+    printEmbeddedArray(filePtr, "embeddedNameOffsets", nameOffsets, numRooms);
+
+    fprintf(filePtr, "\nstatic const char embeddedNames[] =");
+    for (i = 0; i < numRooms; i++) {
+        fprintf(filePtr, "%s\"", (i % EMBEDDED_VALUES_PER_LINE == 0) ? "\n    " : " ");
+        const char* name;
+        for (name = rooms[i].roomName; *name != '\0'; name++) {
+            fprintf(filePtr, (*name == '"' || *name == '\\') ? "\\%c" : "%c", *name);
+        }
+        fprintf(filePtr, "\\000\"");
+    }
+    fprintf(filePtr, ";\n");
+
+    printEmbeddedArray(filePtr, "embeddedNameIndex", nameIndex, nameIndexSize);
+
+    if (fclose(filePtr) != 0 || rename(tempFileName, embedFileName) != 0) {
+        printf("ERROR: Failed to write embedded world %s. Exiting.\n", embedFileName);
+        exit(1);
+    }
+    world->filesCreated++;
+
+    free(tempFileName);
+    free(connectionOffsets);
+    free(nameOffsets);
+    free(nameIndex);
+}
+
+/*
+ * NAME: getStreamRoomName
+ * PARAMS: Pointer to the world, the room id and pointer to a GENERATED_NAME_SIZE buffer
+ * RETURN: Pointer to the room's name
+ * DESCRIPTION: Streamed worlds never hold every name at once. Small worlds use
+ * the shuffled list of names, larger ones generate the name from the room id.
+ */
+char* getStreamRoomName(struct World* world, uint32_t roomId, char* buffer) {
+    if (numRooms <= NUM_ROOM_NAMES) {
+        return world->fileNames[roomId];
+    }
+    makeRoomName(world, roomId, buffer);
+    return buffer;
+}
+
+/*
+ * NAME: isStreamConnected
+ * PARAMS: Pointer to the world, a window slot and a room id
+ * RETURN: Int indicating connection
+ * DESCRIPTION: Returns 0 if the room in the slot is connected to the room id, 1 otherwise
+ */
+int isStreamConnected(struct World* world, int slot, uint32_t roomId) {
+    uint32_t* connections = world->windowConnections + (size_t)slot * maxConnections;
+
+    int i;
+    for (i = 0; i < world->windowDegrees[slot]; i++) {
+        if (connections[i] == roomId) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * NAME: isValidStreamConnection
+ * PARAMS: Pointer to the world and two window slots
+ * RETURN: Int indicating if the connection can be added
+ * DESCRIPTION: Returns 0 if the rooms in slots x and y are different, not yet
+ * connected and y has room for another connection, 1 otherwise
+ */
+int isValidStreamConnection(struct World* world, int x, int y) {
+    if (x == y
+        || world->windowDegrees[y] >= maxConnections
+        || isStreamConnected(world, x, world->windowIds[y]) == TRUE) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * NAME: updateStreamSets
+ * PARAMS: Pointer to the world and a window slot
+ * RETURN: void
+ * DESCRIPTION: Same as updateRoomSets, for a room in the streaming window
+ */
+void updateStreamSets(struct World* world, int slot) {
+    if (world->windowDegrees[slot] < minConnections) {
+        addToRoomSet(&world->underMinimumRooms, slot);
+    } else {
+        removeFromRoomSet(&world->underMinimumRooms, slot);
+    }
+
+    if (world->windowDegrees[slot] < maxConnections) {
+        addToRoomSet(&world->openRooms, slot);
+    } else {
+        removeFromRoomSet(&world->openRooms, slot);
+    }
+}
+
+/*
+ * NAME: connectStreamRooms
+ * PARAMS: Pointer to the world and two window slots
+ * RETURN: void
+ * DESCRIPTION: Connects the rooms in slots x and y together
+ */
+void connectStreamRooms(struct World* world, int x, int y) {
+    world->windowConnections[(size_t)x * maxConnections + world->windowDegrees[x]++] = world->windowIds[y];
+    world->windowConnections[(size_t)y * maxConnections + world->windowDegrees[y]++] = world->windowIds[x];
+    world->connectionsAdded++;
+
+    updateStreamSets(world, x);
+    updateStreamSets(world, y);
+}
+
+/*
+ * NAME: findStreamPartner
+ * PARAMS: Pointer to the world, the slot needing a connection and the set to pick from
+ * RETURN: Window slot of a room that can be connected, -1 if there is none
+ * DESCRIPTION: Draws random rooms from the set, falling back to checking every
+ * member once the draws keep failing
+ */
+int findStreamPartner(struct World* world, int slot, struct RoomSet* set) {
+    if (set->size == 0) {
+        return -1;
+    }
+
+    int attempt;
+    for (attempt = 0; attempt < MAX_CONNECTION_RETRIES; attempt++) {
+        int candidate = set->members[getRandomBelow(&world->random, set->size)];
+        if (isValidStreamConnection(world, slot, candidate) == TRUE) {
+            return candidate;
+        }
+        world->connectionRetries++;
+    }
+
+    world->fallbackScans++;
+    int i;
+    for (i = 0; i < set->size; i++) {
+        if (isValidStreamConnection(world, slot, set->members[i]) == TRUE) {
+            return set->members[i];
+        }
+    }
+    return -1;
+}
+
+/*
+ * NAME: removeStreamConnection
+ * PARAMS: Pointer to the world, a window slot and the id of the connected room
+ * RETURN: void
+ * DESCRIPTION: Removes one side of a connection by moving the last connection into its slot
+ */
+void removeStreamConnection(struct World* world, int slot, uint32_t roomId) {
+    uint32_t* connections = world->windowConnections + (size_t)slot * maxConnections;
+
+    int i;
+    for (i = 0; i < world->windowDegrees[slot]; i++) {
+        if (connections[i] == roomId) {
+            connections[i] = connections[--world->windowDegrees[slot]];
+            break;
+        }
+    }
+    updateStreamSets(world, slot);
+}
+
+/*
+ * NAME: swapInStreamConnection
+ * PARAMS: Pointer to the world and the slot needing a connection
+ * RETURN: Int indicating if a swap was made
+ * DESCRIPTION: Same as swapInConnection, limited to connections between rooms
+ * that are both still in the window and never taking the link a room entered
+ * the window with
+ */
+int swapInStreamConnection(struct World* world, int slot) {
+    uint32_t roomId;
+    for (roomId = world->oldestRoom; roomId <= world->newestRoom; roomId++) {
+        int slotU = roomId % world->windowSize;
+        if (slotU == slot || isStreamConnected(world, slot, roomId) == TRUE) {
+            continue;
+        }
+
+        uint32_t* connections = world->windowConnections + (size_t)slotU * maxConnections;
+        int j;
+        for (j = 0; j < world->windowDegrees[slotU]; j++) {
+            uint32_t roomV = connections[j];
+            int slotV = roomV % world->windowSize;
+            if (roomV < world->oldestRoom || slotV == slot
+                || world->windowParents[slotU] == roomV || world->windowParents[slotV] == roomId
+                || isStreamConnected(world, slot, roomV) == TRUE) {
+                continue;
+            }
+
+            world->edgeSwaps++;
+            world->connectionsAdded--;
+            removeStreamConnection(world, slotU, roomV);
+            removeStreamConnection(world, slotV, roomId);
+            connectStreamRooms(world, slot, slotU);
+            if (world->windowDegrees[slot] < maxConnections) {
+                connectStreamRooms(world, slot, slotV);
+            }
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/*
+ * NAME: enterStreamRoom
+ * PARAMS: Pointer to the world and the id of the next room
+ * RETURN: void
+ * DESCRIPTION: Adds a room to the window and connects it to one room already
+ * there, preferring rooms still under the minimum, or swaps a connection to
+ * make space when every room is full. Every room after the first is linked
+ * back to an earlier one and that link is never swapped away, so the links
+ * form a tree through every room and the world stays in one piece.
+ */
+void enterStreamRoom(struct World* world, uint32_t roomId) {
+    int slot = roomId % world->windowSize;
+
+    world->windowIds[slot] = roomId;
+    world->windowDegrees[slot] = 0;
+    world->windowParents[slot] = NO_PARENT_ROOM;
+    world->newestRoom = roomId;
+
+    int partner = findStreamPartner(world, slot, &world->underMinimumRooms);
+    if (partner == -1) {
+        partner = findStreamPartner(world, slot, &world->openRooms);
+    }
+
+    if (partner != -1) {
+        connectStreamRooms(world, slot, partner);
+        world->windowParents[slot] = world->windowIds[partner];
+    } else if (roomId == world->oldestRoom) {
+        updateStreamSets(world, slot);
+    } else if (swapInStreamConnection(world, slot) == TRUE) {
+        world->windowParents[slot] = world->windowConnections[(size_t)slot * maxConnections];
+    } else {
+        printf("ERROR: Cannot link room %u to the rest of the world with at most %d connections. Exiting.\n",
+               roomId, maxConnections);
+        exit(1);
+    }
+}
+
+/*
+ * NAME: completeStreamRoom
+ * PARAMS: Pointer to the world and a window slot
+ * RETURN: void
+ * DESCRIPTION: Connects a room to random open rooms in the window until it has
+ * the minimum number of connections. Called just before the room is written.
+ */
+void completeStreamRoom(struct World* world, int slot) {
+    while (world->windowDegrees[slot] < minConnections) {
+        int partner = findStreamPartner(world, slot, &world->openRooms);
+        if (partner != -1) {
+            connectStreamRooms(world, slot, partner);
+        } else if (world->edgeSwaps >= numRooms || swapInStreamConnection(world, slot) == FALSE) {
+            printf("ERROR: Cannot give room %u %d connections with at most %d per room. Exiting.\n",
+                   world->windowIds[slot], minConnections, maxConnections);
+            exit(1);
+        }
+    }
+}
+
+/*
+ * NAME: flushStreamOutput
+ * PARAMS: Pointer to the world
+ * RETURN: void
+ * DESCRIPTION: Writes out whatever is in the stream buffer
+ */
+void flushStreamOutput(struct World* world) {
+    struct StreamOutput* output = &world->output;
+
+    if (output->used > 0) {
+        if (pwrite(output->fd, output->buffer, output->used, output->position) != (ssize_t)output->used) {
+            printf("ERROR: Failed to write streamed world. Exiting.\n");
+            exit(1);
+        }
+        output->position += output->used;
+        output->bytesWritten += output->used;
+        output->used = 0;
+    }
+}
+
+/*
+ * NAME: writeStreamBytes
+ * PARAMS: Pointer to the world, pointer to the data and its size in bytes
+ * RETURN: void
+ * DESCRIPTION: Adds data to the stream buffer, writing the buffer out when full
+ */
+void writeStreamBytes(struct World* world, const void* data, size_t size) {
+    struct StreamOutput* output = &world->output;
+    const char* bytes = data;
+
+    while (size > 0) {
+        if (output->used == STREAM_BUFFER_SIZE) {
+            flushStreamOutput(world);
+        }
+
+        size_t chunk = STREAM_BUFFER_SIZE - output->used;
+        if (chunk > size) {
+            chunk = size;
+        }
+        memcpy(output->buffer + output->used, bytes, chunk);
+        output->used += chunk;
+        bytes += chunk;
+        size -= chunk;
+    }
+}
+
+/*
+ * NAME: seekStreamOutput
+ * PARAMS: Pointer to the world and the byte offset to write at next
+ * RETURN: void
+ * DESCRIPTION: Writes out the buffer and moves the stream to a new position
+ */
+void seekStreamOutput(struct World* world, uint64_t position) {
+    flushStreamOutput(world);
+    world->output.position = position;
+}
+
+/*
+ * NAME: flushStreamOffsets
+ * PARAMS: Pointer to the world
+ * RETURN: void
+ * DESCRIPTION: Writes the buffered connection offsets into their section
+ */
+void flushStreamOffsets(struct World* world) {
+    struct StreamOutput* output = &world->output;
+    size_t size = output->offsetsUsed * sizeof(uint32_t);
+
+    if (pwrite(output->fd, output->offsets, size, output->offsetsPosition) != (ssize_t)size) {
+        printf("ERROR: Failed to write streamed world. Exiting.\n");
+        exit(1);
+    }
+    output->offsetsPosition += size;
+    output->bytesWritten += size;
+    output->offsetsUsed = 0;
+}
+
+/*
+ * NAME: addStreamOffset
+ * PARAMS: Pointer to the world and the offset of the next room's connections
+ * RETURN: void
+ * DESCRIPTION: Buffers one entry of the connection offsets section
+ */
+void addStreamOffset(struct World* world, uint32_t offset) {
+    if (world->output.offsetsUsed == STREAM_OFFSET_BATCH) {
+        flushStreamOffsets(world);
+    }
+    world->output.offsets[world->output.offsetsUsed++] = offset;
+}
+
+/*
+ * NAME: emitStreamRoom
+ * PARAMS: Pointer to the world and a window slot
+ * RETURN: void
+ * DESCRIPTION: Writes a finished room and frees its slot. Text rooms get their
+ * own file, binary rooms add their connections to the world file.
+ */
+void emitStreamRoom(struct World* world, int slot) {
+    const char * roomTypesLabel[] = {"START_ROOM", "END_ROOM", "MID_ROOM"};
+    uint32_t* connections = world->windowConnections + (size_t)slot * maxConnections;
+    uint32_t roomId = world->windowIds[slot];
+    char name[GENERATED_NAME_SIZE];
+    char* roomName = getStreamRoomName(world, roomId, name);
+
+    removeFromRoomSet(&world->underMinimumRooms, slot);
+    removeFromRoomSet(&world->openRooms, slot);
+
+    if (format == BINARY_FORMAT) {
+        addStreamOffset(world, world->connectionsWritten);
+        writeStreamBytes(world, connections, world->windowDegrees[slot] * sizeof(uint32_t));
+        world->connectionsWritten += world->windowDegrees[slot];
+        world->namesSize += strlen(roomName) + 1;
+        return;
+    }
+
+    char connectionName[GENERATED_NAME_SIZE];
+    char* text = world->roomText;
+    enum roomTypes type = MID_ROOM;
+
+    if (roomId == world->startRoom) {
+        type = START_ROOM;
+    } else if (roomId == world->endRoom) {
+        type = END_ROOM;
+    }
+
+    int length = sprintf(text, "ROOM NAME: %s\n", roomName);
+
+    int j;
+    for (j = 0; j < world->windowDegrees[slot]; j++) {
+        length += sprintf(text + length, "CONNECTION %d: %s\n", j + 1,
+                          getStreamRoomName(world, connections[j], connectionName));
+    }
+
+    length += sprintf(text + length, "ROOM TYPE: %s\n", roomTypesLabel[type]);
+
+    writeRoomFile(world, roomName, text, length);
+    world->output.bytesWritten += length;
+}
+
+/*
+ * NAME: finishStreamWorldFile
+ * PARAMS: Pointer to the world and pointer to the temporary file name
+ * RETURN: void
+ * DESCRIPTION: Once every room's connections are written, writes the name
+ * sections, builds the name index, checksums the file and writes the header.
+ * The index is built through a shared mapping of the file and dropped from
+ * memory as it goes, so the kernel rather than the heap holds it.
+ */
+void finishStreamWorldFile(struct World* world, char* tempFileName) {
+    struct StreamOutput* output = &world->output;
+    struct WorldHeader header;
+    char name[GENERATED_NAME_SIZE];
+    uint32_t roomId;
+
+    addStreamOffset(world, world->connectionsWritten);
+    flushStreamOffsets(world);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, WORLD_MAGIC, sizeof(WORLD_MAGIC));
+    header.version = WORLD_VERSION;
+    header.numRooms = numRooms;
+    header.numConnections = world->connectionsWritten;
+    header.startRoom = world->startRoom;
+    header.endRoom = world->endRoom;
+    header.connectionOffsetsStart = alignWorldOffset(sizeof(header));
+    header.connectionsStart = alignWorldOffset(header.connectionOffsetsStart
+                                               + ((uint64_t)numRooms + 1) * sizeof(uint32_t));
+    header.nameOffsetsStart = alignWorldOffset(header.connectionsStart
+                                               + header.numConnections * sizeof(uint32_t));
+    header.namesStart = alignWorldOffset(header.nameOffsetsStart + (uint64_t)numRooms * sizeof(uint32_t));
+    header.namesSize = world->namesSize;
+    header.nameIndexStart = alignWorldOffset(header.namesStart + header.namesSize);
+    header.nameIndexSize = getNameIndexSize(numRooms);
+    header.fileSize = header.nameIndexStart + header.nameIndexSize * sizeof(uint32_t);
+
+    uint32_t nameOffset = 0;
+    seekStreamOutput(world, header.nameOffsetsStart);
+    for (roomId = 0; roomId < (uint32_t)numRooms; roomId++) {
+        writeStreamBytes(world, &nameOffset, sizeof(uint32_t));
+        nameOffset += strlen(getStreamRoomName(world, roomId, name)) + 1;
+    }
+
+    seekStreamOutput(world, header.namesStart);
+    for (roomId = 0; roomId < (uint32_t)numRooms; roomId++) {
+        char* roomName = getStreamRoomName(world, roomId, name);
+        writeStreamBytes(world, roomName, strlen(roomName) + 1);
+    }
+    flushStreamOutput(world);
+
+    if (ftruncate(output->fd, header.fileSize) != 0) {
+        printf("ERROR: Failed to write world file %s. Exiting.\n", world->worldFileName);
+        exit(1);
+    }
+
+    long pageSize = sysconf(_SC_PAGESIZE);
+    uint64_t mapStart = header.nameIndexStart & ~(uint64_t)(pageSize - 1);
+    size_t mapSize = header.fileSize - mapStart;
+    char* mapping = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, output->fd, mapStart);
+    assert(mapping != MAP_FAILED);
+    /* Inserts are scattered, so stop the kernel mapping in neighbouring pages on each fault */
+    madvise(mapping, mapSize, MADV_RANDOM);
+
+    uint32_t* nameIndex = (uint32_t*)(mapping + (header.nameIndexStart - mapStart));
+    long long pagesAllowed = memoryLimit / pageSize / 2;
+    for (roomId = 0; roomId < (uint32_t)numRooms; roomId++) {
+        insertNameIndex(nameIndex, header.nameIndexSize, getStreamRoomName(world, roomId, name), roomId);
+        if ((roomId + 1) % pagesAllowed == 0) {
+            madvise(mapping, mapSize, MADV_DONTNEED);
+        }
+    }
+    munmap(mapping, mapSize);
+    output->bytesWritten += header.nameIndexSize * sizeof(uint32_t);
+
+    uint64_t checksum = CHECKSUM_SEED;
+    uint64_t position = sizeof(header);
+    while (position < header.fileSize) {
+        ssize_t received = pread(output->fd, output->buffer, STREAM_BUFFER_SIZE, position);
+        assert(received > 0);
+        checksum = updateChecksum(checksum, output->buffer, received);
+        position += received;
+    }
+
+    header.checksum = checksum;
+    if (pwrite(output->fd, &header, sizeof(header), 0) != sizeof(header)
+        || (syncBatch > 0 && fsync(output->fd) != 0)
+        || close(output->fd) != 0) {
+        printf("ERROR: Failed to write world file %s. Exiting.\n", world->worldFileName);
+        exit(1);
+    }
+    output->bytesWritten += sizeof(header);
+
+    int result = rename(tempFileName, world->worldFileName);
+    assert(result == TRUE);
+}
+
+/*
+ * NAME: streamWorld
+ * PARAMS: Pointer to the world
+ * RETURN: void
+ * DESCRIPTION: Generates a world without holding all of it in memory. Rooms
+ * pass through a window sized to fit the memory limit: each room is linked
+ * to an earlier one when it enters, topped up to the minimum number of
+ * connections when it reaches the front, then written exactly once and its
+ * slot reused. Connections can only join rooms that are in the window together.
+ */
+void streamWorld(struct World* world) {
+    struct timespec start, end;
+    char tempFileName[MAX_PATH_LENGTH];
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    size_t roomBytes = 3 * sizeof(uint32_t) + maxConnections * sizeof(uint32_t) + 4 * sizeof(int);
+    /* Signed throughout, so a limit below the buffers gives a negative window rather than a huge one */
+    long long windowSize = (memoryLimit - STREAM_BUFFER_SIZE - STREAM_OFFSET_BATCH * (long long)sizeof(uint32_t))
+                           / (long long)roomBytes;
+    if (windowSize > numRooms) {
+        windowSize = numRooms;
+    }
+    if (windowSize < numRooms && windowSize < 4 * (maxConnections + 1)) {
+        printf("ERROR: Memory limit is too small for rooms with %d connections. Exiting.\n", maxConnections);
+        exit(1);
+    }
+
+    world->windowSize = windowSize;
+    world->windowIds = malloc(windowSize * sizeof(uint32_t));
+    world->windowDegrees = malloc(windowSize * sizeof(int));
+    world->windowParents = malloc(windowSize * sizeof(uint32_t));
+    world->windowConnections = malloc(windowSize * maxConnections * sizeof(uint32_t));
+    world->output.buffer = malloc(STREAM_BUFFER_SIZE);
+    world->output.offsets = malloc(STREAM_OFFSET_BATCH * sizeof(uint32_t));
+    assert(world->windowIds != NULL && world->windowDegrees != NULL && world->windowParents != NULL);
+    assert(world->windowConnections != NULL);
+    assert(world->output.buffer != NULL && world->output.offsets != NULL);
+    initEmptyRoomSet(&world->underMinimumRooms, windowSize);
+    initEmptyRoomSet(&world->openRooms, windowSize);
+
+    if (numRooms <= NUM_ROOM_NAMES) {
+        world->fileNames = randomizeFileNames(world);
+    } else {
+        initRoomNames(world);
+    }
+
+    world->startRoom = getRandomBelow(&world->random, numRooms);
+    do {
+        world->endRoom = getRandomBelow(&world->random, numRooms);
+    } while (world->endRoom == world->startRoom);
+
+    if (format == BINARY_FORMAT) {
+        snprintf(tempFileName, MAX_PATH_LENGTH, "%s.tmp", world->worldFileName);
+        world->output.fd = open(tempFileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        assert(world->output.fd >= 0);
+        world->output.offsetsPosition = alignWorldOffset(sizeof(struct WorldHeader));
+        world->output.position = alignWorldOffset(world->output.offsetsPosition
+                                                  + ((uint64_t)numRooms + 1) * sizeof(uint32_t));
+    }
+
+    uint32_t roomId;
+    for (roomId = 0; roomId < (uint32_t)numRooms; roomId++) {
+        if (roomId - world->oldestRoom == (uint32_t)windowSize) {
+            int slot = world->oldestRoom % windowSize;
+            completeStreamRoom(world, slot);
+            emitStreamRoom(world, slot);
+            world->oldestRoom++;
+        }
+        enterStreamRoom(world, roomId);
+    }
+
+    /* The last window has no later rooms coming, finish all of it before writing */
+    for (roomId = world->oldestRoom; roomId < (uint32_t)numRooms; roomId++) {
+        completeStreamRoom(world, roomId % windowSize);
+    }
+    for (roomId = world->oldestRoom; roomId < (uint32_t)numRooms; roomId++) {
+        emitStreamRoom(world, roomId % windowSize);
+    }
+
+    /* The window is done with, give its memory to the name index */
+    free(world->windowIds);
+    free(world->windowDegrees);
+    free(world->windowParents);
+    free(world->windowConnections);
+    freeRoomSet(&world->underMinimumRooms);
+    freeRoomSet(&world->openRooms);
+
+    if (format == BINARY_FORMAT) {
+        flushStreamOutput(world);
+        finishStreamWorldFile(world, tempFileName);
+    } else {
+        finishRoomFiles(world);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    world->streamSeconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    free(world->output.buffer);
+    free(world->output.offsets);
+}
+
+/*
+ * NAME: startPhase
+ * PARAMS: Pointer to the world
+ * RETURN: void
+ * DESCRIPTION: Starts timing the world's first phase, with --stats only
+ */
+void startPhase(struct World* world) {
+    if (statsEnabled == TRUE) {
+        world->phaseStart = getStatsTime();
+    }
+}
+
+/*
+ * NAME: endPhase
+ * PARAMS: Pointer to the world and the phase that just finished
+ * RETURN: void
+ * DESCRIPTION: Adds the time since the last phase ended to this phase and
+ * starts timing the next one, with --stats only
+ */
+void endPhase(struct World* world, enum buildPhases phase) {
+    if (statsEnabled == TRUE) {
+        uint64_t now = getStatsTime();
+        world->phaseNs[phase] += now - world->phaseStart;
+        world->phaseStart = now;
+    }
+}
+
+/*
+ * NAME: addWorldStats
+ * PARAMS: Pointer to a finished world
+ * RETURN: void
+ * DESCRIPTION: Adds a world's counters and phase times to the totals
+ */
+void addWorldStats(struct World* world) {
+    addStat(&stats.worlds, 1);
+    addStat(&stats.rooms, numRooms);
+    addStat(&stats.connectionsAdded, world->connectionsAdded);
+    addStat(&stats.connectionRetries, world->connectionRetries);
+    addStat(&stats.connectionChecks, world->connectionChecks);
+    addStat(&stats.fallbackScans, world->fallbackScans);
+    addStat(&stats.edgeSwaps, world->edgeSwaps);
+    addStat(&stats.componentsJoined, world->componentsJoined);
+    addStat(&stats.filesCreated, world->filesCreated);
+    addStat(&stats.bytesWritten, world->bytesWritten);
+
+    int i;
+    for (i = 0; i < NUM_PHASES; i++) {
+        addStat(&stats.phaseNs[i], world->phaseNs[i]);
+    }
+}
+
+/*
+ * NAME: writeStats
+ * PARAMS: none
+ * RETURN: void
+ * DESCRIPTION: Appends the totals so far to the --stats file as one line of JSON
+ */
+void writeStats(void) {
+    FILE* file = openStatsFile(statsFileName);
+    if (file == NULL) {
+        return;
+    }
+
+    fprintf(file, "{\"program\": \"eganch.buildrooms\", \"pid\": %d, \"seconds\": %.6f, ",
+            getpid(), (getStatsTime() - statsStart) / 1e9);
+    fprintf(file, "\"worlds\": %llu, \"rooms\": %llu, \"connections_added\": %llu, "
+            "\"connection_retries\": %llu, \"connection_checks\": %llu, \"fallback_scans\": %llu, "
+            "\"edge_swaps\": %llu, \"components_joined\": %llu, \"files_created\": %llu, "
+            "\"bytes_written\": %llu, \"phase_seconds\": {",
+            (unsigned long long)readStat(&stats.worlds), (unsigned long long)readStat(&stats.rooms),
+            (unsigned long long)readStat(&stats.connectionsAdded),
+            (unsigned long long)readStat(&stats.connectionRetries),
+            (unsigned long long)readStat(&stats.connectionChecks),
+            (unsigned long long)readStat(&stats.fallbackScans), (unsigned long long)readStat(&stats.edgeSwaps),
+            (unsigned long long)readStat(&stats.componentsJoined),
+            (unsigned long long)readStat(&stats.filesCreated),
+            (unsigned long long)readStat(&stats.bytesWritten));
+
+    int i;
+    for (i = 0; i < NUM_PHASES; i++) {
+        fprintf(file, "%s\"%s\": %.6f", (i > 0) ? ", " : "", phaseNames[i], readStat(&stats.phaseNs[i]) / 1e9);
+    }
+    fprintf(file, "}}");
+    closeStatsFile(file);
+}
+
+/*
+ * NAME: buildWorld
+ * PARAMS: Pointer to the world, with its world number set
+ * RETURN: void
+ * DESCRIPTION: Generates one world from its own random stream, joins it into
+ * a single component and stores it, or with --embed writes only its C header.
+ * A text world's directory must already have been made.
+ */
+void buildWorld(struct World* world) {
+    seedRandomStream(&world->random, seed, world->worldNumber);
+    initArena(&world->arena, getWorldArenaSize());
+
+    if (format == BINARY_FORMAT) {
+        makeWorldFileName(world);
+    }
+
+    if (format == TEXT_FORMAT) {
+        world->roomText = allocateWorldBlock(world, ((size_t)maxConnections + 2) * ROOM_LINE_SIZE);
+        world->unsyncedFiles = allocateWorldBlock(world, MAX_SYNC_BATCH * sizeof(int));
+    }
+
+    if (streaming == TRUE) {
+        startPhase(world);
+        streamWorld(world);
+        if (format == BINARY_FORMAT) {
+            world->filesCreated++;
+            world->bytesWritten += world->output.bytesWritten;
+        }
+        endPhase(world, STREAM_PHASE);
+        return;
+    }
+
+    startPhase(world);
+    world->fileNames = randomizeFileNames(world);
+    endPhase(world, NAMES_PHASE);
+
+    world->rooms = setRoomInfo(world, world->fileNames);
+    initComponents(world);
+    endPhase(world, ROOMS_PHASE);
+
+    if (generator == LINEAR_GENERATOR) {
+        addLinearConnections(world);
+    } else {
+        while (getNumConnectedRooms(world) != numRooms) {
+            addRandomConnection(world);
+        }
+    }
+    endPhase(world, CONNECT_PHASE);
+
+    connectComponents(world);
+    endPhase(world, JOIN_PHASE);
+
+    if (embedFileName != NULL) {
+        storeInfoToEmbeddedFile(world);
+    } else if (format == TEXT_FORMAT) {
+        storeInfoToFiles(world);
+    } else {
+        storeInfoToWorldFile(world);
+    }
+    endPhase(world, STORE_PHASE);
+}
+
+/*
+ * NAME: freeWorld
+ * PARAMS: Pointer to the world
+ * RETURN: void
+ * DESCRIPTION: Frees the memory held by a built world, the arena all at once
+ */
+void freeWorld(struct World* world) {
+    freeArena(&world->arena);
+    free(world->directoryName);
+    free(world->worldFileName);
+}
+
+/*
+ * NAME: formatWorldEntry
+ * PARAMS: Pointer to a built world, pointer to a buffer and its size
+ * RETURN: Length of the catalog line
+ * DESCRIPTION: Describes a world for the catalog. Its id is the part of its
+ * name after "eganch.rooms.", the pid and, for bulk runs, the world number.
+ */
+int formatWorldEntry(struct World* world, char* line, size_t size) {
+    struct CatalogEntry entry;
+
+    memset(&entry, 0, sizeof(entry));
+    if (numWorlds > 1) {
+        snprintf(entry.id, CATALOG_ID_SIZE, "%d.%d", getpid(), world->worldNumber);
+    } else {
+        snprintf(entry.id, CATALOG_ID_SIZE, "%d", getpid());
+    }
+    entry.seed = seed;
+    entry.numRooms = numRooms;
+    strcpy(entry.format, (format == TEXT_FORMAT) ? "text" : "binary");
+    entry.created = time(NULL);
+    strncpy(entry.name, (format == TEXT_FORMAT) ? world->directoryName : world->worldFileName,
+            CATALOG_NAME_SIZE - 1);
+
+    return formatCatalogEntry(&entry, line, size);
+}
+
+/*
+ * NAME: openCatalog
+ * PARAMS: Int holding the flock operation, LOCK_SH to add or LOCK_EX to prune
+ * RETURN: File descriptor of the locked catalog
+ * DESCRIPTION: Opens and locks the catalog, creating it if needed. If a prune
+ * renamed a new catalog into place while we waited for the lock, the old one
+ * is dropped and the new one opened instead.
+ */
+int openCatalog(int operation) {
+    struct stat opened, current;
+    int fileDescriptor = -1;
+
+    while (fileDescriptor == -1) {
+        fileDescriptor = open(CATALOG_FILE_NAME, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        if (fileDescriptor < 0) {
+            printf("ERROR: Failed to open %s. Exiting.\n", CATALOG_FILE_NAME);
+            exit(1);
+        }
+        flock(fileDescriptor, operation);
+
+        fstat(fileDescriptor, &opened);
+        if (stat(CATALOG_FILE_NAME, &current) != 0 || current.st_ino != opened.st_ino) {
+            close(fileDescriptor);
+            fileDescriptor = -1;
+        }
+    }
+
+    return fileDescriptor;
+}
+
+/*
+ * NAME: addToCatalog
+ * PARAMS: Pointer to catalog lines and their total length
+ * RETURN: void
+ * DESCRIPTION: Appends lines to the catalog with a single write
+ */
+void addToCatalog(char* lines, size_t length) {
+    int fileDescriptor = openCatalog(LOCK_SH);
+
+    if (write(fileDescriptor, lines, length) != (ssize_t)length) {
+        printf("ERROR: Failed to write %s. Exiting.\n", CATALOG_FILE_NAME);
+        exit(1);
+    }
+
+    close(fileDescriptor);
+}
+
+/*
+ * NAME: setLatestWorld
+ * PARAMS: Pointer to the world's name
+ * RETURN: void
+ * DESCRIPTION: Points the latest link at a world
+ */
+void setLatestWorld(char* worldName) {
+    char tempLinkName[CATALOG_NAME_SIZE];
+
+    snprintf(tempLinkName, sizeof(tempLinkName), "%s.%d.tmp", LATEST_LINK_NAME, getpid());
+    unlink(tempLinkName);
+    if (symlink(worldName, tempLinkName) != 0 || rename(tempLinkName, LATEST_LINK_NAME) != 0) {
+        printf("ERROR: Failed to update %s. Exiting.\n", LATEST_LINK_NAME);
+        exit(1);
+    }
+}
+
+/*
+ * NAME: unshareWorld
+ * PARAMS: Pointer to the world's name
+ * RETURN: void
+ * DESCRIPTION: Removes the shared memory copy of a world published by
+ * eganch.adventure --shared, if there is one, so it is not left behind when
+ * the world is deleted or goes stale when it is edited. Processes attached
+ * to it keep it until they exit.
+ */
+void unshareWorld(char* worldName) {
+    char sharedName[SHARED_WORLD_NAME_SIZE];
+
+    if (getSharedWorldName(worldName, sharedName) == 1) {
+        shm_unlink(sharedName);
+    }
+}
+
+/*
+ * NAME: removeWorld
+ * PARAMS: Pointer to the world's name
+ * RETURN: Int indicating if the world was removed
+ * DESCRIPTION: Deletes a packed world file, or a room directory and the room
+ * files in it, the world's journal and its shared memory copy. Returns 0 on
+ * success, 1 if the world was already gone.
+ */
+int removeWorld(char* worldName) {
+    char journalName[CATALOG_NAME_SIZE + sizeof(JOURNAL_SUFFIX)];
+
+    unshareWorld(worldName);
+    makeJournalName(worldName, journalName, sizeof(journalName));
+    unlink(journalName);
+
+    if (unlink(worldName) == 0) {
+        return TRUE;
+    }
+    if (errno != EISDIR) {
+        return FALSE;
+    }
+
+    DIR* worldDir = opendir(worldName);
+    if (worldDir == NULL) {
+        return FALSE;
+    }
+
+    struct dirent* fileInDir;
+    while ((fileInDir = readdir(worldDir)) != NULL) {
+        if (fileInDir->d_name[0] != '.') {
+            unlinkat(dirfd(worldDir), fileInDir->d_name, 0);
+        }
+    }
+    closedir(worldDir);
+
+    return (rmdir(worldName) == 0) ? TRUE : FALSE;
+}
+
+/*
+ * NAME: pruneWorlds
+ * PARAMS: Int holding the number of worlds to keep
+ * RETURN: void
+ * DESCRIPTION: Deletes every catalogued world except the newest ones and
+ * rewrites the catalog to match. If the latest link pointed at a deleted
+ * world it is moved to the newest world kept.
+ */
+void pruneWorlds(int keep) {
+    struct CatalogEntry entry;
+    struct timespec start, end;
+    struct stat catalogAttributes;
+    char tempCatalogName[CATALOG_NAME_SIZE];
+    char latestName[CATALOG_NAME_SIZE];
+    int numEntries = 0,
+        removed = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int fileDescriptor = openCatalog(LOCK_EX);
+    fstat(fileDescriptor, &catalogAttributes);
+
+    char* catalog = malloc(catalogAttributes.st_size + 1);
+    assert(catalog != NULL);
+    if (pread(fileDescriptor, catalog, catalogAttributes.st_size, 0) != catalogAttributes.st_size) {
+        printf("ERROR: Failed to read %s. Exiting.\n", CATALOG_FILE_NAME);
+        exit(1);
+    }
+    catalog[catalogAttributes.st_size] = '\0';
+
+    /* A build that died while appending can leave a last line with no newline, drop it */
+    char* lastNewline = strrchr(catalog, '\n');
+    size_t catalogSize = (lastNewline != NULL) ? (size_t)(lastNewline + 1 - catalog) : 0;
+    catalog[catalogSize] = '\0';
+
+    char* line;
+    for (line = catalog; *line != '\0'; line = strchr(line, '\n') + 1) {
+        numEntries++;
+    }
+
+    /* The oldest worlds come first, delete them and keep the rest of the file */
+    int i;
+    line = catalog;
+    for (i = 0; i < numEntries - keep; i++) {
+        if (parseCatalogEntry(line, &entry) == 0 && removeWorld(entry.name) == TRUE) {
+            removed++;
+        }
+        line = strchr(line, '\n') + 1;
+    }
+
+    snprintf(tempCatalogName, sizeof(tempCatalogName), "%s.%d.tmp", CATALOG_FILE_NAME, getpid());
+    int tempDescriptor = open(tempCatalogName, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    size_t keptSize = catalog + catalogSize - line;
+    if (tempDescriptor < 0 || write(tempDescriptor, line, keptSize) != (ssize_t)keptSize
+        || close(tempDescriptor) != 0 || rename(tempCatalogName, CATALOG_FILE_NAME) != 0) {
+        printf("ERROR: Failed to write %s. Exiting.\n", CATALOG_FILE_NAME);
+        exit(1);
+    }
+
+    ssize_t length = readlink(LATEST_LINK_NAME, latestName, sizeof(latestName) - 1);
+    if (length > 0) {
+        latestName[length] = '\0';
+        if (access(latestName, F_OK) != 0) {
+            /* The last kept line is the newest world */
+            char* newest = NULL;
+            char* next;
+            for (next = line; *next != '\0'; next = strchr(next, '\n') + 1) {
+                newest = next;
+            }
+
+            if (newest != NULL && parseCatalogEntry(newest, &entry) == 0) {
+                setLatestWorld(entry.name);
+            } else {
+                unlink(LATEST_LINK_NAME);
+            }
+        }
+    }
+
+    close(fileDescriptor);
+    free(catalog);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("PRUNED: %d WORLDS KEPT: %d IN %.6f SECONDS\n", removed, (numEntries < keep) ? numEntries : keep,
+           (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+}
+
+/*
+ * NAME: claimWorlds
+ * PARAMS: Int holding the number of worlds to claim
+ * RETURN: The first world number claimed, numWorlds or more once all are taken
+ * DESCRIPTION: Hands the next batch of world numbers to a worker
+ */
+int claimWorlds(int batchSize) {
+    pthread_mutex_lock(&reportLock);
+    int first = nextWorld;
+    nextWorld += batchSize;
+    pthread_mutex_unlock(&reportLock);
+
+    return first;
+}
+
+/*
+ * NAME: runBuildWorker
+ * PARAMS: Unused thread argument
+ * RETURN: NULL
+ * DESCRIPTION: Thread pool worker. Claims worlds a batch at a time, makes the
+ * batch's directories in one pass, then builds each world in the batch.
+ */
+void* runBuildWorker(void* arg) {
+    struct World batch[WORLD_BATCH_SIZE];
+    char catalogLines[WORLD_BATCH_SIZE * CATALOG_LINE_SIZE];
+    int batchSize = numWorlds / (numJobs * 4);
+    (void)arg;
+
+    if (batchSize < 1) {
+        batchSize = 1;
+    } else if (batchSize > WORLD_BATCH_SIZE) {
+        batchSize = WORLD_BATCH_SIZE;
+    }
+
+    int first;
+    while ((first = claimWorlds(batchSize)) < numWorlds) {
+        int count = (numWorlds - first < batchSize) ? numWorlds - first : batchSize;
+
+        size_t catalogUsed = 0;
+
+        int i;
+        for (i = 0; i < count; i++) {
+            memset(&batch[i], 0, sizeof(struct World));
+            batch[i].worldNumber = first + i;
+            if (format == TEXT_FORMAT) {
+                makeDirectory(&batch[i]);
+            }
+        }
+
+        for (i = 0; i < count; i++) {
+            struct World* world = &batch[i];
+            buildWorld(world);
+
+            pthread_mutex_lock(&reportLock);
+            filesWritten += (format == TEXT_FORMAT) ? numRooms : 1;
+            if (printReport == TRUE) {
+                if (numWorlds > 1) {
+                    printf("WORLD: %d ", world->worldNumber);
+                }
+                printf("SEED: %llu ROOMS: %d CONNECTIONS: %lld RETRIES: %lld FALLBACK SCANS: %lld EDGE SWAPS: %lld "
+                       "COMPONENTS JOINED: %lld\n",
+                       (unsigned long long)seed, numRooms, world->connectionsAdded, world->connectionRetries,
+                       world->fallbackScans, world->edgeSwaps, world->componentsJoined);
+                if (streaming == TRUE) {
+                    struct rusage usage;
+                    getrusage(RUSAGE_SELF, &usage);
+                    printf("WINDOW: %d BYTES: %llu SECONDS: %.6f BYTES PER SECOND: %.1f PEAK RSS: %ld KB\n",
+                           world->windowSize, (unsigned long long)world->output.bytesWritten,
+                           world->streamSeconds, world->output.bytesWritten / world->streamSeconds,
+                           usage.ru_maxrss);
+                }
+            }
+            if (world->worldNumber == numWorlds - 1) {
+                strncpy(latestWorldName, (format == TEXT_FORMAT) ? world->directoryName : world->worldFileName,
+                        CATALOG_NAME_SIZE - 1);
+            }
+            pthread_mutex_unlock(&reportLock);
+
+            catalogUsed += formatWorldEntry(world, catalogLines + catalogUsed, CATALOG_LINE_SIZE);
+            addWorldStats(world);
+            freeWorld(world);
+        }
+
+        /* An embedded world is not on disk, so it is not catalogued */
+        if (embedFileName == NULL) {
+            addToCatalog(catalogLines, catalogUsed);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * NAME: buildWorlds
+ * PARAMS: none
+ * RETURN: void
+ * DESCRIPTION: Builds numWorlds worlds on numJobs threads and, when there is
+ * more than one world, reports worlds and files written per second. World i
+ * always comes from stream i of the seed so the output does not depend on the
+ * number of jobs. Every world is added to the catalog and the last one
+ * becomes the latest world, unless it was only written as a C header.
+ */
+void buildWorlds() {
+    pthread_t threads[MAX_JOBS];
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (numJobs == 1) {
+        runBuildWorker(NULL);
+    } else {
+        int i;
+        for (i = 0; i < numJobs; i++) {
+            int result = pthread_create(&threads[i], NULL, runBuildWorker, NULL);
+            assert(result == TRUE);
+        }
+        for (i = 0; i < numJobs; i++) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    if (embedFileName == NULL) {
+        setLatestWorld(latestWorldName);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    if (numWorlds > 1) {
+        printf("WORLDS: %d JOBS: %d FILES: %lld SECONDS: %.6f WORLDS PER SECOND: %.1f FILES PER SECOND: %.1f\n",
+               numWorlds, numJobs, filesWritten, seconds, numWorlds / seconds, filesWritten / seconds);
+    }
+}
+
+/*
+ * NAME: readEdits
+ * PARAMS: Pointer to an int for the number of edits
+ * RETURN: Array of the edits
+ * DESCRIPTION: Reads the edits for --edit from standard input, one journal
+ * line each. Blank lines are skipped.
+ */
+struct JournalEdit* readEdits(int* numEdits) {
+    char line[JOURNAL_LINE_SIZE];
+    struct JournalEdit* edits = NULL;
+    int size = 0;
+    int lineNumber = 0;
+
+    *numEdits = 0;
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        lineNumber++;
+        if (strspn(line, " \t\r\n") == strlen(line)) {
+            continue;
+        }
+
+        if (*numEdits == size) {
+            size = (size > 0) ? size * 2 : 16;
+            edits = realloc(edits, size * sizeof(struct JournalEdit));
+            assert(edits != NULL);
+        }
+        if (parseJournalEdit(line, &edits[*numEdits]) != 0) {
+            printf("ERROR: Line %d is not an edit. Exiting.\n", lineNumber);
+            exit(1);
+        }
+        (*numEdits)++;
+    }
+
+    return edits;
+}
+
+/*
+ * NAME: finishEdits
+ * PARAMS: Pointer to the journal's name, the edits, the number applied and,
+ * if one could not be applied, why
+ * RETURN: void
+ * DESCRIPTION: Appends the applied edits to the journal in one write. If an
+ * edit failed, the ones before it stay applied and journaled and the rest
+ * are dropped.
+ */
+void finishEdits(char* journalName, struct JournalEdit* edits, int numApplied, const char* error) {
+    char* lines = malloc((size_t)numApplied * JOURNAL_LINE_SIZE + 1);
+    size_t used = 0;
+    assert(lines != NULL);
+
+    int i;
+    for (i = 0; i < numApplied; i++) {
+        used += formatJournalEdit(&edits[i], lines + used, JOURNAL_LINE_SIZE);
+    }
+    if (used > 0 && appendJournal(journalName, lines, used) != 0) {
+        printf("ERROR: Failed to write journal %s. Exiting.\n", journalName);
+        exit(1);
+    }
+    free(lines);
+
+    if (error != NULL) {
+        printf("ERROR: Edit %d (%s %s) cannot be applied, %s. ", numApplied + 1,
+               journalOperationNames[edits[numApplied].operation], edits[numApplied].room, error);
+        if (numApplied > 0) {
+            printf("The %d edits before it were applied. ", numApplied);
+        }
+        printf("Exiting.\n");
+        exit(1);
+    }
+}
+
+/* One room file of a rooms directory being edited */
+struct RoomFile {
+    char name[JOURNAL_NAME_SIZE];
+    enum roomTypes type;
+    int numConnections;
+    int capacity;
+    char (*connections)[JOURNAL_NAME_SIZE];
+};
+
+/*
+ * NAME: readRoomFile
+ * PARAMS: Pointer to the world, pointer to the room name and pointer to the room to fill
+ * RETURN: Int indicating if the room exists
+ * DESCRIPTION: Reads one room file of the world being edited, leaving space
+ * for one more connection. Returns 0 if it was read, 1 if there is no such room.
+ */
+int readRoomFile(struct World* world, const char* roomName, struct RoomFile* room) {
+    const char* roomTypesLabel[] = {"START_ROOM", "END_ROOM", "MID_ROOM"};
+    struct stat fileAttributes;
+
+    if (!isValidRoomName(roomName)) {
+        return FALSE;
+    }
+    int fileDescriptor = openat(world->directoryFd, roomName, O_RDONLY);
+    if (fileDescriptor < 0) {
+        return FALSE;
+    }
+
+    int result = fstat(fileDescriptor, &fileAttributes);
+    assert(result == TRUE);
+    char* text = malloc(fileAttributes.st_size + 1);
+    assert(text != NULL);
+    if (read(fileDescriptor, text, fileAttributes.st_size) != fileAttributes.st_size) {
+        printf("ERROR: Failed to read room file %s/%s. Exiting.\n", world->directoryName, roomName);
+        exit(1);
+    }
+    close(fileDescriptor);
+    text[fileAttributes.st_size] = '\0';
+
+    /* Each connection is on a line of its own */
+    int numLines = 0;
+    char* line;
+    for (line = text; *line != '\0'; line++) {
+        numLines += (*line == '\n');
+    }
+
+    strncpy(room->name, roomName, JOURNAL_NAME_SIZE - 1);
+    room->name[JOURNAL_NAME_SIZE - 1] = '\0';
+    room->type = MID_ROOM;
+    room->numConnections = 0;
+    room->capacity = numLines + 1;
+    room->connections = malloc(room->capacity * JOURNAL_NAME_SIZE);
+    assert(room->connections != NULL);
+
+    char* nextLine;
+    for (line = text; *line != '\0'; line = nextLine) {
+        nextLine = line + strcspn(line, "\n");
+        if (*nextLine == '\n') {
+            *nextLine++ = '\0';
+        }
+
+        char* colon = strchr(line, ':');
+        if (strncmp(line, "CONNECTION", 10) == TRUE && colon != NULL) {
+            /* Skip a damaged line with no name after the "CONNECTION N: " label */
+            if (colon[1] == ' ' && colon[2] != '\0') {
+                snprintf(room->connections[room->numConnections++], JOURNAL_NAME_SIZE, "%s", colon + 2);
+            }
+        } else if (strncmp(line, "ROOM TYPE: ", 11) == TRUE) {
+            int i;
+            for (i = START_ROOM; i <= MID_ROOM; i++) {
+                if (strcmp(line + 11, roomTypesLabel[i]) == TRUE) {
+                    room->type = i;
+                }
+            }
+        }
+    }
+
+    free(text);
+    return TRUE;
+}
+
+/*
+ * NAME: replaceRoomFile
+ * PARAMS: Pointer to the world and pointer to an edited room
+ * RETURN: void
+ * DESCRIPTION: Writes an edited room's file beside the directory, syncs it,
+ * and renames it over the old one, so the room is never seen half written
+ */
+void replaceRoomFile(struct World* world, struct RoomFile* room) {
+    const char* roomTypesLabel[] = {"START_ROOM", "END_ROOM", "MID_ROOM"};
+    char tempFileName[MAX_PATH_LENGTH];
+    char* text = malloc(((size_t)room->numConnections + 2) * (JOURNAL_NAME_SIZE + ROOM_LINE_SIZE));
+    assert(text != NULL);
+
+    int length = sprintf(text, "ROOM NAME: %s\n", room->name);
+
+    int j;
+    for (j = 0; j < room->numConnections; j++) {
+        length += sprintf(text + length, "CONNECTION %d: %s\n", j + 1, room->connections[j]);
+    }
+
+    length += sprintf(text + length, "ROOM TYPE: %s\n", roomTypesLabel[room->type]);
+
+    snprintf(tempFileName, sizeof(tempFileName), "%s.edit.tmp", world->directoryName);
+    int fileDescriptor = open(tempFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fileDescriptor < 0 || write(fileDescriptor, text, length) != length || fsync(fileDescriptor) != 0
+        || close(fileDescriptor) != 0 || renameat(AT_FDCWD, tempFileName, world->directoryFd, room->name) != 0) {
+        printf("ERROR: Failed to write room file %s/%s. Exiting.\n", world->directoryName, room->name);
+        exit(1);
+    }
+    world->filesCreated++;
+
+    free(text);
+}
+
+/*
+ * NAME: findRoomConnection
+ * PARAMS: Pointer to a room and pointer to a room name
+ * RETURN: The connection's number, -1 if the room is not connected to that room
+ * DESCRIPTION: Looks for a connection by name
+ */
+int findRoomConnection(struct RoomFile* room, const char* roomName) {
+    int i;
+    for (i = 0; i < room->numConnections; i++) {
+        if (strcmp(room->connections[i], roomName) == TRUE) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * NAME: findRoomOfType
+ * PARAMS: Pointer to the world, the room type and pointer to the room to fill
+ * RETURN: void
+ * DESCRIPTION: Finds the start or end room. Room files only say what type
+ * they are, so this reads them until it finds the one.
+ */
+void findRoomOfType(struct World* world, enum roomTypes type, struct RoomFile* room) {
+    DIR* roomsDir = opendir(world->directoryName);
+    struct dirent* fileInDir;
+    assert(roomsDir != NULL);
+
+    while ((fileInDir = readdir(roomsDir)) != NULL) {
+        if (fileInDir->d_name[0] != '.' && readRoomFile(world, fileInDir->d_name, room) == TRUE) {
+            if (room->type == type) {
+                closedir(roomsDir);
+                return;
+            }
+            free(room->connections);
+        }
+    }
+
+    printf("ERROR: World %s has no %s room. Exiting.\n", world->directoryName, (type == START_ROOM) ? "start" : "end");
+    exit(1);
+}
+
+/*
+ * NAME: applyRoomFileEdit
+ * PARAMS: Pointer to the world and pointer to the edit
+ * RETURN: NULL if the edit was applied, otherwise why it could not be
+ * DESCRIPTION: Applies an edit to a rooms directory by rewriting only the
+ * room files it changes: the two rooms for a connection, the room and
+ * every room connected to it for a rename, the old and new room for a move
+ * of the start or end. Checked the same way as an edit to a packed world.
+ */
+const char* applyRoomFileEdit(struct World* world, struct JournalEdit* edit) {
+    struct RoomFile room, other;
+    const char* error = NULL;
+
+    if (readRoomFile(world, edit->room, &room) == FALSE) {
+        return "no room has that name";
+    }
+    other.connections = NULL;
+
+    if (edit->operation == ADD_EDIT || edit->operation == REMOVE_EDIT) {
+        int connection = findRoomConnection(&room, edit->other);
+
+        if (strcmp(edit->room, edit->other) == TRUE) {
+            error = "a room cannot connect to itself";
+        } else if (readRoomFile(world, edit->other, &other) == FALSE) {
+            error = "no room has that name";
+        } else if (edit->operation == ADD_EDIT) {
+            if (connection >= 0) {
+                error = "the rooms are already connected";
+            } else if (room.numConnections >= maxConnections || other.numConnections >= maxConnections) {
+                error = "a room would have too many connections";
+            } else {
+                strcpy(room.connections[room.numConnections++], other.name);
+                strcpy(other.connections[other.numConnections++], room.name);
+            }
+        } else {
+            int otherConnection = findRoomConnection(&other, room.name);
+
+            if (connection < 0 || otherConnection < 0) {
+                error = "the rooms are not connected";
+            } else if (room.numConnections <= minConnections || other.numConnections <= minConnections) {
+                error = "a room would have too few connections";
+            } else {
+                memmove(room.connections[connection], room.connections[connection + 1],
+                        (room.numConnections-- - connection - 1) * JOURNAL_NAME_SIZE);
+                memmove(other.connections[otherConnection], other.connections[otherConnection + 1],
+                        (other.numConnections-- - otherConnection - 1) * JOURNAL_NAME_SIZE);
+            }
+        }
+
+        if (error == NULL) {
+            replaceRoomFile(world, &room);
+            replaceRoomFile(world, &other);
+        }
+    } else if (edit->operation == RENAME_EDIT) {
+        if (!isValidRoomName(edit->other)) {
+            error = "the new name is not a valid room name";
+        } else if (faccessat(world->directoryFd, edit->other, F_OK, 0) == TRUE) {
+            error = "a room already has the new name";
+        } else {
+            /* Write the room under its new name before anything points at it */
+            strcpy(room.name, edit->other);
+            replaceRoomFile(world, &room);
+
+            int i;
+            for (i = 0; i < room.numConnections; i++) {
+                if (readRoomFile(world, room.connections[i], &other) == TRUE) {
+                    int connection = findRoomConnection(&other, edit->room);
+                    if (connection >= 0) {
+                        strcpy(other.connections[connection], edit->other);
+                        replaceRoomFile(world, &other);
+                    }
+                    free(other.connections);
+                    other.connections = NULL;
+                }
+            }
+
+            if (unlinkat(world->directoryFd, edit->room, 0) != 0) {
+                printf("ERROR: Failed to remove room file %s/%s. Exiting.\n", world->directoryName, edit->room);
+                exit(1);
+            }
+        }
+    } else {
+        enum roomTypes type = (edit->operation == START_EDIT) ? START_ROOM : END_ROOM;
+        enum roomTypes otherType = (edit->operation == START_EDIT) ? END_ROOM : START_ROOM;
+
+        if (room.type == otherType) {
+            error = (type == START_ROOM) ? "the end room cannot also be the start room"
+                                         : "the start room cannot also be the end room";
+        } else if (room.type != type) {
+            findRoomOfType(world, type, &other);
+            other.type = MID_ROOM;
+            room.type = type;
+            replaceRoomFile(world, &room);
+            replaceRoomFile(world, &other);
+        }
+    }
+
+    free(room.connections);
+    free(other.connections);
+    return error;
+}
+
+/*
+ * NAME: editRoomFiles
+ * PARAMS: Pointer to the rooms directory's name, the edits and their number
+ * RETURN: void
+ * DESCRIPTION: Applies edits to a rooms directory, then syncs the directory
+ * and journals them
+ */
+void editRoomFiles(char* worldName, struct JournalEdit* edits, int numEdits) {
+    char journalName[MAX_PATH_LENGTH];
+    struct World world;
+    const char* error = NULL;
+
+    memset(&world, 0, sizeof(world));
+    world.directoryName = worldName;
+    world.directoryFd = open(worldName, O_RDONLY | O_DIRECTORY);
+    assert(world.directoryFd >= 0);
+    makeJournalName(worldName, journalName, sizeof(journalName));
+
+    int i;
+    for (i = 0; i < numEdits && error == NULL; i++) {
+        error = applyRoomFileEdit(&world, &edits[i]);
+    }
+    if (error != NULL) {
+        i--;
+    }
+
+    fsync(world.directoryFd);
+    close(world.directoryFd);
+    finishEdits(journalName, edits, i, error);
+
+    printf("EDITED %s: %d EDITS, %lld ROOM FILES WRITTEN\n", worldName, numEdits, world.filesCreated);
+}
+
+/*
+ * NAME: editWorldFile
+ * PARAMS: Pointer to the packed world file's name, the edits and their number
+ * RETURN: void
+ * DESCRIPTION: Checks edits against a packed world with its journal
+ * replayed, then journals them. The world file itself is left untouched.
+ */
+void editWorldFile(char* worldName, struct JournalEdit* edits, int numEdits) {
+    char journalName[MAX_PATH_LENGTH];
+    struct WorldEdits worldEdits;
+    struct stat fileAttributes;
+    int lineNumber;
+
+    int fileDescriptor = open(worldName, O_RDONLY);
+    if (fileDescriptor < 0 || fstat(fileDescriptor, &fileAttributes) != 0
+        || (size_t)fileAttributes.st_size < sizeof(struct WorldHeader)) {
+        printf("ERROR: Failed to open world file %s. Exiting.\n", worldName);
+        exit(1);
+    }
+    void* mapping = mmap(NULL, fileAttributes.st_size, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+    assert(mapping != MAP_FAILED);
+    close(fileDescriptor);
+
+    if (!isValidWorldHeader(mapping, fileAttributes.st_size) || !isValidWorldImage(mapping)) {
+        printf("ERROR: %s is not a valid world file. Exiting.\n", worldName);
+        exit(1);
+    }
+
+    makeJournalName(worldName, journalName, sizeof(journalName));
+    initWorldEdits(&worldEdits, mapping);
+    const char* error = replayJournal(&worldEdits, journalName, &lineNumber);
+    if (error != NULL) {
+        printf("ERROR: Line %d of %s cannot be replayed, %s. Exiting.\n", lineNumber, journalName, error);
+        exit(1);
+    }
+
+    int i;
+    for (i = 0; i < numEdits && error == NULL; i++) {
+        error = applyJournalEdit(&worldEdits, &edits[i], minConnections, maxConnections);
+    }
+    if (error != NULL) {
+        i--;
+    }
+    finishEdits(journalName, edits, i, error);
+
+    printf("EDITED %s: %d EDITS, %lld IN JOURNAL\n", worldName, numEdits, worldEdits.numEdits);
+
+    freeWorldEdits(&worldEdits);
+    munmap(mapping, fileAttributes.st_size);
+}
+
+/*
+ * NAME: editWorld
+ * PARAMS: none
+ * RETURN: void
+ * DESCRIPTION: Applies the edits on standard input to the world named by
+ * --edit, or to the newest world if it is "latest", and drops the world's
+ * now stale shared memory copy
+ */
+void editWorld() {
+    char worldName[CATALOG_NAME_SIZE];
+    struct stat worldAttributes;
+
+    memset(worldName, '\0', sizeof(worldName));
+    if (strcmp(editWorldName, LATEST_WORLD) == TRUE) {
+        if (readlink(LATEST_LINK_NAME, worldName, sizeof(worldName) - 1) < 0) {
+            printf("ERROR: There is no latest world. Exiting.\n");
+            exit(1);
+        }
+    } else {
+        strncpy(worldName, editWorldName, sizeof(worldName) - 1);
+    }
+
+    if (stat(worldName, &worldAttributes) != 0) {
+        printf("ERROR: Failed to find world %s. Exiting.\n", worldName);
+        exit(1);
+    }
+
+    int numEdits;
+    struct JournalEdit* edits = readEdits(&numEdits);
+
+    if (S_ISDIR(worldAttributes.st_mode)) {
+        editRoomFiles(worldName, edits, numEdits);
+    } else {
+        editWorldFile(worldName, edits, numEdits);
+    }
+    unshareWorld(worldName);
+
+    free(edits);
+}
+
+/*
+ * NAME: printUsage
+ * PARAMS: Pointer to the program name
+ * RETURN: void
+ * DESCRIPTION: Prints the command line options
+ */
+void printUsage(char* programName) {
+    printf("USAGE: %s [--rooms N] [--min-connections N] [--max-connections N]\n", programName);
+    printf("       [--generator linear|legacy] [--format text|binary] [--seed N] [--report]\n");
+    printf("       [--count N] [--jobs N] [--stream] [--memory-limit MB] [--sync N] [--stats FILE]\n");
+    printf("       [--embed FILE]\n");
+    printf("       %s --prune N\n", programName);
+    printf("       %s --edit WORLD [--min-connections N] [--max-connections N] < EDITS\n", programName);
+    printf("  --rooms N            number of rooms to generate (default %d)\n", NUM_ROOMS);
+    printf("  --min-connections N  fewest connections a room may have (default %d)\n", MIN_NUM_CONNECTIONS);
+    printf("  --max-connections N  most connections a room may have (default %d)\n", NUM_CONNECTIONS);
+    printf("  --generator NAME     linear (default) or legacy rejection sampling\n");
+    printf("  --format NAME        text (default) directory of room files, or one binary world file\n");
+    printf("  --seed N             seed for the world, the same seed always builds the same world\n");
+    printf("  --report             print the seed, connection and retry counts when done\n");
+    printf("  --count N            number of worlds to generate (default 1)\n");
+    printf("  --jobs N             threads generating worlds at once (default one per core)\n");
+    printf("  --stream             write rooms as they are finished instead of holding the whole world\n");
+    printf("  --memory-limit MB    memory each streamed world may use (default %d)\n", MEMORY_LIMIT_MB);
+    printf("  --sync N             fsync room files N at a time (1 to %d) and world files before they are\n",
+           MAX_SYNC_BATCH);
+    printf("                       renamed into place, so a finished world survives a crash\n");
+    printf("  --prune N            delete all but the newest N catalogued worlds and exit\n");
+    printf("  --edit WORLD         apply the edits on standard input to a rooms directory or world file\n");
+    printf("                       (\"%s\" for the newest), one per line, and add them to its journal:\n",
+           LATEST_WORLD);
+    printf("                       add ROOM ROOM, remove ROOM ROOM, rename ROOM NAME, start ROOM, end ROOM\n");
+    printf("                       Rooms keep between the minimum and maximum number of connections.\n");
+    printf("  --embed FILE         write the world only as a C header of static const arrays, for\n");
+    printf("                       building eganch.adventure with -DEMBEDDED_WORLD='\"FILE\"'; it is\n");
+    printf("                       not stored, catalogued or made the latest world\n");
+    printf("  --stats FILE         append counters and phase times to FILE (- for standard error)\n");
+    printf("                       as JSON at exit and on SIGUSR1\n");
+}
+
+/*
+ * NAME: parseArguments
+ * PARAMS: Argument count and argument vector from main
+ * RETURN: void
+ * DESCRIPTION: Reads the command line options into the world dimensions
+ * and validates that a world with those dimensions can be built.
+ */
+void parseArguments(int argc, char** argv) {
+    static struct option longOptions[] = {
+        {"rooms", required_argument, NULL, 'r'},
+        {"min-connections", required_argument, NULL, 'm'},
+        {"max-connections", required_argument, NULL, 'M'},
+        {"generator", required_argument, NULL, 'g'},
+        {"format", required_argument, NULL, 'f'},
+        {"seed", required_argument, NULL, 's'},
+        {"report", no_argument, NULL, 'p'},
+        {"count", required_argument, NULL, 'c'},
+        {"jobs", required_argument, NULL, 'j'},
+        {"stream", no_argument, NULL, 'S'},
+        {"memory-limit", required_argument, NULL, 'L'},
+        {"sync", required_argument, NULL, 'y'},
+        {"prune", required_argument, NULL, 'P'},
+        {"edit", required_argument, NULL, 'e'},
+        {"stats", required_argument, NULL, 'd'},
+        {"embed", required_argument, NULL, 'E'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    long long megabytes;
+    char* end;
+    int option;
+
+    while ((option = getopt_long(argc, argv, "r:m:M:g:f:s:pc:j:SL:y:P:e:d:E:h", longOptions, NULL)) != -1) {
+        switch (option) {
+            case 'r':
+                numRooms = atoi(optarg);
+                break;
+            case 'm':
+                minConnections = atoi(optarg);
+                break;
+            case 'M':
+                maxConnections = atoi(optarg);
+                break;
+            case 'g':
+                if (strcmp(optarg, "linear") == TRUE) {
+                    generator = LINEAR_GENERATOR;
+                } else if (strcmp(optarg, "legacy") == TRUE) {
+                    generator = LEGACY_GENERATOR;
+                } else {
+                    printf("ERROR: Unknown generator %s. Exiting.\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'f':
+                if (strcmp(optarg, "text") == TRUE) {
+                    format = TEXT_FORMAT;
+                } else if (strcmp(optarg, "binary") == TRUE) {
+                    format = BINARY_FORMAT;
+                } else {
+                    printf("ERROR: Unknown format %s. Exiting.\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 10);
+                seedGiven = TRUE;
+                break;
+            case 'p':
+                printReport = TRUE;
+                break;
+            case 'c':
+                numWorlds = atoi(optarg);
+                break;
+            case 'j':
+                numJobs = atoi(optarg);
+                if (numJobs < 1 || numJobs > MAX_JOBS) {
+                    printf("ERROR: Number of jobs must be between 1 and %d. Exiting.\n", MAX_JOBS);
+                    exit(1);
+                }
+                break;
+            case 'S':
+                streaming = TRUE;
+                break;
+            case 'L':
+                megabytes = strtoll(optarg, &end, 10);
+                if (*end != '\0' || megabytes < 1 || megabytes > (LLONG_MAX >> 20)) {
+                    printf("ERROR: Memory limit must be between 1 and %lld MB. Exiting.\n", LLONG_MAX >> 20);
+                    exit(1);
+                }
+                memoryLimit = megabytes << 20;
+                break;
+            case 'y':
+                syncBatch = atoi(optarg);
+                if (syncBatch < 1 || syncBatch > MAX_SYNC_BATCH) {
+                    printf("ERROR: Sync batch must be between 1 and %d. Exiting.\n", MAX_SYNC_BATCH);
+                    exit(1);
+                }
+                break;
+            case 'P':
+                pruneKeep = atoi(optarg);
+                if (pruneKeep < 0) {
+                    printf("ERROR: Number of worlds to keep must be at least 0. Exiting.\n");
+                    exit(1);
+                }
+                break;
+            case 'e':
+                editWorldName = optarg;
+                break;
+            case 'd':
+                statsFileName = optarg;
+                statsEnabled = TRUE;
+                break;
+            case 'E':
+                embedFileName = optarg;
+                break;
+            case 'h':
+                printUsage(argv[0]);
+                exit(0);
+            default:
+                printUsage(argv[0]);
+                exit(1);
+        }
+    }
+
+    /* Only streamed binary worlds can go past the rooms that fit in memory */
+    int maxRooms = (streaming == TRUE && format == BINARY_FORMAT) ? MAX_STREAM_ROOMS : MAX_NUM_ROOMS;
+    if (numRooms < 2 || numRooms > maxRooms) {
+        printf("ERROR: Number of rooms must be between 2 and %d. Exiting.\n", maxRooms);
+        exit(1);
+    }
+    if (minConnections < 1 || minConnections > maxConnections) {
+        printf("ERROR: Minimum connections must be between 1 and the maximum. Exiting.\n");
+        exit(1);
+    }
+    if (maxConnections > numRooms - 1 && editWorldName == NULL) {
+        printf("ERROR: Maximum connections must be less than the number of rooms. Exiting.\n");
+        exit(1);
+    }
+    if (maxConnections < 2 && numRooms > 2) {
+        printf("ERROR: Maximum connections must be at least 2 to join every room into one world. Exiting.\n");
+        exit(1);
+    }
+    if (numWorlds < 1) {
+        printf("ERROR: Number of worlds must be at least 1. Exiting.\n");
+        exit(1);
+    }
+    if (embedFileName != NULL && (numWorlds > 1 || streaming == TRUE)) {
+        printf("ERROR: --embed builds one world in memory, not with --count or --stream. Exiting.\n");
+        exit(1);
+    }
+
+    if (numJobs == 0) {
+        numJobs = sysconf(_SC_NPROCESSORS_ONLN);
+        if (numJobs < 1) {
+            numJobs = 1;
+        } else if (numJobs > MAX_JOBS) {
+            numJobs = MAX_JOBS;
+        }
+    }
+    if (numJobs > numWorlds) {
+        numJobs = numWorlds;
+    }
+}
+
+int main(int argc, char** argv) {
+    parseArguments(argc, argv);
+
+    if (pruneKeep >= 0) {
+        pruneWorlds(pruneKeep);
+        return 0;
+    }
+
+    if (editWorldName != NULL) {
+        editWorld();
+        return 0;
+    }
+
+    if (seedGiven == FALSE) {
+        seed = ((uint64_t)time(NULL) << 20) ^ getpid();
+    }
+
+    if (statsEnabled == TRUE) {
+        statsStart = getStatsTime();
+        startStatsThread(writeStats);
+    }
+
+    buildWorlds();
+
+    if (statsEnabled == TRUE) {
+        finishStats(writeStats);
+    }
+
+    return 0;
+}
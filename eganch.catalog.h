@@ -0,0 +1,62 @@
+/*
+ * FILE NAME: eganch.catalog.h
+ * DESCRIPTION: The world catalog shared by eganch.buildrooms (which adds to
+ * it and prunes it) and eganch.adventure (which opens worlds through it).
+ * The catalog is a text file with one line per world:
+ *   id seed rooms format created name
+ * where created is the Unix time the world was finished and name is the
+ * world's directory or packed world file. Lines are only ever appended, with
+ * one write per batch of worlds under a shared lock; pruning takes the lock
+ * exclusively and renames a rewritten catalog into place. LATEST_LINK_NAME
+ * is a symbolic link to the newest world, replaced with a rename so it
+ * always points at a whole world.
+ * AUTHOR: Chelsea Egan (eganch@oregonstate.edu)
+ */
+
+#ifndef EGANCH_CATALOG_H
+#define EGANCH_CATALOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define CATALOG_FILE_NAME "eganch.catalog"
+#define LATEST_LINK_NAME "eganch.latest"
+#define LATEST_WORLD "latest"
+#define CATALOG_ID_SIZE 32
+#define CATALOG_FORMAT_SIZE 8
+#define CATALOG_NAME_SIZE 64
+#define CATALOG_LINE_SIZE 192
+
+struct CatalogEntry {
+    char id[CATALOG_ID_SIZE];
+    unsigned long long seed;
+    unsigned numRooms;
+    char format[CATALOG_FORMAT_SIZE];
+    long long created;
+    char name[CATALOG_NAME_SIZE];
+};
+
+/*
+ * NAME: formatCatalogEntry
+ * PARAMS: Pointer to the entry, pointer to a buffer and its size
+ * RETURN: Length of the line
+ * DESCRIPTION: Writes an entry as one catalog line, newline included
+ */
+static inline int formatCatalogEntry(const struct CatalogEntry* entry, char* line, size_t size) {
+    return snprintf(line, size, "%s %llu %u %s %lld %s\n", entry->id, entry->seed, entry->numRooms,
+                    entry->format, entry->created, entry->name);
+}
+
+/*
+ * NAME: parseCatalogEntry
+ * PARAMS: Pointer to a catalog line and pointer to the entry to fill
+ * RETURN: 0 if the line is a catalog entry, -1 otherwise
+ * DESCRIPTION: Reads one catalog line
+ */
+static inline int parseCatalogEntry(const char* line, struct CatalogEntry* entry) {
+    int fields = sscanf(line, "%31s %llu %u %7s %lld %63s", entry->id, &entry->seed, &entry->numRooms,
+                        entry->format, &entry->created, entry->name);
+    return (fields == 6) ? 0 : -1;
+}
+
+#endif
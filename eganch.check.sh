@@ -0,0 +1,104 @@
+#!/bin/bash
+#
+# PROGRAM NAME: eganch.check.sh
+# DESCRIPTION: Checks that eganch.adventure and eganch.buildrooms handle
+# damaged worlds without crashing. Each case copies a freshly built world,
+# damages one thing in it and runs a program over it:
+#   room files  a connection line with no colon, or no room name after it,
+#               must stop eganch.adventure with an ERROR and be skipped by
+#               eganch.buildrooms --edit
+#   world files a packed world with a connection to a room that does not
+#               exist, connection offsets that run backwards or past the
+#               connections, a name offset past the name table, a name table
+#               with no final NUL or a name index entry for no room must be
+#               refused by eganch.adventure without --verify and by
+#               eganch.buildrooms --edit
+# Prints one line per case and exits 1 if any case failed.
+# USAGE: ./eganch.check.sh
+# AUTHOR: Chelsea Egan (eganch@oregonstate.edu)
+#
+
+SEED=1
+FAILED=0
+
+WORK_DIR=$(mktemp -d eganch.check.XXXXXX)
+
+#
+# NAME: check
+# DESCRIPTION: Records one case: its name, the program's exit code, the
+# expected exit code, its output and the text the output must start with
+#
+check() {
+    if [ "$2" -eq "$3" ] && [ "${4#"$5"}" != "$4" ]; then
+        echo "PASS $1"
+    else
+        echo "FAIL $1: exit $2, expected $3: $4"
+        FAILED=1
+    fi
+}
+
+cp eganch.buildrooms eganch.adventure "$WORK_DIR" || exit 1
+cd "$WORK_DIR" || exit 1
+
+./eganch.buildrooms --seed "$SEED" > /dev/null || exit 1
+GOOD_ROOMS=$(readlink eganch.latest)
+ROOM=$(ls "$GOOD_ROOMS" | head -1)
+
+# Connection lines with no colon, no space after it and no name after that
+LABELS=(no_colon no_space no_name)
+LINES=("CONNECTION 1 garbage" "CONNECTION 1:" "CONNECTION 1: ")
+
+for i in "${!LABELS[@]}"; do
+    rm -rf damaged
+    cp -r "$GOOD_ROOMS" damaged
+    sed -i "2s/.*/${LINES[$i]}/" "damaged/$ROOM"
+
+    output=$(echo | ./eganch.adventure --world damaged --batch - 2>&1)
+    check "adventure room file ${LABELS[$i]}" $? 1 "$output" \
+          "ERROR: Room file $ROOM has a connection with no room name."
+
+    output=$(echo "start $ROOM" | ./eganch.buildrooms --edit damaged 2>&1)
+    check "buildrooms room file ${LABELS[$i]}" $? 0 "$output" "EDITED damaged:"
+done
+
+./eganch.buildrooms --seed "$SEED" --format binary > /dev/null || exit 1
+GOOD_WORLD=$(readlink eganch.latest)
+
+# Each case overwrites one uint32 (or one byte for the name table) found
+# through the header: section offset field, index in the section, value
+WORLD_CASES=(
+    "connection 40 0 4294967295"
+    "backward_offsets 32 1 4294967295"
+    "past_connections 32 7 4294967295"
+    "name_offset 48 0 4294967295"
+    "name_table 56 -1 65"
+    "name_index 72 0 4294967295"
+)
+
+for worldCase in "${WORLD_CASES[@]}"; do
+    read -r label field index value <<< "$worldCase"
+    cp "$GOOD_WORLD" damaged.world
+    python3 - damaged.world "$field" "$index" "$value" <<'PYTHON' || exit 1
+import struct, sys
+path, field, index, value = sys.argv[1], int(sys.argv[2]), int(sys.argv[3]), int(sys.argv[4])
+data = bytearray(open(path, "rb").read())
+start = struct.unpack_from("<Q", data, field)[0]
+if field == 56:
+    # The name table is bytes, index -1 is its last byte
+    size = struct.unpack_from("<Q", data, 64)[0]
+    data[start + size - 1] = value
+else:
+    struct.pack_into("<I", data, start + 4 * index, value)
+open(path, "wb").write(data)
+PYTHON
+
+    output=$(echo | ./eganch.adventure --world damaged.world --batch - 2>&1)
+    check "adventure world file $label" $? 1 "$output" "ERROR: damaged.world is not a valid world file."
+
+    output=$(echo "start $ROOM" | ./eganch.buildrooms --edit damaged.world 2>&1)
+    check "buildrooms world file $label" $? 1 "$output" "ERROR: damaged.world is not a valid world file."
+    rm -f damaged.world damaged.world.journal
+done
+
+cd .. && rm -rf "$WORK_DIR"
+exit $FAILED
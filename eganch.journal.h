@@ -0,0 +1,606 @@
+/*
+ * FILE NAME: eganch.journal.h
+ * DESCRIPTION: The world change journal shared by eganch.buildrooms (which
+ * edits worlds and appends to it) and eganch.adventure (which replays it).
+ * A world's journal sits next to it, named after it with JOURNAL_SUFFIX, and
+ * is a text file with one edit per line:
+ *   add ROOM ROOM       connect two rooms
+ *   remove ROOM ROOM    disconnect two rooms
+ *   rename ROOM NAME    give a room a new name
+ *   start ROOM          make a room the start room
+ *   end ROOM            make a room the end room
+ * Lines are only ever appended, one write per batch of edits under an
+ * exclusive lock, and a last line without its newline is a torn write: it is
+ * ignored on replay and cut off by the next append. Room files are
+ * rewritten as they are edited, so the journal of a rooms directory is only a
+ * record. A packed world file is never changed once written, since players
+ * may have it mapped; its edits live only in the journal and are replayed
+ * into a WorldEdits overlay each time it is loaded, which costs time in the
+ * number of edits rather than the size of the world.
+ * AUTHOR: Chelsea Egan (eganch@oregonstate.edu)
+ */
+
+#ifndef EGANCH_JOURNAL_H
+#define EGANCH_JOURNAL_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "eganch.arena.h"
+#include "eganch.world.h"
+
+#define JOURNAL_SUFFIX ".journal"
+#define JOURNAL_NAME_SIZE 64
+#define JOURNAL_LINE_SIZE 160
+#define EDITS_ARENA_SIZE 4096
+#define EDITS_INDEX_START_SIZE 16
+#define EDITED_ROOM_EMPTY 0
+#define EDITED_ROOM_HASH 0x9E3779B97F4A7C15ULL
+#define NOT_RENAMED SIZE_MAX
+
+enum journalOperations {ADD_EDIT, REMOVE_EDIT, RENAME_EDIT, START_EDIT, END_EDIT, NUM_EDITS};
+static const char* journalOperationNames[] = {"add", "remove", "rename", "start", "end"};
+
+/* One line of the journal. other is the second room, or the new name. */
+struct JournalEdit {
+    enum journalOperations operation;
+    char room[JOURNAL_NAME_SIZE];
+    char other[JOURNAL_NAME_SIZE];
+};
+
+/* A room whose connections or name differ from the packed world's */
+struct EditedRoom {
+    uint32_t room;
+    uint32_t numConnections;
+    uint32_t capacity;
+    size_t connections;
+    size_t name;
+};
+
+/* A packed world as written, laid out as described in eganch.world.h, and
+ * the edits replayed over it. Edited rooms are found through an open
+ * addressing table of room id + 1, and renamed rooms through one hashed by
+ * their new name; both hold edited room index + 1. Connection lists and new
+ * names are kept in the arena. */
+struct WorldEdits {
+    uint32_t numRooms;
+    const uint32_t* connectionOffsets;
+    const uint32_t* connections;
+    const uint32_t* nameOffsets;
+    const char* names;
+    const uint32_t* nameIndex;
+    uint64_t nameIndexSize;
+
+    struct Arena arena;
+    struct EditedRoom* rooms;
+    uint32_t numEditedRooms;
+    uint32_t editedRoomsSize;
+    uint32_t* roomTable;
+    uint32_t* nameTable;
+    uint32_t numTableNames;
+    uint64_t tableSize;
+    int64_t startRoom;
+    int64_t endRoom;
+    int64_t connectionChange;
+    long long numEdits;
+};
+
+/*
+ * NAME: makeJournalName
+ * PARAMS: Pointer to the world's name, pointer to a buffer and its size
+ * RETURN: void
+ * DESCRIPTION: Names the journal of a rooms directory or packed world file
+ */
+static inline void makeJournalName(const char* worldName, char* journalName, size_t size) {
+    snprintf(journalName, size, "%s%s", worldName, JOURNAL_SUFFIX);
+}
+
+/*
+ * NAME: isValidRoomName
+ * PARAMS: Pointer to a room name
+ * RETURN: 1 if the name can be used for a room, 0 otherwise
+ * DESCRIPTION: A name is a file name and a single word the player types, so
+ * it may not hold slashes or white space, and may not be one of the
+ * player's other commands
+ */
+static inline int isValidRoomName(const char* name) {
+    size_t length = strlen(name);
+
+    return length > 0 && length < JOURNAL_NAME_SIZE && strcspn(name, "/ \t\r\n") == length
+           && strcmp(name, ".") != 0 && strcmp(name, "..") != 0
+           && strcmp(name, "time") != 0 && strcmp(name, "hint") != 0
+           && strcmp(name, "save") != 0 && strcmp(name, "load") != 0;
+}
+
+/*
+ * NAME: parseJournalEdit
+ * PARAMS: Pointer to a journal line and pointer to the edit to fill
+ * RETURN: 0 if the line is an edit, -1 otherwise
+ * DESCRIPTION: Reads one journal line, or one edit given to eganch.buildrooms --edit
+ */
+static inline int parseJournalEdit(const char* line, struct JournalEdit* edit) {
+    char operation[JOURNAL_NAME_SIZE];
+    char extra[2];
+
+    edit->other[0] = '\0';
+    int fields = sscanf(line, "%63s %63s %63s %1s", operation, edit->room, edit->other, extra);
+
+    int i;
+    for (i = 0; i < NUM_EDITS; i++) {
+        if (strcmp(operation, journalOperationNames[i]) == 0) {
+            edit->operation = i;
+            return (fields == ((i == START_EDIT || i == END_EDIT) ? 2 : 3)) ? 0 : -1;
+        }
+    }
+    return -1;
+}
+
+/*
+ * NAME: formatJournalEdit
+ * PARAMS: Pointer to the edit, pointer to a buffer and its size
+ * RETURN: Length of the line
+ * DESCRIPTION: Writes an edit as one journal line, newline included
+ */
+static inline int formatJournalEdit(const struct JournalEdit* edit, char* line, size_t size) {
+    if (edit->operation == START_EDIT || edit->operation == END_EDIT) {
+        return snprintf(line, size, "%s %s\n", journalOperationNames[edit->operation], edit->room);
+    }
+    return snprintf(line, size, "%s %s %s\n", journalOperationNames[edit->operation], edit->room, edit->other);
+}
+
+/*
+ * NAME: appendJournal
+ * PARAMS: Pointer to the journal's name, pointer to the lines and their length
+ * RETURN: 0 if the lines are on disk, -1 otherwise
+ * DESCRIPTION: Appends a batch of edits with one write and syncs it. The
+ * journal is locked so editors take turns, and a torn last line is cut off
+ * first so it cannot run into the new lines.
+ */
+static inline int appendJournal(const char* journalName, const char* lines, size_t length) {
+    char tail[JOURNAL_LINE_SIZE];
+
+    int fileDescriptor = open(journalName, O_RDWR | O_CREAT, 0644);
+    if (fileDescriptor < 0 || flock(fileDescriptor, LOCK_EX) != 0) {
+        return -1;
+    }
+
+    off_t end = lseek(fileDescriptor, 0, SEEK_END);
+    off_t tailStart = (end > JOURNAL_LINE_SIZE) ? end - JOURNAL_LINE_SIZE : 0;
+    ssize_t tailSize = pread(fileDescriptor, tail, end - tailStart, tailStart);
+    while (tailSize > 0 && tail[tailSize - 1] != '\n') {
+        tailSize--;
+    }
+
+    off_t position = tailStart + tailSize;
+    int result = (ftruncate(fileDescriptor, position) == 0
+                  && pwrite(fileDescriptor, lines, length, position) == (ssize_t)length
+                  && fsync(fileDescriptor) == 0) ? 0 : -1;
+    close(fileDescriptor);
+    return result;
+}
+
+/*
+ * NAME: initWorldEdits
+ * PARAMS: Pointer to the overlay, pointer to the mapped world file
+ * RETURN: void
+ * DESCRIPTION: Points an empty overlay at a packed world
+ */
+static inline void initWorldEdits(struct WorldEdits* edits, const void* mapping) {
+    const struct WorldHeader* header = mapping;
+    const char* base = mapping;
+
+    memset(edits, 0, sizeof(*edits));
+    edits->numRooms = header->numRooms;
+    edits->connectionOffsets = (const uint32_t*)(base + header->connectionOffsetsStart);
+    edits->connections = (const uint32_t*)(base + header->connectionsStart);
+    edits->nameOffsets = (const uint32_t*)(base + header->nameOffsetsStart);
+    edits->names = base + header->namesStart;
+    edits->nameIndex = (const uint32_t*)(base + header->nameIndexStart);
+    edits->nameIndexSize = header->nameIndexSize;
+    edits->startRoom = header->startRoom;
+    edits->endRoom = header->endRoom;
+
+    initArena(&edits->arena, EDITS_ARENA_SIZE);
+    edits->tableSize = EDITS_INDEX_START_SIZE;
+    edits->roomTable = calloc(edits->tableSize, sizeof(uint32_t));
+    edits->nameTable = calloc(edits->tableSize, sizeof(uint32_t));
+    assert(edits->roomTable != NULL && edits->nameTable != NULL);
+}
+
+/*
+ * NAME: freeWorldEdits
+ * PARAMS: Pointer to the overlay
+ * RETURN: void
+ * DESCRIPTION: Frees the edits, the packed world itself is left alone
+ */
+static inline void freeWorldEdits(struct WorldEdits* edits) {
+    freeArena(&edits->arena);
+    free(edits->rooms);
+    free(edits->roomTable);
+    free(edits->nameTable);
+    memset(edits, 0, sizeof(*edits));
+}
+
+/*
+ * NAME: getEditedRoomSlot
+ * PARAMS: Pointer to the overlay and a room id
+ * RETURN: The room's first slot in the table of edited rooms
+ * DESCRIPTION: Multiplicative hash of the room id
+ */
+static inline uint64_t getEditedRoomSlot(struct WorldEdits* edits, uint32_t room) {
+    return ((uint64_t)room * EDITED_ROOM_HASH) >> 32 & (edits->tableSize - 1);
+}
+
+/*
+ * NAME: findEditedRoom
+ * PARAMS: Pointer to the overlay and a room id
+ * RETURN: Pointer to the room's edits, NULL if it has none
+ * DESCRIPTION: Looks a room up in the table of edited rooms
+ */
+static inline struct EditedRoom* findEditedRoom(struct WorldEdits* edits, uint32_t room) {
+    if (edits->numEditedRooms == 0) {
+        return NULL;
+    }
+
+    uint64_t slot = getEditedRoomSlot(edits, room);
+    while (edits->roomTable[slot] != EDITED_ROOM_EMPTY) {
+        struct EditedRoom* edited = &edits->rooms[edits->roomTable[slot] - 1];
+        if (edited->room == room) {
+            return edited;
+        }
+        slot = (slot + 1) & (edits->tableSize - 1);
+    }
+    return NULL;
+}
+
+/*
+ * NAME: getEditedRoomName
+ * PARAMS: Pointer to the overlay and a room id
+ * RETURN: Pointer to the room's current name
+ * DESCRIPTION: Returns the new name of a renamed room, else its written name
+ */
+static inline const char* getEditedRoomName(struct WorldEdits* edits, uint32_t room) {
+    struct EditedRoom* edited = findEditedRoom(edits, room);
+
+    if (edited != NULL && edited->name != NOT_RENAMED) {
+        return getArenaPointer(&edits->arena, edited->name);
+    }
+    return edits->names + edits->nameOffsets[room];
+}
+
+/*
+ * NAME: getEditedNumConnections
+ * PARAMS: Pointer to the overlay and a room id
+ * RETURN: Number of connections the room has now
+ * DESCRIPTION: Counts an edited room's connections from its edited list
+ */
+static inline uint32_t getEditedNumConnections(struct WorldEdits* edits, uint32_t room) {
+    struct EditedRoom* edited = findEditedRoom(edits, room);
+
+    if (edited != NULL) {
+        return edited->numConnections;
+    }
+    return edits->connectionOffsets[room + 1] - edits->connectionOffsets[room];
+}
+
+/*
+ * NAME: getEditedConnection
+ * PARAMS: Pointer to the overlay, a room id and the connection number
+ * RETURN: The connected room's id
+ * DESCRIPTION: Returns a room's nth connection as it is now
+ */
+static inline uint32_t getEditedConnection(struct WorldEdits* edits, uint32_t room, uint32_t connection) {
+    struct EditedRoom* edited = findEditedRoom(edits, room);
+
+    if (edited != NULL) {
+        return ((uint32_t*)getArenaPointer(&edits->arena, edited->connections))[connection];
+    }
+    return edits->connections[edits->connectionOffsets[room] + connection];
+}
+
+/*
+ * NAME: findEditedRoomByName
+ * PARAMS: Pointer to the overlay and pointer to a room name
+ * RETURN: The room id, or -1 if no room has that name now
+ * DESCRIPTION: Renamed rooms are looked up by their new name first. A room
+ * found by its written name only counts if it has not been renamed since.
+ * Tables are never cleared, so each hit is checked against the current name.
+ */
+static inline int64_t findEditedRoomByName(struct WorldEdits* edits, const char* name) {
+    if (edits->numEditedRooms > 0) {
+        uint64_t slot = hashRoomName(name) & (edits->tableSize - 1);
+        while (edits->nameTable[slot] != EDITED_ROOM_EMPTY) {
+            uint32_t room = edits->rooms[edits->nameTable[slot] - 1].room;
+            if (strcmp(getEditedRoomName(edits, room), name) == 0) {
+                return room;
+            }
+            slot = (slot + 1) & (edits->tableSize - 1);
+        }
+    }
+
+    int64_t room = findNameIndex(edits->nameIndex, edits->nameIndexSize, name, edits->names, edits->nameOffsets);
+    if (room >= 0 && strcmp(getEditedRoomName(edits, room), name) != 0) {
+        return -1;
+    }
+    return room;
+}
+
+/*
+ * NAME: insertEditedName
+ * PARAMS: Pointer to the overlay and the edited room's index
+ * RETURN: void
+ * DESCRIPTION: Adds an edited room under its current name
+ */
+static inline void insertEditedName(struct WorldEdits* edits, uint32_t index) {
+    const char* name = getArenaPointer(&edits->arena, edits->rooms[index].name);
+    uint64_t slot = hashRoomName(name) & (edits->tableSize - 1);
+
+    while (edits->nameTable[slot] != EDITED_ROOM_EMPTY) {
+        slot = (slot + 1) & (edits->tableSize - 1);
+    }
+    edits->nameTable[slot] = index + 1;
+    edits->numTableNames++;
+}
+
+/*
+ * NAME: insertEditedRoom
+ * PARAMS: Pointer to the overlay and the edited room's index
+ * RETURN: void
+ * DESCRIPTION: Adds an edited room under its room id
+ */
+static inline void insertEditedRoom(struct WorldEdits* edits, uint32_t index) {
+    uint64_t slot = getEditedRoomSlot(edits, edits->rooms[index].room);
+
+    while (edits->roomTable[slot] != EDITED_ROOM_EMPTY) {
+        slot = (slot + 1) & (edits->tableSize - 1);
+    }
+    edits->roomTable[slot] = index + 1;
+}
+
+/*
+ * NAME: growEditTables
+ * PARAMS: Pointer to the overlay
+ * RETURN: void
+ * DESCRIPTION: Doubles both tables and puts every edited room back in them,
+ * dropping names that rooms no longer have
+ */
+static inline void growEditTables(struct WorldEdits* edits) {
+    free(edits->roomTable);
+    free(edits->nameTable);
+    edits->tableSize *= 2;
+    edits->roomTable = calloc(edits->tableSize, sizeof(uint32_t));
+    edits->nameTable = calloc(edits->tableSize, sizeof(uint32_t));
+    edits->numTableNames = 0;
+    assert(edits->roomTable != NULL && edits->nameTable != NULL);
+
+    uint32_t i;
+    for (i = 0; i < edits->numEditedRooms; i++) {
+        insertEditedRoom(edits, i);
+        if (edits->rooms[i].name != NOT_RENAMED) {
+            insertEditedName(edits, i);
+        }
+    }
+}
+
+/*
+ * NAME: editRoom
+ * PARAMS: Pointer to the overlay and a room id
+ * RETURN: Pointer to the room's edits
+ * DESCRIPTION: Returns a room's edits, copying its connections into the
+ * overlay the first time it is edited
+ */
+static inline struct EditedRoom* editRoom(struct WorldEdits* edits, uint32_t room) {
+    struct EditedRoom* edited = findEditedRoom(edits, room);
+    if (edited != NULL) {
+        return edited;
+    }
+
+    if ((uint64_t)(edits->numEditedRooms + 1) * 2 > edits->tableSize) {
+        growEditTables(edits);
+    }
+    if (edits->numEditedRooms == edits->editedRoomsSize) {
+        edits->editedRoomsSize = (edits->editedRoomsSize > 0) ? edits->editedRoomsSize * 2 : EDITS_INDEX_START_SIZE;
+        edits->rooms = realloc(edits->rooms, edits->editedRoomsSize * sizeof(struct EditedRoom));
+        assert(edits->rooms != NULL);
+    }
+
+    uint32_t numConnections = edits->connectionOffsets[room + 1] - edits->connectionOffsets[room];
+    edited = &edits->rooms[edits->numEditedRooms];
+    edited->room = room;
+    edited->numConnections = numConnections;
+    edited->capacity = numConnections + 1;
+    edited->connections = allocateArena(&edits->arena, edited->capacity * sizeof(uint32_t), sizeof(uint32_t));
+    edited->name = NOT_RENAMED;
+    memcpy(getArenaPointer(&edits->arena, edited->connections),
+           edits->connections + edits->connectionOffsets[room], numConnections * sizeof(uint32_t));
+
+    insertEditedRoom(edits, edits->numEditedRooms++);
+    return edited;
+}
+
+/*
+ * NAME: addEditedConnection
+ * PARAMS: Pointer to the overlay and two room ids
+ * RETURN: void
+ * DESCRIPTION: Adds a connection from room x to room y, moving x's list to
+ * a block twice the size when it is full
+ */
+static inline void addEditedConnection(struct WorldEdits* edits, uint32_t x, uint32_t y) {
+    struct EditedRoom* edited = editRoom(edits, x);
+
+    if (edited->numConnections == edited->capacity) {
+        size_t connections = allocateArena(&edits->arena, edited->capacity * 2 * sizeof(uint32_t), sizeof(uint32_t));
+        memcpy(getArenaPointer(&edits->arena, connections), getArenaPointer(&edits->arena, edited->connections),
+               edited->numConnections * sizeof(uint32_t));
+        edited->connections = connections;
+        edited->capacity *= 2;
+    }
+    ((uint32_t*)getArenaPointer(&edits->arena, edited->connections))[edited->numConnections++] = y;
+}
+
+/*
+ * NAME: removeEditedConnection
+ * PARAMS: Pointer to the overlay and two room ids
+ * RETURN: void
+ * DESCRIPTION: Removes the connection from room x to room y, keeping the
+ * order of x's other connections
+ */
+static inline void removeEditedConnection(struct WorldEdits* edits, uint32_t x, uint32_t y) {
+    struct EditedRoom* edited = editRoom(edits, x);
+    uint32_t* connections = getArenaPointer(&edits->arena, edited->connections);
+
+    uint32_t i;
+    for (i = 0; i < edited->numConnections && connections[i] != y; i++) {
+    }
+    assert(i < edited->numConnections);
+    memmove(connections + i, connections + i + 1, (edited->numConnections - i - 1) * sizeof(uint32_t));
+    edited->numConnections--;
+}
+
+/*
+ * NAME: isEditedConnection
+ * PARAMS: Pointer to the overlay and two room ids
+ * RETURN: 1 if room x is connected to room y, 0 otherwise
+ * DESCRIPTION: Checks a room's current connections
+ */
+static inline int isEditedConnection(struct WorldEdits* edits, uint32_t x, uint32_t y) {
+    uint32_t numConnections = getEditedNumConnections(edits, x);
+
+    uint32_t i;
+    for (i = 0; i < numConnections; i++) {
+        if (getEditedConnection(edits, x, i) == y) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * NAME: applyJournalEdit
+ * PARAMS: Pointer to the overlay, pointer to the edit, and the fewest and
+ * most connections a room may be left with (0 for no limit)
+ * RETURN: NULL if the edit was applied, otherwise why it could not be
+ * DESCRIPTION: Checks an edit against the world as it is now and applies it
+ * to the overlay. Connections are always added and removed in both
+ * directions.
+ */
+static inline const char* applyJournalEdit(struct WorldEdits* edits, const struct JournalEdit* edit,
+                                           uint32_t minConnections, uint32_t maxConnections) {
+    int64_t room = findEditedRoomByName(edits, edit->room);
+    int64_t other = -1;
+
+    if (room < 0) {
+        return "no room has that name";
+    }
+    if (edit->operation == ADD_EDIT || edit->operation == REMOVE_EDIT) {
+        other = findEditedRoomByName(edits, edit->other);
+        if (other < 0) {
+            return "no room has that name";
+        }
+        if (other == room) {
+            return "a room cannot connect to itself";
+        }
+    }
+
+    if (edit->operation == ADD_EDIT) {
+        if (isEditedConnection(edits, room, other)) {
+            return "the rooms are already connected";
+        }
+        if (maxConnections > 0 && (getEditedNumConnections(edits, room) >= maxConnections
+                                   || getEditedNumConnections(edits, other) >= maxConnections)) {
+            return "a room would have too many connections";
+        }
+        addEditedConnection(edits, room, other);
+        addEditedConnection(edits, other, room);
+        edits->connectionChange += 2;
+    } else if (edit->operation == REMOVE_EDIT) {
+        if (!isEditedConnection(edits, room, other)) {
+            return "the rooms are not connected";
+        }
+        if (getEditedNumConnections(edits, room) <= minConnections
+            || getEditedNumConnections(edits, other) <= minConnections) {
+            return "a room would have too few connections";
+        }
+        removeEditedConnection(edits, room, other);
+        removeEditedConnection(edits, other, room);
+        edits->connectionChange -= 2;
+    } else if (edit->operation == RENAME_EDIT) {
+        if (!isValidRoomName(edit->other)) {
+            return "the new name is not a valid room name";
+        }
+        if (findEditedRoomByName(edits, edit->other) >= 0) {
+            return "a room already has the new name";
+        }
+
+        struct EditedRoom* edited = editRoom(edits, room);
+        size_t length = strlen(edit->other) + 1;
+        size_t name = allocateArena(&edits->arena, length, 1);
+        memcpy(getArenaPointer(&edits->arena, name), edit->other, length);
+        edited->name = name;
+
+        /* Growing puts the room in under its new name */
+        if ((uint64_t)(edits->numTableNames + 1) * 2 > edits->tableSize) {
+            growEditTables(edits);
+        } else {
+            insertEditedName(edits, edited - edits->rooms);
+        }
+    } else if (edit->operation == START_EDIT) {
+        if (room == edits->endRoom) {
+            return "the end room cannot also be the start room";
+        }
+        edits->startRoom = room;
+    } else {
+        if (room == edits->startRoom) {
+            return "the start room cannot also be the end room";
+        }
+        edits->endRoom = room;
+    }
+
+    edits->numEdits++;
+    return NULL;
+}
+
+/*
+ * NAME: replayJournal
+ * PARAMS: Pointer to the overlay, pointer to the journal's name and pointer
+ * to an int for the line that failed
+ * RETURN: NULL if every edit was replayed (or there is no journal), otherwise why one was not
+ * DESCRIPTION: Applies every whole line of a packed world's journal, in order
+ */
+static inline const char* replayJournal(struct WorldEdits* edits, const char* journalName, int* lineNumber) {
+    char line[JOURNAL_LINE_SIZE];
+    struct JournalEdit edit;
+
+    *lineNumber = 0;
+    FILE* journal = fopen(journalName, "r");
+    if (journal == NULL) {
+        return NULL;
+    }
+
+    while (fgets(line, sizeof(line), journal) != NULL) {
+        (*lineNumber)++;
+        if (strchr(line, '\n') == NULL) {
+            break;
+        }
+        if (parseJournalEdit(line, &edit) != 0) {
+            fclose(journal);
+            return "the line is not an edit";
+        }
+
+        const char* error = applyJournalEdit(edits, &edit, 0, 0);
+        if (error != NULL) {
+            fclose(journal);
+            return error;
+        }
+    }
+
+    fclose(journal);
+    return NULL;
+}
+
+#endif
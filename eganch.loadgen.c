@@ -0,0 +1,354 @@
+/*
+ * PROGRAM NAME: eganch.loadgen.c
+ * DESCRIPTION: Load generator for eganch.adventure --server. Keeps a number
+ * of player sessions open at once over the server's Unix domain socket. Each
+ * player walks randomly through the rooms listed in the server's responses
+ * until it finds the end room or runs out of moves. Prints sessions per second
+ * and move latency percentiles as JSON.
+ * AUTHOR: Chelsea Egan (eganch@oregonstate.edu)
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BUFFER_SIZE 16384
+#define MAX_EVENTS 256
+#define PROMPT "WHERE TO? >"
+#define CONNECTIONS_LABEL "POSSIBLE CONNECTIONS: "
+#define TRUE 0
+#define FALSE 1
+
+/* One simulated player */
+struct Player {
+    int socket;
+    int moves;
+    int received;
+    char buffer[BUFFER_SIZE];
+    struct timespec sent;
+};
+
+char* socketPath;
+int totalSessions = 1000;
+int concurrency = 100;
+int maxMoves = 100;
+int sessionsStarted = 0;
+int sessionsFinished = 0;
+int sessionsWon = 0;
+int epollFd;
+
+double* latencies;
+long long latenciesUsed = 0;
+long long latenciesSize = 1024;
+
+/*
+ * NAME: getElapsedSeconds
+ * PARAMS: Pointer to the starting time
+ * RETURN: Double holding the seconds since the starting time
+ * DESCRIPTION: Measures elapsed wall time with the monotonic clock
+ */
+double getElapsedSeconds(struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * NAME: addLatency
+ * PARAMS: Double holding a move latency in seconds
+ * RETURN: void
+ * DESCRIPTION: Records a move latency, growing the array as needed
+ */
+void addLatency(double latency) {
+    if (latenciesUsed == latenciesSize) {
+        latenciesSize *= 2;
+        latencies = realloc(latencies, latenciesSize * sizeof(double));
+        assert(latencies != NULL);
+    }
+    latencies[latenciesUsed++] = latency;
+}
+
+/*
+ * NAME: startPlayer
+ * PARAMS: Pointer to the player
+ * RETURN: void
+ * DESCRIPTION: Connects a player to the server and waits for its first room
+ */
+void startPlayer(struct Player* player) {
+    struct sockaddr_un address;
+    struct epoll_event event;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+
+    player->socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    while (connect(player->socket, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        /* The server's backlog is full, give it a moment */
+        if (errno != EAGAIN) {
+            printf("ERROR: Failed to connect to %s. Exiting.\n", socketPath);
+            exit(1);
+        }
+        usleep(100);
+    }
+
+    player->moves = 0;
+    player->received = 0;
+    clock_gettime(CLOCK_MONOTONIC, &player->sent);
+    sessionsStarted++;
+
+    event.events = EPOLLIN;
+    event.data.ptr = player;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, player->socket, &event);
+}
+
+/*
+ * NAME: finishPlayer
+ * PARAMS: Pointer to the player and int indicating if it found the end room
+ * RETURN: void
+ * DESCRIPTION: Ends a player's session and starts the next one if any are left
+ */
+void finishPlayer(struct Player* player, int won) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, player->socket, NULL);
+    close(player->socket);
+    player->socket = -1;
+
+    sessionsFinished++;
+    if (won == TRUE) {
+        sessionsWon++;
+    }
+
+    if (sessionsStarted < totalSessions) {
+        startPlayer(player);
+    }
+}
+
+/*
+ * NAME: chooseMove
+ * PARAMS: Pointer to the player, pointer to a buffer for the room name and its size
+ * RETURN: void
+ * DESCRIPTION: Picks a random connection from the last room the server described
+ */
+void chooseMove(struct Player* player, char* roomName, int size) {
+    char* connections = NULL;
+    char* found = player->buffer;
+    int numConnections = 1;
+
+    while ((found = strstr(found, CONNECTIONS_LABEL)) != NULL) {
+        connections = found + strlen(CONNECTIONS_LABEL);
+        found = connections;
+    }
+    assert(connections != NULL);
+
+    char* end = strstr(connections, ".\n");
+    assert(end != NULL);
+
+    char* c;
+    for (c = connections; c < end; c++) {
+        if (*c == ',') {
+            numConnections++;
+        }
+    }
+
+    int choice = rand() % numConnections;
+    while (choice-- > 0) {
+        connections = strstr(connections, ", ") + 2;
+    }
+
+    int length = strcspn(connections, ",");
+    if (connections + length > end) {
+        length = end - connections;
+    }
+    if (length >= size) {
+        length = size - 1;
+    }
+    memcpy(roomName, connections, length);
+    roomName[length] = '\0';
+}
+
+/*
+ * NAME: readPlayer
+ * PARAMS: Pointer to the player
+ * RETURN: void
+ * DESCRIPTION: Reads the server's response. Once a full response has arrived,
+ * records the latency and sends the next move.
+ */
+void readPlayer(struct Player* player) {
+    char roomName[BUFFER_SIZE];
+
+    ssize_t received = recv(player->socket, player->buffer + player->received,
+                            BUFFER_SIZE - 1 - player->received, 0);
+    if (received <= 0) {
+        /* The server closes the session once the end room is found */
+        int won = (received == 0 && player->moves > 0) ? TRUE : FALSE;
+        if (won == TRUE) {
+            addLatency(getElapsedSeconds(&player->sent));
+        }
+        finishPlayer(player, won);
+        return;
+    }
+    player->received += received;
+    player->buffer[player->received] = '\0';
+
+    int promptLength = strlen(PROMPT);
+    if (player->received < promptLength
+        || strcmp(player->buffer + player->received - promptLength, PROMPT) != 0) {
+        /* A response that ends the game has no prompt, wait for the close */
+        if (player->received == BUFFER_SIZE - 1) {
+            player->received = 0;
+        }
+        return;
+    }
+
+    if (player->moves > 0) {
+        addLatency(getElapsedSeconds(&player->sent));
+    }
+
+    if (player->moves == maxMoves) {
+        finishPlayer(player, FALSE);
+        return;
+    }
+
+    chooseMove(player, roomName, sizeof(roomName) - 1);
+    strcat(roomName, "\n");
+
+    player->received = 0;
+    player->moves++;
+    clock_gettime(CLOCK_MONOTONIC, &player->sent);
+    if (send(player->socket, roomName, strlen(roomName), MSG_NOSIGNAL) < 0) {
+        finishPlayer(player, FALSE);
+    }
+}
+
+/*
+ * NAME: compareDoubles
+ * PARAMS: Two pointers to doubles
+ * RETURN: Int ordering the doubles
+ * DESCRIPTION: qsort comparator for ascending doubles
+ */
+int compareDoubles(const void* x, const void* y) {
+    double a = *(const double*)x;
+    double b = *(const double*)y;
+    return (a > b) - (a < b);
+}
+
+/*
+ * NAME: printUsage
+ * PARAMS: Pointer to the program name
+ * RETURN: void
+ * DESCRIPTION: Prints the command line options
+ */
+void printUsage(char* programName) {
+    printf("USAGE: %s --socket PATH [--sessions N] [--concurrency N] [--moves N] [--seed N]\n", programName);
+    printf("  --socket PATH     socket eganch.adventure --server is listening on\n");
+    printf("  --sessions N      total player sessions to run (default %d)\n", totalSessions);
+    printf("  --concurrency N   sessions open at once (default %d)\n", concurrency);
+    printf("  --moves N         most moves per session before giving up (default %d)\n", maxMoves);
+    printf("  --seed N          seed for the random walks (default 1)\n");
+}
+
+int main(int argc, char** argv) {
+    static struct option longOptions[] = {
+        {"socket", required_argument, NULL, 'S'},
+        {"sessions", required_argument, NULL, 'n'},
+        {"concurrency", required_argument, NULL, 'c'},
+        {"moves", required_argument, NULL, 'm'},
+        {"seed", required_argument, NULL, 'r'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    struct epoll_event events[MAX_EVENTS];
+    struct rlimit limit;
+    struct timespec start;
+    unsigned seed = 1;
+    int option;
+
+    while ((option = getopt_long(argc, argv, "S:n:c:m:r:h", longOptions, NULL)) != -1) {
+        switch (option) {
+            case 'S':
+                socketPath = optarg;
+                break;
+            case 'n':
+                totalSessions = atoi(optarg);
+                break;
+            case 'c':
+                concurrency = atoi(optarg);
+                break;
+            case 'm':
+                maxMoves = atoi(optarg);
+                break;
+            case 'r':
+                seed = strtoul(optarg, NULL, 10);
+                break;
+            case 'h':
+                printUsage(argv[0]);
+                return 0;
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (socketPath == NULL || totalSessions < 1 || concurrency < 1 || maxMoves < 1) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (concurrency > totalSessions) {
+        concurrency = totalSessions;
+    }
+
+    /* Each open session needs a file descriptor */
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    srand(seed);
+    latencies = malloc(latenciesSize * sizeof(double));
+    struct Player* players = malloc(concurrency * sizeof(struct Player));
+    assert(latencies != NULL && players != NULL);
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    assert(epollFd >= 0);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int i;
+    for (i = 0; i < concurrency; i++) {
+        startPlayer(&players[i]);
+    }
+
+    while (sessionsFinished < totalSessions) {
+        int numEvents = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+        for (i = 0; i < numEvents; i++) {
+            readPlayer(events[i].data.ptr);
+        }
+    }
+
+    double wallSeconds = getElapsedSeconds(&start);
+
+    qsort(latencies, latenciesUsed, sizeof(double), compareDoubles);
+    double p50 = (latenciesUsed > 0) ? latencies[latenciesUsed / 2] : 0;
+    double p99 = (latenciesUsed > 0) ? latencies[(long long)(latenciesUsed * 0.99)] : 0;
+
+    printf("{\"sessions\": %d, \"won\": %d, \"concurrency\": %d, \"moves\": %lld, ",
+           sessionsFinished, sessionsWon, concurrency, latenciesUsed);
+    printf("\"wall_seconds\": %.6f, \"sessions_per_second\": %.1f, \"moves_per_second\": %.1f, ",
+           wallSeconds, sessionsFinished / wallSeconds, latenciesUsed / wallSeconds);
+    printf("\"p50_move_us\": %.2f, \"p99_move_us\": %.2f}\n", p50 * 1e6, p99 * 1e6);
+
+    close(epollFd);
+    free(players);
+    free(latencies);
+
+    return 0;
+}
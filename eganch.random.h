@@ -0,0 +1,83 @@
+/*
+ * FILE NAME: eganch.random.h
+ * DESCRIPTION: Seeded pseudo random numbers shared by the eganch programs.
+ * A stream is xoshiro256** seeded through splitmix64 from a seed and a
+ * stream number, so every world (or thread) can have its own independent
+ * stream and the same seed always gives the same numbers no matter how the
+ * work is split up.
+ * AUTHOR: Chelsea Egan (eganch@oregonstate.edu)
+ */
+
+#ifndef EGANCH_RANDOM_H
+#define EGANCH_RANDOM_H
+
+#include <stdint.h>
+
+#define STREAM_INCREMENT 0x9E3779B97F4A7C15ULL
+
+struct RandomStream {
+    uint64_t state[4];
+};
+
+/*
+ * NAME: splitMix
+ * PARAMS: Pointer to the splitmix64 state
+ * RETURN: The next splitmix64 output
+ * DESCRIPTION: Used to expand a seed into a full xoshiro256** state
+ */
+static inline uint64_t splitMix(uint64_t* state) {
+    uint64_t z = (*state += STREAM_INCREMENT);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/*
+ * NAME: seedRandomStream
+ * PARAMS: Pointer to the stream, the seed and the stream number
+ * RETURN: void
+ * DESCRIPTION: Starts stream number streamId of the given seed
+ */
+static inline void seedRandomStream(struct RandomStream* stream, uint64_t seed, uint64_t streamId) {
+    uint64_t mix = seed;
+    uint64_t streamSeed = splitMix(&mix) ^ (streamId * 0xD1B54A32D192ED03ULL);
+
+    int i;
+    for (i = 0; i < 4; i++) {
+        stream->state[i] = splitMix(&streamSeed);
+    }
+}
+
+/*
+ * NAME: nextRandom
+ * PARAMS: Pointer to the stream
+ * RETURN: The next 64 random bits
+ * DESCRIPTION: xoshiro256** step
+ */
+static inline uint64_t nextRandom(struct RandomStream* stream) {
+    uint64_t* s = stream->state;
+    uint64_t result = ((s[1] * 5) << 7 | (s[1] * 5) >> 57) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+
+    return result;
+}
+
+/*
+ * NAME: getRandomBelow
+ * PARAMS: Pointer to the stream and the exclusive upper bound
+ * RETURN: A random number from 0 to bound - 1
+ * DESCRIPTION: Maps 64 random bits onto the range with a multiply instead of
+ * a modulo
+ */
+static inline uint64_t getRandomBelow(struct RandomStream* stream, uint64_t bound) {
+    return (uint64_t)(((unsigned __int128)nextRandom(stream) * bound) >> 64);
+}
+
+#endif
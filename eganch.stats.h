@@ -0,0 +1,225 @@
+/*
+ * FILE NAME: eganch.stats.h
+ * DESCRIPTION: Run statistics shared by eganch.buildrooms and
+ * eganch.adventure. With --stats FILE each program counts what it does,
+ * times its phases or commands, and appends its statistics to FILE as one
+ * line of JSON when it exits and whenever it is sent STATS_SIGNAL ("-" is
+ * standard error). Without --stats every hook is a single untaken branch.
+ * Counters may be bumped from several threads at once, so they are added
+ * with relaxed atomics; a dump taken while threads are running is a close
+ * snapshot, not an exact one.
+ * AUTHOR: Chelsea Egan (eganch@oregonstate.edu)
+ */
+
+#ifndef EGANCH_STATS_H
+#define EGANCH_STATS_H
+
+#include <assert.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define STATS_SIGNAL SIGUSR1
+#define HISTOGRAM_BUCKETS 40
+
+/* Latencies in power of two buckets, bucket i counts [2^i, 2^(i + 1)) ns */
+struct LatencyHistogram {
+    uint64_t count;
+    uint64_t totalNs;
+    uint64_t maxNs;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+/* Held while a dump is written so the signal thread and the final dump never interleave */
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * NAME: getStatsTime
+ * PARAMS: none
+ * RETURN: Nanoseconds on the monotonic clock
+ * DESCRIPTION: Clock used for every statistics timer
+ */
+static inline uint64_t getStatsTime(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/*
+ * NAME: addStat
+ * PARAMS: Pointer to the counter and the amount to add
+ * RETURN: void
+ * DESCRIPTION: Adds to a counter that other threads may be adding to
+ */
+static inline void addStat(uint64_t* stat, uint64_t amount) {
+    __atomic_fetch_add(stat, amount, __ATOMIC_RELAXED);
+}
+
+/*
+ * NAME: readStat
+ * PARAMS: Pointer to the counter
+ * RETURN: The counter's value
+ * DESCRIPTION: Reads a counter that other threads may be adding to
+ */
+static inline uint64_t readStat(const uint64_t* stat) {
+    return __atomic_load_n(stat, __ATOMIC_RELAXED);
+}
+
+/*
+ * NAME: recordLatency
+ * PARAMS: Pointer to the histogram and the latency in nanoseconds
+ * RETURN: void
+ * DESCRIPTION: Adds one latency to a histogram
+ */
+static inline void recordLatency(struct LatencyHistogram* histogram, uint64_t ns) {
+    int bucket = (ns > 0) ? 63 - __builtin_clzll(ns) : 0;
+    if (bucket >= HISTOGRAM_BUCKETS) {
+        bucket = HISTOGRAM_BUCKETS - 1;
+    }
+
+    addStat(&histogram->count, 1);
+    addStat(&histogram->totalNs, ns);
+    addStat(&histogram->buckets[bucket], 1);
+
+    uint64_t maxNs = readStat(&histogram->maxNs);
+    while (ns > maxNs
+           && !__atomic_compare_exchange_n(&histogram->maxNs, &maxNs, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/*
+ * NAME: getHistogramPercentile
+ * PARAMS: Pointer to the histogram and the percentile (0 to 100)
+ * RETURN: Upper bound in nanoseconds of the bucket holding the percentile
+ * DESCRIPTION: Buckets are powers of two, so this is within a factor of two
+ */
+static inline uint64_t getHistogramPercentile(const struct LatencyHistogram* histogram, double percentile) {
+    uint64_t count = readStat(&histogram->count);
+    uint64_t target = (uint64_t)(count * percentile / 100.0);
+    uint64_t seen = 0;
+
+    int i;
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += readStat(&histogram->buckets[i]);
+        if (seen > target) {
+            return 2ULL << i;
+        }
+    }
+    return (count > 0) ? readStat(&histogram->maxNs) : 0;
+}
+
+/*
+ * NAME: printHistogramJson
+ * PARAMS: Pointer to the output file, the histogram's name and pointer to the histogram
+ * RETURN: void
+ * DESCRIPTION: Prints "name": {...} with the count, mean, percentiles and
+ * every bucket up to the last one in use
+ */
+static inline void printHistogramJson(FILE* file, const char* name, const struct LatencyHistogram* histogram) {
+    uint64_t count = readStat(&histogram->count);
+    int used = HISTOGRAM_BUCKETS;
+    while (used > 0 && readStat(&histogram->buckets[used - 1]) == 0) {
+        used--;
+    }
+
+    fprintf(file, "\"%s\": {\"count\": %llu, \"mean_ns\": %.0f, \"p50_ns\": %llu, \"p99_ns\": %llu, "
+            "\"max_ns\": %llu, \"buckets\": [", name, (unsigned long long)count,
+            (count > 0) ? (double)readStat(&histogram->totalNs) / count : 0.0,
+            (unsigned long long)getHistogramPercentile(histogram, 50),
+            (unsigned long long)getHistogramPercentile(histogram, 99),
+            (unsigned long long)readStat(&histogram->maxNs));
+
+    int i;
+    for (i = 0; i < used; i++) {
+        fprintf(file, "%s%llu", (i > 0) ? ", " : "", (unsigned long long)readStat(&histogram->buckets[i]));
+    }
+    fprintf(file, "]}");
+}
+
+/*
+ * NAME: openStatsFile
+ * PARAMS: Pointer to the file name, "-" for standard error
+ * RETURN: The file to print one dump to
+ * DESCRIPTION: Dumps are appended so a file holds one line per dump
+ */
+static inline FILE* openStatsFile(const char* fileName) {
+    if (strcmp(fileName, "-") == 0) {
+        return stderr;
+    }
+    return fopen(fileName, "a");
+}
+
+/*
+ * NAME: closeStatsFile
+ * PARAMS: Pointer to the file from openStatsFile
+ * RETURN: void
+ * DESCRIPTION: Ends the dump's line and closes the file
+ */
+static inline void closeStatsFile(FILE* file) {
+    fprintf(file, "\n");
+    if (file == stderr) {
+        fflush(file);
+    } else {
+        fclose(file);
+    }
+}
+
+/*
+ * NAME: runStatsThread
+ * PARAMS: Pointer to the function that writes a dump
+ * RETURN: NULL
+ * DESCRIPTION: Waits for STATS_SIGNAL and writes a dump each time it comes,
+ * so dumps are written from a normal thread rather than a signal handler
+ */
+static inline void* runStatsThread(void* argument) {
+    void (*writeStats)(void) = (void (*)(void))argument;
+    sigset_t signals;
+    int signalNumber;
+
+    sigemptyset(&signals);
+    sigaddset(&signals, STATS_SIGNAL);
+    while (sigwait(&signals, &signalNumber) == 0) {
+        pthread_mutex_lock(&statsLock);
+        writeStats();
+        pthread_mutex_unlock(&statsLock);
+    }
+    return NULL;
+}
+
+/*
+ * NAME: startStatsThread
+ * PARAMS: Pointer to the function that writes a dump
+ * RETURN: void
+ * DESCRIPTION: Blocks STATS_SIGNAL and starts the thread that waits for it.
+ * Must be called before any other thread is started so they all inherit
+ * the blocked signal.
+ */
+static inline void startStatsThread(void (*writeStats)(void)) {
+    sigset_t signals;
+    pthread_t thread;
+
+    sigemptyset(&signals);
+    sigaddset(&signals, STATS_SIGNAL);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    int result = pthread_create(&thread, NULL, &runStatsThread, (void*)writeStats);
+    assert(result == 0);
+    pthread_detach(thread);
+}
+
+/*
+ * NAME: finishStats
+ * PARAMS: Pointer to the function that writes a dump
+ * RETURN: void
+ * DESCRIPTION: Writes the final dump at exit
+ */
+static inline void finishStats(void (*writeStats)(void)) {
+    pthread_mutex_lock(&statsLock);
+    writeStats();
+    pthread_mutex_unlock(&statsLock);
+}
+
+#endif
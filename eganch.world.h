@@ -0,0 +1,259 @@
+/*
+ * FILE NAME: eganch.world.h
+ * DESCRIPTION: Layout of the packed binary world file shared by
+ * eganch.buildrooms (which writes it) and eganch.adventure (which maps it
+ * and uses it in place). A world file is a header followed by 8 byte
+ * aligned sections:
+ *   connection offsets  numRooms + 1 uint32, room i's connections are
+ *                       connections[offsets[i]] .. connections[offsets[i + 1] - 1]
+ *   connections         numConnections uint32 room ids
+ *   name offsets        numRooms uint32 byte offsets into the name table
+ *   name table          NUL terminated room names
+ *   name index          nameIndexSize uint32 slots of an open addressing hash
+ *                       table from room name to room id + 1 (0 is empty),
+ *                       probed linearly from hashRoomName(name)
+ * The checksum covers every byte after the header. eganch.adventure --shared
+ * publishes worlds in this layout in POSIX shared memory, one segment per
+ * world named by getSharedWorldName so eganch.buildrooms can remove it.
+ * AUTHOR: Chelsea Egan (eganch@oregonstate.edu)
+ */
+
+#ifndef EGANCH_WORLD_H
+#define EGANCH_WORLD_H
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WORLD_MAGIC "EGWORLD"
+#define WORLD_MAGIC_SIZE 8
+#define WORLD_VERSION 2
+#define WORLD_FILE_SUFFIX ".world"
+#define WORLD_ALIGNMENT 8
+#define CHECKSUM_SEED 14695981039346656037ULL
+#define CHECKSUM_PRIME 1099511628211ULL
+#define NAME_INDEX_EMPTY 0
+#define SHARED_WORLD_PREFIX "/eganch.world."
+#define SHARED_WORLD_NAME_SIZE 64
+
+struct WorldHeader {
+    char magic[WORLD_MAGIC_SIZE];
+    uint32_t version;
+    uint32_t numRooms;
+    uint64_t numConnections;
+    uint32_t startRoom;
+    uint32_t endRoom;
+    uint64_t connectionOffsetsStart;
+    uint64_t connectionsStart;
+    uint64_t nameOffsetsStart;
+    uint64_t namesStart;
+    uint64_t namesSize;
+    uint64_t nameIndexStart;
+    uint64_t nameIndexSize;
+    uint64_t fileSize;
+    uint64_t checksum;
+};
+
+/*
+ * NAME: alignWorldOffset
+ * PARAMS: Byte offset into the world file
+ * RETURN: The offset rounded up to the section alignment
+ * DESCRIPTION: Sections start on 8 byte boundaries so they can be used in place
+ */
+static inline uint64_t alignWorldOffset(uint64_t offset) {
+    return (offset + WORLD_ALIGNMENT - 1) & ~(uint64_t)(WORLD_ALIGNMENT - 1);
+}
+
+/*
+ * NAME: updateChecksum
+ * PARAMS: Running checksum, pointer to the data and its size in bytes
+ * RETURN: The checksum including the new data
+ * DESCRIPTION: 64 bit FNV-1a, start from CHECKSUM_SEED
+ */
+static inline uint64_t updateChecksum(uint64_t checksum, const void* data, size_t size) {
+    const unsigned char* bytes = data;
+    size_t i;
+    for (i = 0; i < size; i++) {
+        checksum ^= bytes[i];
+        checksum *= CHECKSUM_PRIME;
+    }
+    return checksum;
+}
+
+/*
+ * NAME: isValidWorldSection
+ * PARAMS: Section start, number of elements, element size and the size of the world file
+ * RETURN: 1 if the section starts aligned after the header and ends inside the file, 0 otherwise
+ * DESCRIPTION: Bounds checks one section of a world file without overflowing
+ */
+static inline int isValidWorldSection(uint64_t start, uint64_t count, uint64_t elementSize, uint64_t fileSize) {
+    return start >= sizeof(struct WorldHeader)
+           && start % WORLD_ALIGNMENT == 0
+           && start <= fileSize
+           && count <= (fileSize - start) / elementSize;
+}
+
+/*
+ * NAME: isValidWorldHeader
+ * PARAMS: Pointer to the header and the size of the world file
+ * RETURN: 1 if the header describes a world of this format that fits the file, 0 otherwise
+ * DESCRIPTION: Checks a world file's header before its sections are used.
+ * Every section must fit in the file and the name index must be a power of
+ * two in size for its masked probe. isValidWorldImage then checks what the
+ * sections hold.
+ */
+static inline int isValidWorldHeader(const struct WorldHeader* header, uint64_t fileSize) {
+    return fileSize >= sizeof(struct WorldHeader)
+           && memcmp(header->magic, WORLD_MAGIC, sizeof(WORLD_MAGIC)) == 0
+           && header->version == WORLD_VERSION
+           && header->fileSize == fileSize
+           && isValidWorldSection(header->connectionOffsetsStart, (uint64_t)header->numRooms + 1,
+                                  sizeof(uint32_t), fileSize)
+           && isValidWorldSection(header->connectionsStart, header->numConnections, sizeof(uint32_t), fileSize)
+           && isValidWorldSection(header->nameOffsetsStart, header->numRooms, sizeof(uint32_t), fileSize)
+           && isValidWorldSection(header->namesStart, header->namesSize, 1, fileSize)
+           && isValidWorldSection(header->nameIndexStart, header->nameIndexSize, sizeof(uint32_t), fileSize)
+           && header->nameIndexSize > 0
+           && (header->nameIndexSize & (header->nameIndexSize - 1)) == 0
+           && header->startRoom < header->numRooms
+           && header->endRoom < header->numRooms;
+}
+
+/*
+ * NAME: isValidWorldImage
+ * PARAMS: Pointer to a world whose header passed isValidWorldHeader
+ * RETURN: 1 if every room id, offset and name in the world stays inside it, 0 otherwise
+ * DESCRIPTION: Checks a world's sections before they are used in place, in
+ * one pass over its rooms, connections and name index, so a damaged world
+ * cannot be read out of bounds even without its checksum being verified.
+ * Room i's connections must run up to room i + 1's, every connection and
+ * name index entry must name a room, every name must start in the name
+ * table and the table must end in a NUL. The name index must have an empty
+ * slot so probes for names not in it end.
+ */
+static inline int isValidWorldImage(const struct WorldHeader* header) {
+    const char* base = (const char*)header;
+    const uint32_t* connectionOffsets = (const uint32_t*)(base + header->connectionOffsetsStart);
+    const uint32_t* connections = (const uint32_t*)(base + header->connectionsStart);
+    const uint32_t* nameOffsets = (const uint32_t*)(base + header->nameOffsetsStart);
+    const uint32_t* nameIndex = (const uint32_t*)(base + header->nameIndexStart);
+    uint64_t i;
+
+    if (connectionOffsets[0] != 0 || connectionOffsets[header->numRooms] != header->numConnections
+        || header->namesSize == 0 || base[header->namesStart + header->namesSize - 1] != '\0') {
+        return 0;
+    }
+    for (i = 0; i < header->numRooms; i++) {
+        if (connectionOffsets[i] > connectionOffsets[i + 1] || nameOffsets[i] >= header->namesSize) {
+            return 0;
+        }
+    }
+    for (i = 0; i < header->numConnections; i++) {
+        if (connections[i] >= header->numRooms) {
+            return 0;
+        }
+    }
+
+    int hasEmptySlot = 0;
+    for (i = 0; i < header->nameIndexSize; i++) {
+        if (nameIndex[i] > header->numRooms) {
+            return 0;
+        }
+        hasEmptySlot |= (nameIndex[i] == NAME_INDEX_EMPTY);
+    }
+    return hasEmptySlot;
+}
+
+/*
+ * NAME: hashRoomName
+ * PARAMS: Pointer to a NUL terminated room name
+ * RETURN: 64 bit hash of the name
+ * DESCRIPTION: Hash used for the room name index
+ */
+static inline uint64_t hashRoomName(const char* name) {
+    uint64_t hash = CHECKSUM_SEED;
+    while (*name != '\0') {
+        hash ^= (unsigned char)*name++;
+        hash *= CHECKSUM_PRIME;
+    }
+    return hash ^ (hash >> 32);
+}
+
+/*
+ * NAME: getNameIndexSize
+ * PARAMS: Number of rooms in the world
+ * RETURN: Number of slots in the name index
+ * DESCRIPTION: Smallest power of two that keeps the index at most half full
+ */
+static inline uint64_t getNameIndexSize(uint64_t numRooms) {
+    uint64_t size = 16;
+    while (size < numRooms * 2) {
+        size *= 2;
+    }
+    return size;
+}
+
+/*
+ * NAME: insertNameIndex
+ * PARAMS: Pointer to the index, its size, pointer to the room name and the room id
+ * RETURN: void
+ * DESCRIPTION: Adds a room to the name index in the first free slot after
+ * its hash. Names are expected to be unique.
+ */
+static inline void insertNameIndex(uint32_t* nameIndex, uint64_t nameIndexSize, const char* name,
+                                   uint32_t roomId) {
+    uint64_t slot = hashRoomName(name) & (nameIndexSize - 1);
+
+    while (nameIndex[slot] != NAME_INDEX_EMPTY) {
+        slot = (slot + 1) & (nameIndexSize - 1);
+    }
+
+    nameIndex[slot] = roomId + 1;
+}
+
+/*
+ * NAME: findNameIndex
+ * PARAMS: Pointer to the index, its size, pointer to the room name, the name table and name offsets
+ * RETURN: The room id, or -1 if no room has that name
+ * DESCRIPTION: Looks up a room id by name with one hash and, almost always,
+ * one name comparison
+ */
+static inline int64_t findNameIndex(const uint32_t* nameIndex, uint64_t nameIndexSize, const char* name,
+                                    const char* names, const uint32_t* nameOffsets) {
+    uint64_t slot = hashRoomName(name) & (nameIndexSize - 1);
+
+    while (nameIndex[slot] != NAME_INDEX_EMPTY) {
+        uint32_t roomId = nameIndex[slot] - 1;
+        if (strcmp(names + nameOffsets[roomId], name) == 0) {
+            return roomId;
+        }
+        slot = (slot + 1) & (nameIndexSize - 1);
+    }
+
+    return -1;
+}
+
+/*
+ * NAME: getSharedWorldName
+ * PARAMS: Pointer to the world's path and pointer to a SHARED_WORLD_NAME_SIZE buffer
+ * RETURN: 1 if the world was found and named, 0 otherwise
+ * DESCRIPTION: Names the shared memory segment a world is published in after
+ * the world's full path, so however the world is reached, and whatever it
+ * was edited to, it has the one segment
+ */
+static inline int getSharedWorldName(const char* worldPath, char* name) {
+    char fullPath[PATH_MAX];
+
+    if (realpath(worldPath, fullPath) == NULL) {
+        return 0;
+    }
+
+    snprintf(name, SHARED_WORLD_NAME_SIZE, "%s%016llx", SHARED_WORLD_PREFIX,
+             (unsigned long long)updateChecksum(CHECKSUM_SEED, fullPath, strlen(fullPath)));
+    return 1;
+}
+
+#endif